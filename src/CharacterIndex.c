@@ -0,0 +1,382 @@
+
+#include "CharacterIndex.h"
+
+#include <string.h>
+
+#include "mem.h"
+#include "Hash.h"
+#include "SWAR.h"
+#include "WordCounter.h"
+
+// Names shorter than this are normalized on the stack when looking them up.
+#define NAME_BUFFER_SIZE 256
+
+struct CharacterIndex
+{
+	CharacterEntry *entries;
+	uint32_t *name_offsets;
+	size_t len;
+	size_t cap;
+	
+	// Entries by normalized name.
+	HashTable slots;
+	
+	// Normalized names, each followed by a NUL.
+	char *names;
+	size_t names_len;
+	size_t names_cap;
+	
+	// Every cue in document order along with the index of its entry, until finalizing groups them by entry.
+	ASTNode **cues;
+	uint32_t *owners;
+	size_t cue_count;
+	size_t cue_cap;
+	
+	// Entries sorted by name, built by the first completion.
+	CharacterEntry **sorted;
+};
+
+CharacterIndex *character_index_new()
+{
+	CharacterIndex *index = c_calloc(1, sizeof(CharacterIndex));
+	
+	hash_table_init(&index->slots, 64);
+	
+	return index;
+}
+
+void character_index_free(CharacterIndex *index)
+{
+	free(index->entries);
+	free(index->name_offsets);
+	hash_table_free(&index->slots);
+	free(index->names);
+	free(index->cues);
+	free(index->owners);
+	free(index->sorted);
+	
+	free(index);
+}
+
+static inline int is_name_space(char c)
+{
+	return c == ' ' || c == '\t';
+}
+
+// Writes the normalized form of `name` to `out`, which must have room for `length` bytes, and returns its length. Its 32-bit FNV-1a hash is computed along the way and stored in `hash`.
+static uint32_t normalize_name(const char *name,
+							   size_t length,
+							   char *out,
+							   uint32_t *hash)
+{
+	uint32_t n = 0;
+	uint32_t h = FNV_OFFSET_BASIS;
+	int pending_space = 0;
+	
+	for (size_t i = 0; i < length; ++i) {
+		unsigned char c = name[i];
+		
+		if (is_name_space(c)) {
+			pending_space = n > 0;
+			continue;
+		}
+		
+		if (pending_space) {
+			out[n++] = ' ';
+			h = (h ^ ' ') * FNV_PRIME;
+			pending_space = 0;
+		}
+		
+		c -= (c - 'a' < 26u) ? 'a' - 'A' : 0;
+		
+		out[n++] = c;
+		h = (h ^ c) * FNV_PRIME;
+	}
+	
+	*hash = h;
+	
+	return n;
+}
+
+typedef struct
+{
+	CharacterIndex *index;
+	const char *name;
+	uint32_t length;
+} NameKey;
+
+static int name_equals(const void *context,
+					   uint32_t e)
+{
+	const NameKey *key = context;
+	CharacterIndex *index = key->index;
+	
+	return index->entries[e].name_length == key->length && memcmp(index->names + index->name_offsets[e], key->name, key->length) == 0;
+}
+
+// Returns the slot that holds `name`, or the empty slot where it belongs.
+static HashSlot *find_slot(CharacterIndex *index,
+						   const char *name,
+						   uint32_t length,
+						   uint32_t hash)
+{
+	NameKey key = { index, name, length };
+	
+	return hash_table_find(&index->slots, hash, name_equals, &key);
+}
+
+void character_index_add_cue(CharacterIndex *index,
+							 ASTNode *cue,
+							 const char *source)
+{
+	SRange range = cue->as.cue.name->range;
+	
+	// Normalize straight into the end of the name buffer, and only keep it there if the name is new.
+	if (index->names_len + range.length + 1 > index->names_cap) {
+		index->names_cap = (index->names_cap + range.length + 1) * 2;
+		index->names = c_realloc(index->names, index->names_cap);
+	}
+	
+	char *name = index->names + index->names_len;
+	uint32_t hash;
+	uint32_t length = normalize_name(source + range.location, range.length, name, &hash);
+	
+	HashSlot *slot = find_slot(index, name, length, hash);
+	uint32_t owner = slot->entry - 1;
+	
+	if (!slot->entry) {
+		if (index->len >= index->cap) {
+			index->cap = index->cap ? index->cap * 2 : 32;
+			index->entries = c_realloc(index->entries, index->cap * sizeof(CharacterEntry));
+			index->name_offsets = c_realloc(index->name_offsets, index->cap * sizeof(uint32_t));
+		}
+		
+		size_t e = index->len++;
+		
+		memset(index->entries + e, 0, sizeof(CharacterEntry));
+		index->entries[e].name_length = length;
+		index->name_offsets[e] = (uint32_t)index->names_len;
+		
+		name[length] = '\0';
+		index->names_len += length + 1;
+		
+		hash_table_insert(&index->slots, slot, hash, (uint32_t)e);
+		owner = (uint32_t)e;
+	}
+	
+	if (index->cue_count >= index->cue_cap) {
+		index->cue_cap = index->cue_cap ? index->cue_cap * 2 : 64;
+		index->cues = c_realloc(index->cues, index->cue_cap * sizeof(ASTNode*));
+		index->owners = c_realloc(index->owners, index->cue_cap * sizeof(uint32_t));
+	}
+	
+	index->cues[index->cue_count] = cue;
+	index->owners[index->cue_count] = owner;
+	++index->cue_count;
+}
+
+// Parentheticals and comments aren't spoken.
+#define UNSPOKEN_MASK (S_NODE_MASK(S_NODE_PARENTHETICAL) | S_NODE_MASK(S_NODE_COMMENT))
+
+static void count_cue(CharacterEntry *entry,
+					  ASTNode *cue,
+					  const char *source)
+{
+	ASTNode *dir = cue->as.cue.direction;
+	
+	if (dir->type == S_NODE_LYRIC_DIRECTION) {
+		for (ASTNode *line = dir->first_child; line; line = line->next) {
+			++entry->line_count;
+			entry->word_count += word_counter_count_stream(line->first_child, source, UNSPOKEN_MASK);
+		}
+	} else if (dir->first_child) {
+		++entry->line_count;
+		entry->word_count += word_counter_count_stream(dir->first_child, source, UNSPOKEN_MASK);
+	}
+}
+
+static int compare_entries_by_name(const void *a,
+								   const void *b)
+{
+	const CharacterEntry *x = *(CharacterEntry * const *)a;
+	const CharacterEntry *y = *(CharacterEntry * const *)b;
+	
+	return strcmp(x->name, y->name);
+}
+
+void character_index_finalize(CharacterIndex *index,
+							  const char *source)
+{
+	CharacterEntry *entries = index->entries;
+	
+	for (size_t e = 0; e < index->len; ++e)
+		entries[e].name = index->names + index->name_offsets[e];
+	
+	// Counting sort the cues by entry, keeping document order within each.
+	for (size_t i = 0; i < index->cue_count; ++i)
+		++entries[index->owners[i]].cue_count;
+	
+	ASTNode **grouped = c_malloc((index->cue_count + 1) * sizeof(ASTNode*));
+	
+	size_t start = 0;
+	for (size_t e = 0; e < index->len; ++e) {
+		entries[e].cues = grouped + start;
+		start += entries[e].cue_count;
+		entries[e].cue_count = 0;
+	}
+	
+	for (size_t i = 0; i < index->cue_count; ++i) {
+		CharacterEntry *entry = entries + index->owners[i];
+		entry->cues[entry->cue_count++] = index->cues[i];
+		
+		count_cue(entry, index->cues[i], source);
+	}
+	
+	free(index->cues);
+	free(index->owners);
+	index->cues = grouped;
+	index->owners = NULL;
+}
+
+size_t character_index_count(CharacterIndex *index)
+{
+	return index->len;
+}
+
+CharacterEntry *character_index_get_entries(CharacterIndex *index)
+{
+	return index->entries;
+}
+
+CharacterEntry *character_index_lookup(CharacterIndex *index,
+									   const char *name,
+									   size_t length)
+{
+	char buffer[NAME_BUFFER_SIZE];
+	char *normalized = length <= NAME_BUFFER_SIZE ? buffer : c_malloc(length);
+	
+	uint32_t hash;
+	uint32_t n = normalize_name(name, length, normalized, &hash);
+	HashSlot *slot = find_slot(index, normalized, n, hash);
+	
+	if (normalized != buffer)
+		free(normalized);
+	
+	return slot->entry ? index->entries + (slot->entry - 1) : NULL;
+}
+
+// Upper-cases the ASCII letters among the bytes of `w`.
+static inline uint64_t fold_case(uint64_t w)
+{
+	uint64_t heptets = w & LOWS;
+	uint64_t lower = (heptets + ONES * (0x80 - 'a')) & ~(heptets + ONES * (0x7F - 'z')) & ~w & HIGHS;
+	
+	return w ^ (lower >> 2);
+}
+
+/* Hashes `name` a word at a time with its case folded. Returns 0 if the name has leading, trailing, doubled or tab whitespace, because then it only hashes the same as names that normalize the same once normalized. */
+static int hash_name_words(const char *name,
+						   size_t length,
+						   uint64_t *hash)
+{
+	if (length && (is_name_space(name[0]) || is_name_space(name[length - 1])))
+		return 0;
+	
+	uint64_t h = length;
+	uint64_t prev_spaces = 0;
+	
+	for (size_t i = 0; i < length; i += 8) {
+		uint64_t w = 0;
+		memcpy(&w, name + i, length - i < 8 ? length - i : 8);
+		
+		uint64_t spaces = zero_bytes(w ^ (ONES * ' '));
+		if (zero_bytes(w ^ (ONES * '\t')) || (spaces & ((spaces << 8) | (prev_spaces >> 56))))
+			return 0;
+		
+		prev_spaces = spaces;
+		
+		h = hash_mix_word(h, fold_case(w));
+	}
+	
+	*hash = h;
+	
+	return 1;
+}
+
+uint64_t character_name_key(const char *name,
+							size_t length)
+{
+	uint64_t hash;
+	if (hash_name_words(name, length, &hash))
+		return hash;
+	
+	char buffer[NAME_BUFFER_SIZE];
+	char *normalized = length <= NAME_BUFFER_SIZE ? buffer : c_malloc(length);
+	
+	uint32_t fnv;
+	uint32_t n = normalize_name(name, length, normalized, &fnv);
+	hash_name_words(normalized, n, &hash);
+	
+	if (normalized != buffer)
+		free(normalized);
+	
+	return hash;
+}
+
+// Returns the first sorted entry whose name, cut to `length` bytes, compares above `prefix` (or at or above it, if `inclusive`).
+static size_t lower_bound(CharacterIndex *index,
+						  const char *prefix,
+						  uint32_t length,
+						  int inclusive)
+{
+	size_t lo = 0;
+	size_t hi = index->len;
+	
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+		int cmp = strncmp(index->sorted[mid]->name, prefix, length);
+		
+		if (cmp < 0 || (!inclusive && cmp == 0))
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	
+	return lo;
+}
+
+size_t character_index_complete(CharacterIndex *index,
+								const char *prefix,
+								size_t length,
+								CharacterEntry **out,
+								size_t cap)
+{
+	char buffer[NAME_BUFFER_SIZE];
+	char *normalized = length <= NAME_BUFFER_SIZE ? buffer : c_malloc(length);
+	
+	// Keep a trailing space, so that `Audio ` completes to `AUDIO FX` but not `AUDIOBOOK`.
+	uint32_t hash;
+	uint32_t n = normalize_name(prefix, length, normalized, &hash);
+	if (length && is_name_space(prefix[length - 1]) && n)
+		normalized[n++] = ' ';
+	
+	// Most documents are never completed, so only pay for sorting the names here.
+	if (!index->sorted) {
+		index->sorted = c_malloc((index->len + 1) * sizeof(CharacterEntry*));
+		for (size_t e = 0; e < index->len; ++e)
+			index->sorted[e] = index->entries + e;
+		
+		qsort(index->sorted, index->len, sizeof(CharacterEntry*), compare_entries_by_name);
+	}
+	
+	size_t first = lower_bound(index, normalized, n, 1);
+	size_t last = lower_bound(index, normalized, n, 0);
+	
+	if (normalized != buffer)
+		free(normalized);
+	
+	for (size_t i = first; i < last && i - first < cap; ++i)
+		out[i - first] = index->sorted[i];
+	
+	return last - first;
+}
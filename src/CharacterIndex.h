@@ -0,0 +1,75 @@
+
+#ifndef CharacterIndex_h
+#define CharacterIndex_h
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "nodes.h"
+
+/** Everything a document's cues say about one character. `name` is the
+ * normalized name shared by all of the character's cues, and `cues` holds
+ * them in document order. Lines count each plain direction once and each
+ * lyric line once. Words are counted in spoken text only, so
+ * parentheticals and comments don't count.
+ */
+typedef struct
+{
+	const char *name;
+	uint32_t name_length;
+	
+	ASTNode **cues;
+	uint32_t cue_count;
+	
+	uint32_t line_count;
+	uint32_t word_count;
+} CharacterEntry;
+
+/** Groups the cues of a document by character name. Names are interned with
+ * ASCII letters upper-cased and runs of whitespace collapsed to one space,
+ * so `Jack`, `JACK` and ` jack ` are the same character.
+ */
+typedef struct CharacterIndex CharacterIndex;
+
+CharacterIndex *character_index_new(void);
+
+void character_index_free(CharacterIndex *index);
+
+/** Records `cue` under its name. Cues must be added in document order. */
+void character_index_add_cue(CharacterIndex *index,
+							 ASTNode *cue,
+							 const char *source);
+
+/** Groups the cues of each character and counts their lines and words. Must
+ * be called once every cue has been added and their directions are final.
+ */
+void character_index_finalize(CharacterIndex *index,
+							  const char *source);
+
+size_t character_index_count(CharacterIndex *index);
+
+/** Returns every character in order of their first cue. */
+CharacterEntry *character_index_get_entries(CharacterIndex *index);
+
+/** Returns the character called `name` after normalization, or NULL. */
+CharacterEntry *character_index_lookup(CharacterIndex *index,
+									   const char *name,
+									   size_t length);
+
+/** Stores up to `cap` characters whose normalized names start with `prefix`
+ * in `out`, in alphabetical order, and returns how many there are in total.
+ * Runs in O(log n) plus the number of matches stored.
+ */
+size_t character_index_complete(CharacterIndex *index,
+								const char *prefix,
+								size_t length,
+								CharacterEntry **out,
+								size_t cap);
+
+/** Returns a 64-bit hash of `name` that is equal for names that normalize
+ * the same. Most names are hashed in place, 8 bytes at a time.
+ */
+uint64_t character_name_key(const char *name,
+							size_t length);
+
+#endif /* CharacterIndex_h */
@@ -0,0 +1,656 @@
+
+#include "Diff.h"
+
+#include <string.h>
+
+#include "mem.h"
+#include "Hash.h"
+
+// Search budgets, in steps per element. Past the full budget, the rest of a region is reported as one edit rather than the shortest.
+#define DIFF_QUICK_BUDGET 16
+#define DIFF_FULL_BUDGET 1024
+#define DIFF_MIN_BUDGET 4096
+
+struct BlockDiff
+{
+	DiffOp *ops;
+	size_t len;
+	size_t cap;
+	
+	// The word-level changes of every modified block, back to back.
+	DiffOp *changes;
+	size_t change_len;
+	size_t change_cap;
+};
+
+static inline int is_diff_space(char c)
+{
+	return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+void diff_hash_blocks(ASTNode **blocks,
+					  size_t count,
+					  const char *source,
+					  uint64_t *hashes)
+{
+	for (size_t i = 0; i < count; ++i) {
+		const char *s = source + blocks[i]->range.location;
+		uint32_t len = blocks[i]->range.length;
+		
+		uint64_t h = (FNV_OFFSET_BASIS_64 ^ blocks[i]->type) * FNV_PRIME_64;
+		int pending_space = 0;
+		int started = 0;
+		
+		for (uint32_t k = 0; k < len; ++k) {
+			unsigned char c = s[k];
+			
+			if (is_diff_space(c)) {
+				pending_space = started;
+				continue;
+			}
+			
+			// A space only counts between words.
+			if (pending_space)
+				h = (h ^ ' ') * FNV_PRIME_64;
+			
+			pending_space = 0;
+			started = 1;
+			h = (h ^ c) * FNV_PRIME_64;
+		}
+		
+		hashes[i] = h;
+	}
+}
+
+// A run of elements a[a0, a1) replaced by b[b0, b1). Either run may be empty.
+typedef struct
+{
+	uint32_t a0, a1;
+	uint32_t b0, b1;
+} Edit;
+
+// Edits in order, with adjacent ones merged.
+typedef struct
+{
+	Edit *edits;
+	size_t len;
+	size_t cap;
+} EditScript;
+
+static void edit_script_add(EditScript *script,
+							uint32_t a0,
+							uint32_t a1,
+							uint32_t b0,
+							uint32_t b1)
+{
+	if (script->len) {
+		Edit *last = script->edits + script->len - 1;
+		
+		if (last->a1 == a0 && last->b1 == b0) {
+			last->a1 = a1;
+			last->b1 = b1;
+			return;
+		}
+	}
+	
+	if (script->len >= script->cap) {
+		script->cap = script->cap ? script->cap * 2 : 16;
+		script->edits = c_realloc(script->edits, script->cap * sizeof(Edit));
+	}
+	
+	Edit edit = { a0, a1, b0, b1 };
+	script->edits[script->len++] = edit;
+}
+
+typedef struct
+{
+	const uint64_t *a;
+	const uint64_t *b;
+	
+	// Furthest reaching paths, forward and backward, indexed by diagonal plus `offset`.
+	long *vf;
+	long *vb;
+	long offset;
+	
+	// Diagonals and comparisons left before giving up.
+	long budget;
+	
+	EditScript *script;
+} Myers;
+
+/* Finds the middle snake of the shortest edit script between a[a0, a0+n) and b[b0, b0+k), by running the search forward from the start and backward from the end until the two meet. Stores the snake's start in (x, y) and its end in (u, v), relative to a0 and b0. Returns 0 if the search runs out of budget. */
+static int myers_middle_snake(Myers *m,
+							   uint32_t a0,
+							   long n,
+							   uint32_t b0,
+							   long k,
+							   long *x,
+							   long *y,
+							   long *u,
+							   long *v)
+{
+	const uint64_t *a = m->a + a0;
+	const uint64_t *b = m->b + b0;
+	
+	long *vf = m->vf + m->offset;
+	long *vb = m->vb + m->offset;
+	
+	long delta = n - k;
+	int odd = delta & 1;
+	long max = (n + k + 1) / 2;
+	
+	vf[1] = 0;
+	vb[1] = 0;
+	
+	for (long d = 0; d <= max && m->budget >= 0; ++d) {
+		for (long diag = -d; diag <= d; diag += 2) {
+			long px = (diag == -d || (diag != d && vf[diag - 1] < vf[diag + 1])) ? vf[diag + 1] : vf[diag - 1] + 1;
+			long py = px - diag;
+			long sx = px;
+			long sy = py;
+			
+			while (px < n && py < k && a[px] == b[py]) {
+				++px;
+				++py;
+			}
+			
+			vf[diag] = px;
+			m->budget -= 1 + (px - sx);
+			
+			long back = delta - diag;
+			if (odd && back >= -(d - 1) && back <= d - 1 && vf[diag] + vb[back] >= n) {
+				*x = sx;
+				*y = sy;
+				*u = px;
+				*v = py;
+				return 1;
+			}
+		}
+		
+		for (long diag = -d; diag <= d; diag += 2) {
+			long px = (diag == -d || (diag != d && vb[diag - 1] < vb[diag + 1])) ? vb[diag + 1] : vb[diag - 1] + 1;
+			long py = px - diag;
+			long sx = px;
+			long sy = py;
+			
+			while (px < n && py < k && a[n - px - 1] == b[k - py - 1]) {
+				++px;
+				++py;
+			}
+			
+			vb[diag] = px;
+			m->budget -= 1 + (px - sx);
+			
+			long forward = delta - diag;
+			if (!odd && forward >= -d && forward <= d && vb[diag] + vf[forward] >= n) {
+				*x = n - px;
+				*y = k - py;
+				*u = n - sx;
+				*v = k - sy;
+				return 1;
+			}
+		}
+	}
+	
+	return 0;
+}
+
+static void myers_diff(Myers *m,
+					   uint32_t a0,
+					   uint32_t a1,
+					   uint32_t b0,
+					   uint32_t b1)
+{
+	// Shared runs at either end are common, and cost nothing to skip.
+	while (a0 < a1 && b0 < b1 && m->a[a0] == m->b[b0]) {
+		++a0;
+		++b0;
+	}
+	
+	while (a0 < a1 && b0 < b1 && m->a[a1 - 1] == m->b[b1 - 1]) {
+		--a1;
+		--b1;
+	}
+	
+	if (a0 == a1 || b0 == b1) {
+		if (a0 < a1 || b0 < b1)
+			edit_script_add(m->script, a0, a1, b0, b1);
+		return;
+	}
+	
+	// Once out of budget, whatever is left becomes one edit.
+	long x, y, u, v;
+	if (!myers_middle_snake(m, a0, a1 - a0, b0, b1 - b0, &x, &y, &u, &v)) {
+		edit_script_add(m->script, a0, a1, b0, b1);
+		return;
+	}
+	
+	myers_diff(m, a0, a0 + (uint32_t)x, b0, b0 + (uint32_t)y);
+	myers_diff(m, a0 + (uint32_t)u, a1, b0 + (uint32_t)v, b1);
+}
+
+// Diffs a[a0, a1) against b[b0, b1) into `script`. Returns 0 if it took more than `budget` steps, in which case the script is still valid, but not the shortest.
+static int myers_run(const uint64_t *a,
+					 uint32_t a0,
+					 uint32_t a1,
+					 const uint64_t *b,
+					 uint32_t b0,
+					 uint32_t b1,
+					 long budget,
+					 EditScript *script)
+{
+	Myers m;
+	m.a = a;
+	m.b = b;
+	m.offset = (long)((a1 - a0 + b1 - b0 + 1) / 2) + 1;
+	m.vf = c_malloc((2 * m.offset + 1) * sizeof(long));
+	m.vb = c_malloc((2 * m.offset + 1) * sizeof(long));
+	m.budget = budget;
+	m.script = script;
+	
+	myers_diff(&m, a0, a1, b0, b1);
+	
+	free(m.vf);
+	free(m.vb);
+	
+	return m.budget >= 0;
+}
+
+// Adds the entries of a set of hashes, kept at most half full. Hashes equal to `empty` are tracked on the side.
+typedef struct
+{
+	uint64_t *slots;
+	size_t mask;
+	int has_empty;
+} HashSet;
+
+#define HASH_SET_EMPTY 0
+
+static void hash_set_init(HashSet *set,
+						  const uint64_t *hashes,
+						  size_t count)
+{
+	size_t size = 16;
+	while (size < count * 2)
+		size *= 2;
+	
+	set->slots = c_calloc(size, sizeof(uint64_t));
+	set->mask = size - 1;
+	set->has_empty = 0;
+	
+	for (size_t i = 0; i < count; ++i) {
+		uint64_t h = hashes[i];
+		
+		if (h == HASH_SET_EMPTY) {
+			set->has_empty = 1;
+			continue;
+		}
+		
+		size_t k = (size_t)(h ^ (h >> 32)) & set->mask;
+		while (set->slots[k] && set->slots[k] != h)
+			k = (k + 1) & set->mask;
+		
+		set->slots[k] = h;
+	}
+}
+
+static int hash_set_contains(HashSet *set,
+							 uint64_t h)
+{
+	if (h == HASH_SET_EMPTY)
+		return set->has_empty;
+	
+	size_t k = (size_t)(h ^ (h >> 32)) & set->mask;
+	while (set->slots[k]) {
+		if (set->slots[k] == h)
+			return 1;
+		
+		k = (k + 1) & set->mask;
+	}
+	
+	return 0;
+}
+
+// Keeps the elements of `hashes` that are also in `other`, storing them in `kept` and their indices in `indices`. Returns how many there are.
+static size_t keep_shared(const uint64_t *hashes,
+						  size_t count,
+						  const uint64_t *other,
+						  size_t other_count,
+						  uint32_t first,
+						  uint64_t *kept,
+						  uint32_t *indices)
+{
+	HashSet set;
+	hash_set_init(&set, other, other_count);
+	
+	size_t n = 0;
+	for (size_t i = 0; i < count; ++i) {
+		if (hash_set_contains(&set, hashes[i])) {
+			kept[n] = hashes[i];
+			indices[n] = first + (uint32_t)i;
+			++n;
+		}
+	}
+	
+	free(set.slots);
+	
+	return n;
+}
+
+/* Diffs a[0, n) against b[0, k) into the empty `script`. If a quick search fails, there are many changes, and then elements that don't appear on the other side at all can only be edits. The search runs again over the rest, and its matches are mapped back to find the edits in between. */
+static void diff_sequences(const uint64_t *a,
+						   size_t n,
+						   const uint64_t *b,
+						   size_t k,
+						   EditScript *script)
+{
+	size_t prefix = 0;
+	while (prefix < n && prefix < k && a[prefix] == b[prefix])
+		++prefix;
+	
+	size_t suffix = 0;
+	while (suffix < n - prefix && suffix < k - prefix && a[n - suffix - 1] == b[k - suffix - 1])
+		++suffix;
+	
+	uint32_t a0 = (uint32_t)prefix;
+	uint32_t a1 = (uint32_t)(n - suffix);
+	uint32_t b0 = (uint32_t)prefix;
+	uint32_t b1 = (uint32_t)(k - suffix);
+	
+	if (a0 == a1 || b0 == b1) {
+		if (a0 < a1 || b0 < b1)
+			edit_script_add(script, a0, a1, b0, b1);
+		return;
+	}
+	
+	// Most revisions change little, so first try a search whose budget only covers a few edits.
+	if (myers_run(a, a0, a1, b, b0, b1, DIFF_QUICK_BUDGET * (long)(a1 - a0 + b1 - b0) + DIFF_MIN_BUDGET, script))
+		return;
+	
+	script->len = 0;
+	
+	uint64_t *ra = c_malloc((a1 - a0) * sizeof(uint64_t));
+	uint64_t *rb = c_malloc((b1 - b0) * sizeof(uint64_t));
+	uint32_t *ia = c_malloc((a1 - a0) * sizeof(uint32_t));
+	uint32_t *ib = c_malloc((b1 - b0) * sizeof(uint32_t));
+	
+	size_t rn = keep_shared(a + a0, a1 - a0, b + b0, b1 - b0, a0, ra, ia);
+	size_t rk = keep_shared(b + b0, b1 - b0, a + a0, a1 - a0, b0, rb, ib);
+	
+	EditScript reduced = { NULL, 0, 0 };
+	myers_run(ra, 0, (uint32_t)rn, rb, 0, (uint32_t)rk, DIFF_FULL_BUDGET * (long)(rn + rk) + DIFF_MIN_BUDGET, &reduced);
+	
+	// Everything between two consecutive matches is an edit.
+	uint32_t next_a = a0;
+	uint32_t next_b = b0;
+	size_t i = 0;
+	size_t j = 0;
+	
+	for (size_t e = 0; e <= reduced.len; ++e) {
+		size_t match_end = (e < reduced.len) ? reduced.edits[e].a0 : rn;
+		
+		for (; i < match_end; ++i, ++j) {
+			if (next_a < ia[i] || next_b < ib[j])
+				edit_script_add(script, next_a, ia[i], next_b, ib[j]);
+			
+			next_a = ia[i] + 1;
+			next_b = ib[j] + 1;
+		}
+		
+		if (e < reduced.len) {
+			i = reduced.edits[e].a1;
+			j = reduced.edits[e].b1;
+		}
+	}
+	
+	if (next_a < a1 || next_b < b1)
+		edit_script_add(script, next_a, a1, next_b, b1);
+	
+	free(reduced.edits);
+	free(ra);
+	free(rb);
+	free(ia);
+	free(ib);
+}
+
+static DiffOp *push_op(DiffOp **ops,
+					   size_t *len,
+					   size_t *cap)
+{
+	if (*len >= *cap) {
+		*cap = *cap ? *cap * 2 : 16;
+		*ops = c_realloc(*ops, *cap * sizeof(DiffOp));
+	}
+	
+	DiffOp *op = *ops + (*len)++;
+	memset(op, 0, sizeof(DiffOp));
+	
+	return op;
+}
+
+// The words of a block, with a hash of each.
+typedef struct
+{
+	SRange *ranges;
+	uint64_t *hashes;
+	size_t len;
+	size_t cap;
+} Words;
+
+static void split_words(ASTNode *block,
+						const char *source,
+						Words *words)
+{
+	words->len = 0;
+	
+	uint32_t i = block->range.location;
+	uint32_t end = s_range_max(block->range);
+	
+	while (i < end) {
+		if (is_diff_space(source[i])) {
+			++i;
+			continue;
+		}
+		
+		uint32_t start = i;
+		uint64_t h = FNV_OFFSET_BASIS_64;
+		
+		for (; i < end && !is_diff_space(source[i]); ++i)
+			h = (h ^ (unsigned char)source[i]) * FNV_PRIME_64;
+		
+		if (words->len >= words->cap) {
+			words->cap = words->cap ? words->cap * 2 : 64;
+			words->ranges = c_realloc(words->ranges, words->cap * sizeof(SRange));
+			words->hashes = c_realloc(words->hashes, words->cap * sizeof(uint64_t));
+		}
+		
+		SRange range = { start, i - start };
+		words->ranges[words->len] = range;
+		words->hashes[words->len] = h;
+		++words->len;
+	}
+}
+
+// The range of words [w0, w1), or an empty range where word w0 would be.
+static SRange words_range(Words *words,
+						  uint32_t w0,
+						  uint32_t w1,
+						  ASTNode *block)
+{
+	SRange range;
+	
+	if (w0 < w1) {
+		range.location = words->ranges[w0].location;
+		range.length = s_range_max(words->ranges[w1 - 1]) - range.location;
+	} else {
+		range.location = (w0 < words->len) ? words->ranges[w0].location : s_range_max(block->range);
+		range.length = 0;
+	}
+	
+	return range;
+}
+
+// Diffs the words of two blocks, appending the changes to `diff`.
+static void diff_words(BlockDiff *diff,
+					   DiffOp *op,
+					   ASTNode *old_block,
+					   const char *old_source,
+					   ASTNode *new_block,
+					   const char *new_source,
+					   Words *old_words,
+					   Words *new_words)
+{
+	split_words(old_block, old_source, old_words);
+	split_words(new_block, new_source, new_words);
+	
+	EditScript script = { NULL, 0, 0 };
+	diff_sequences(old_words->hashes, old_words->len, new_words->hashes, new_words->len, &script);
+	
+	for (size_t i = 0; i < script.len; ++i) {
+		Edit *edit = script.edits + i;
+		DiffOp *change = push_op(&diff->changes, &diff->change_len, &diff->change_cap);
+		
+		change->type = (edit->a0 == edit->a1) ? DIFF_INSERT : (edit->b0 == edit->b1) ? DIFF_DELETE : DIFF_MODIFY;
+		change->old_block = op->old_block;
+		change->new_block = op->new_block;
+		change->old_range = words_range(old_words, edit->a0, edit->a1, old_block);
+		change->new_range = words_range(new_words, edit->b0, edit->b1, new_block);
+	}
+	
+	op->change_count = (uint32_t)script.len;
+	
+	free(script.edits);
+}
+
+// The range of blocks [b0, b1), or an empty range where block b0 would be.
+static SRange blocks_range(const DiffInput *input,
+						   uint32_t b0,
+						   uint32_t b1)
+{
+	SRange range;
+	
+	if (b0 < b1) {
+		range.location = input->blocks[b0]->range.location;
+		range.length = s_range_max(input->blocks[b1 - 1]->range) - range.location;
+	} else {
+		range.location = (b0 < input->count) ? input->blocks[b0]->range.location : input->length;
+		range.length = 0;
+	}
+	
+	return range;
+}
+
+// Adds an insertion or deletion of one block, merging it with the op before if that's the same kind and adjacent.
+static void add_block_op(BlockDiff *diff,
+						 DiffOpType type,
+						 const DiffInput *old_input,
+						 uint32_t i,
+						 const DiffInput *new_input,
+						 uint32_t j)
+{
+	uint32_t old_end = i + (type == DIFF_DELETE);
+	uint32_t new_end = j + (type == DIFF_INSERT);
+	
+	DiffOp *last = diff->len ? diff->ops + diff->len - 1 : NULL;
+	DiffOp *op;
+	
+	if (last && last->type == type && last->old_block + last->old_count == i && last->new_block + last->new_count == j) {
+		op = last;
+	} else {
+		op = push_op(&diff->ops, &diff->len, &diff->cap);
+		op->type = type;
+		op->old_block = i;
+		op->new_block = j;
+	}
+	
+	op->old_count = old_end - op->old_block;
+	op->new_count = new_end - op->new_block;
+	op->old_range = blocks_range(old_input, op->old_block, old_end);
+	op->new_range = blocks_range(new_input, op->new_block, new_end);
+}
+
+BlockDiff *block_diff_compute(const DiffInput *old_input,
+							  const DiffInput *new_input)
+{
+	BlockDiff *diff = c_calloc(1, sizeof(BlockDiff));
+	
+	EditScript script = { NULL, 0, 0 };
+	diff_sequences(old_input->hashes, old_input->count, new_input->hashes, new_input->count, &script);
+	
+	Words old_words = { NULL, NULL, 0, 0 };
+	Words new_words = { NULL, NULL, 0, 0 };
+	
+	// Where each modify op's changes start, until the change array stops growing.
+	uint32_t *starts = NULL;
+	size_t starts_cap = 0;
+	
+	for (size_t e = 0; e < script.len; ++e) {
+		Edit *edit = script.edits + e;
+		uint32_t i = edit->a0;
+		uint32_t j = edit->b0;
+		
+		// Pair blocks of the same type in order. Otherwise drop whichever side has more left over.
+		while (i < edit->a1 || j < edit->b1) {
+			ASTNode *old_block = (i < edit->a1) ? old_input->blocks[i] : NULL;
+			ASTNode *new_block = (j < edit->b1) ? new_input->blocks[j] : NULL;
+			
+			if (old_block && new_block && old_block->type == new_block->type) {
+				DiffOp *op = push_op(&diff->ops, &diff->len, &diff->cap);
+				op->type = DIFF_MODIFY;
+				op->old_block = i;
+				op->old_count = 1;
+				op->new_block = j;
+				op->new_count = 1;
+				op->old_range = old_block->range;
+				op->new_range = new_block->range;
+				
+				if (diff->len > starts_cap) {
+					starts_cap = diff->cap;
+					starts = c_realloc(starts, starts_cap * sizeof(uint32_t));
+				}
+				
+				starts[diff->len - 1] = (uint32_t)diff->change_len;
+				diff_words(diff, op, old_block, old_input->source, new_block, new_input->source, &old_words, &new_words);
+				
+				++i;
+				++j;
+			} else if (old_block && (!new_block || edit->a1 - i >= edit->b1 - j)) {
+				add_block_op(diff, DIFF_DELETE, old_input, i++, new_input, j);
+			} else {
+				add_block_op(diff, DIFF_INSERT, old_input, i, new_input, j++);
+			}
+		}
+	}
+	
+	for (size_t k = 0; k < diff->len; ++k) {
+		if (diff->ops[k].type == DIFF_MODIFY)
+			diff->ops[k].changes = diff->changes + starts[k];
+	}
+	
+	free(starts);
+	free(old_words.ranges);
+	free(old_words.hashes);
+	free(new_words.ranges);
+	free(new_words.hashes);
+	free(script.edits);
+	
+	return diff;
+}
+
+void block_diff_free(BlockDiff *diff)
+{
+	free(diff->ops);
+	free(diff->changes);
+	
+	free(diff);
+}
+
+size_t block_diff_count(BlockDiff *diff)
+{
+	return diff->len;
+}
+
+DiffOp *block_diff_get_ops(BlockDiff *diff)
+{
+	return diff->ops;
+}
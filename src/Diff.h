@@ -0,0 +1,81 @@
+
+#ifndef Diff_h
+#define Diff_h
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "nodes.h"
+
+typedef enum
+{
+	DIFF_INSERT,
+	DIFF_DELETE,
+	DIFF_MODIFY
+} DiffOpType;
+
+/** One change between two versions of a document. Block ops replace
+ * `old_count` top-level blocks starting at `old_block` with `new_count`
+ * blocks starting at `new_block`, and a modify op always pairs one block of
+ * each. Ranges cover the blocks' source, and are empty where the other side
+ * has nothing, placed where the change happens.
+ *
+ * A modified block lists its word-level changes in `changes`. Those have
+ * both counts set to 0 and ranges that cover whole words.
+ */
+typedef struct DiffOp
+{
+	DiffOpType type;
+	
+	uint32_t old_block;
+	uint32_t old_count;
+	uint32_t new_block;
+	uint32_t new_count;
+	
+	SRange old_range;
+	SRange new_range;
+	
+	struct DiffOp *changes;
+	uint32_t change_count;
+} DiffOp;
+
+/** The top-level blocks of one version, along with the hash of each from
+ * `diff_hash_blocks`.
+ */
+typedef struct
+{
+	ASTNode **blocks;
+	const uint64_t *hashes;
+	size_t count;
+	const char *source;
+	uint32_t length;
+} DiffInput;
+
+/** The changes between two versions, in document order. */
+typedef struct BlockDiff BlockDiff;
+
+/** Stores a hash of each block's type and source in `hashes`. Runs of
+ * whitespace count as a single space and leading and trailing whitespace
+ * is ignored, so reflowing a block doesn't change it.
+ */
+void diff_hash_blocks(ASTNode **blocks,
+					  size_t count,
+					  const char *source,
+					  uint64_t *hashes);
+
+/** Diffs the block hashes of `old` and `new` with Myers' algorithm in
+ * linear space, after skipping the blocks they share at either end. Within
+ * each run of changed blocks, blocks of the same type are paired up as
+ * modifications and diffed word by word. Beyond hashing, time grows with
+ * the number of changes rather than the length of the documents.
+ */
+BlockDiff *block_diff_compute(const DiffInput *old_input,
+							  const DiffInput *new_input);
+
+void block_diff_free(BlockDiff *diff);
+
+size_t block_diff_count(BlockDiff *diff);
+
+DiffOp *block_diff_get_ops(BlockDiff *diff);
+
+#endif /* Diff_h */
@@ -0,0 +1,146 @@
+
+#include "Escape.h"
+
+#include <string.h>
+
+#include "SWAR.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+static const char *const entities[256] = {
+	['&'] = "&amp;",
+	['<'] = "&lt;",
+	['>'] = "&gt;",
+	['"'] = "&quot;",
+	['\''] = "&#39;"
+};
+
+static const uint8_t entity_lengths[256] = {
+	['&'] = 5,
+	['<'] = 4,
+	['>'] = 4,
+	['"'] = 6,
+	['\''] = 5
+};
+
+// Control characters get `\u00XX` unless they have a shorter form. Each sequence is 6 bytes or less.
+static const char *const json_sequences[256] = {
+	"\\u0000", "\\u0001", "\\u0002", "\\u0003", "\\u0004", "\\u0005", "\\u0006", "\\u0007",
+	"\\b", "\\t", "\\n", "\\u000b", "\\f", "\\r", "\\u000e", "\\u000f",
+	"\\u0010", "\\u0011", "\\u0012", "\\u0013", "\\u0014", "\\u0015", "\\u0016", "\\u0017",
+	"\\u0018", "\\u0019", "\\u001a", "\\u001b", "\\u001c", "\\u001d", "\\u001e", "\\u001f",
+	['"'] = "\\\"",
+	['\\'] = "\\\\"
+};
+
+const char *escape_entity(unsigned char c,
+						  uint32_t *length)
+{
+	*length = entity_lengths[c];
+	
+	return entities[c];
+}
+
+// Sets the high bit of every byte of `w` that equals `c`, and possibly of bytes above one that does.
+static inline uint64_t swar_match(uint64_t w,
+								  unsigned char c)
+{
+	uint64_t x = w ^ (ONES * c);
+	
+	return (x - ONES) & ~x & HIGHS;
+}
+
+size_t escape_find(const char *s,
+				   size_t length)
+{
+	size_t i = 0;
+
+#ifdef __SSE2__
+	const __m128i amp = _mm_set1_epi8('&');
+	const __m128i lt = _mm_set1_epi8('<');
+	const __m128i gt = _mm_set1_epi8('>');
+	const __m128i quot = _mm_set1_epi8('"');
+	const __m128i apos = _mm_set1_epi8('\'');
+	
+	for (; i + 16 <= length; i += 16) {
+		__m128i v = _mm_loadu_si128((const __m128i *)(s + i));
+		
+		__m128i m = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, amp), _mm_cmpeq_epi8(v, lt)),
+								 _mm_or_si128(_mm_cmpeq_epi8(v, gt), _mm_cmpeq_epi8(v, quot)));
+		m = _mm_or_si128(m, _mm_cmpeq_epi8(v, apos));
+		
+		int mask = _mm_movemask_epi8(m);
+		if (mask)
+			return i + __builtin_ctz(mask);
+	}
+#endif
+	
+	// Borrows can flag a byte above a real match, but never one below it, so the first flagged byte is always right.
+	for (; i + 8 <= length; i += 8) {
+		uint64_t w;
+		memcpy(&w, s + i, 8);
+		
+		uint64_t m = swar_match(w, '&') | swar_match(w, '<') | swar_match(w, '>') | swar_match(w, '"') | swar_match(w, '\'');
+		if (m)
+			break;
+	}
+	
+	for (; i < length; ++i) {
+		if (entity_lengths[(unsigned char)s[i]])
+			return i;
+	}
+	
+	return length;
+}
+
+const char *escape_json_sequence(unsigned char c,
+								 uint32_t *length)
+{
+	const char *sequence = json_sequences[c];
+	*length = sequence ? (uint32_t)strlen(sequence) : 0;
+	
+	return sequence;
+}
+
+size_t escape_find_json(const char *s,
+						size_t length)
+{
+	size_t i = 0;
+
+#ifdef __SSE2__
+	const __m128i quot = _mm_set1_epi8('"');
+	const __m128i backslash = _mm_set1_epi8('\\');
+	const __m128i control = _mm_set1_epi8(0x1f);
+	
+	for (; i + 16 <= length; i += 16) {
+		__m128i v = _mm_loadu_si128((const __m128i *)(s + i));
+		
+		// Bytes at or below 0x1f are the ones the unsigned max leaves at 0x1f.
+		__m128i m = _mm_or_si128(_mm_cmpeq_epi8(v, quot), _mm_cmpeq_epi8(v, backslash));
+		m = _mm_or_si128(m, _mm_cmpeq_epi8(_mm_max_epu8(v, control), control));
+		
+		int mask = _mm_movemask_epi8(m);
+		if (mask)
+			return i + __builtin_ctz(mask);
+	}
+#endif
+	
+	for (; i + 8 <= length; i += 8) {
+		uint64_t w;
+		memcpy(&w, s + i, 8);
+		
+		// The last term flags bytes below 0x20, with the same borrows as `swar_match`.
+		uint64_t m = swar_match(w, '"') | swar_match(w, '\\') | ((w - ONES * 0x20) & ~w & HIGHS);
+		if (m)
+			break;
+	}
+	
+	for (; i < length; ++i) {
+		if (json_sequences[(unsigned char)s[i]])
+			return i;
+	}
+	
+	return length;
+}
@@ -0,0 +1,34 @@
+
+#ifndef Escape_h
+#define Escape_h
+
+#include <stdint.h>
+#include <stddef.h>
+
+/** Returns the offset of the first byte of `s` that needs escaping in HTML
+ * or XML (`&`, `<`, `>`, `"` or `'`), or `length` if none does. Text is
+ * checked 16 bytes at a time with SSE2 where it's available and 8 bytes at a
+ * time otherwise, so runs of plain text cost little more than copying them.
+ */
+size_t escape_find(const char *s,
+				   size_t length);
+
+/** Returns the entity that replaces `c` and stores its length in `length`,
+ * or NULL if `c` doesn't need escaping.
+ */
+const char *escape_entity(unsigned char c,
+						  uint32_t *length);
+
+/** Like `escape_find`, for the bytes that need escaping in a JSON string:
+ * `"`, `\` and control characters below 0x20.
+ */
+size_t escape_find_json(const char *s,
+						size_t length);
+
+/** Returns the escape sequence that replaces `c` in a JSON string and stores
+ * its length in `length`, or NULL if `c` doesn't need escaping.
+ */
+const char *escape_json_sequence(unsigned char c,
+								 uint32_t *length);
+
+#endif /* Escape_h */
@@ -0,0 +1,43 @@
+
+#ifndef Format_h
+#define Format_h
+
+#include <stdint.h>
+#include <string.h>
+
+/** The decimal digits of 0 to 99, two to a number. */
+extern const char format_digit_pairs[201];
+
+/** The most bytes `format_uint32` writes. */
+#define FORMAT_UINT32_MAX 10
+
+/** Writes `value` in decimal at `p` and returns the end of it. Digits are
+ * produced two at a time from a table, back to front, so a number costs a
+ * few stores rather than a call to `sprintf`.
+ */
+static inline char *format_uint32(char *p,
+								  uint32_t value)
+{
+	char digits[FORMAT_UINT32_MAX];
+	char *end = digits + sizeof(digits);
+	char *q = end;
+	
+	while (value >= 100) {
+		q -= 2;
+		memcpy(q, format_digit_pairs + (value % 100) * 2, 2);
+		value /= 100;
+	}
+	
+	if (value >= 10) {
+		q -= 2;
+		memcpy(q, format_digit_pairs + value * 2, 2);
+	} else {
+		*--q = '0' + value;
+	}
+	
+	memcpy(p, q, end - q);
+	
+	return p + (end - q);
+}
+
+#endif /* Format_h */
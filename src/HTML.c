@@ -1,11 +1,14 @@
 
 #include "HTML.h"
 
-#include <stdlib.h>
+#include <pthread.h>
+#include <string.h>
 
 #include "nodes.h"
+#include "mem.h"
 #include "Walker.h"
 #include "MarkupContext.h"
+#include "Renderer.h"
 
 void render_div_tag_to_markup_context(const char *class,
 									  uint32_t class_length,
@@ -40,106 +43,441 @@ void render_p_tag_in_markup_context(MarkupContext *ctx,
 }
 
 void render_inline_tag_to_markup_context(const char *tag,
+										 uint32_t tag_length,
 										 WalkerEvent event,
 										 MarkupContext *ctx)
 {
 	if (event == EVENT_ENTER) {
-		markup_context_put(ctx, "", 0);
+		markup_context_put(ctx, "<", 1);
+		markup_context_put(ctx, tag, tag_length);
+		markup_context_put(ctx, ">", 1);
 	} else {
-		markup_context_put(ctx, "", 0);
+		markup_context_put(ctx, "</", 2);
+		markup_context_put(ctx, tag, tag_length);
+		markup_context_put(ctx, ">", 1);
 	}
 }
 
-void render_node_to_markup_context(ASTNode *node,
-								   WalkerEvent event,
+void render_span_tag_to_markup_context(const char *class,
+									   uint32_t class_length,
+									   WalkerEvent event,
+									   MarkupContext *ctx)
+{
+	if (event == EVENT_ENTER) {
+		markup_context_put(ctx, "<span class=\"", 13);
+		markup_context_put(ctx, class, class_length);
+		markup_context_put(ctx, "\">", 2);
+	} else {
+		markup_context_put(ctx, "</span>", 7);
+	}
+}
+
+static inline int is_html_space(char c)
+{
+	return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+static inline void render_text_to_markup_context(ASTNode *node,
+												 const char *source,
+												 MarkupContext *ctx)
+{
+	markup_context_put_escaped(ctx, source + node->range.location, node->range.length);
+}
+
+// A target is relative unless a `:` comes before any `/`, `?` or `#`, and then only web and mail schemes are let through, so that `[javascript:...]` can't become a live link.
+static int reference_target_is_safe(const char *target,
+									uint32_t length)
+{
+	static const char *const schemes[] = { "http", "https", "mailto" };
+	
+	uint32_t i = 0;
+	while (i < length && target[i] != ':' && target[i] != '/' && target[i] != '?' && target[i] != '#')
+		++i;
+	
+	if (i == length || target[i] != ':')
+		return 1;
+	
+	for (size_t s = 0; s < sizeof(schemes) / sizeof(schemes[0]); ++s) {
+		if (strlen(schemes[s]) != i)
+			continue;
+		
+		uint32_t k = 0;
+		while (k < i && (target[k] | 0x20) == schemes[s][k])
+			++k;
+		
+		if (k == i)
+			return 1;
+	}
+	
+	return 0;
+}
+
+// Renders a reference as a link to its target, with the brackets and surrounding whitespace left out. Targets with any other scheme are rendered as an anchor without an href.
+void render_reference_to_markup_context(ASTNode *node,
+										const char *source,
+										MarkupContext *ctx)
+{
+	const char *target = source + node->range.location + 1;
+	uint32_t length = node->range.length >= 2 ? node->range.length - 2 : 0;
+	
+	while (length && (target[0] == ' ' || target[0] == '\t')) {
+		++target;
+		--length;
+	}
+	
+	while (length && (target[length - 1] == ' ' || target[length - 1] == '\t'))
+		--length;
+	
+	if (reference_target_is_safe(target, length)) {
+		markup_context_put(ctx, "<a class=\"reference\" href=\"", 27);
+		markup_context_put_escaped(ctx, target, length);
+		markup_context_put(ctx, "\">", 2);
+	} else {
+		markup_context_put(ctx, "<a class=\"reference\">", 21);
+	}
+	
+	markup_context_put_escaped(ctx, target, length);
+	markup_context_put(ctx, "</a>", 4);
+}
+
+static const char *const header_open_tags[] = { "<h1>", "<h2>", "<h3>", "<h4>" };
+static const char *const header_close_tags[] = { "</h1>", "</h2>", "</h3>", "</h4>" };
+
+// Forced headers are rendered like acts.
+static inline int header_level(ASTNode *node)
+{
+	return (node->as.header.type == HEADER_FORCED) ? 0 : node->as.header.type;
+}
+
+static inline int html_enter_header(ASTNode *node,
+									const char *source,
+									void *info)
+{
+	markup_context_set_needs_new_line(info);
+	markup_context_put(info, header_open_tags[header_level(node)], 4);
+	return 0;
+}
+
+static inline int html_exit_header(ASTNode *node,
 								   const char *source,
-								   MarkupContext *ctx)
-{
-	int entering = (event == EVENT_ENTER);
-	
-	switch ((ASTNodeType)node->type) {
-		case S_NODE_HEADER: {
-			int headerType = node->as.header.type;
-			char level = (headerType == HEADER_FORCED) ? '1' : headerType + '1';
-			if (entering) {
-				markup_context_set_needs_new_line(ctx);
-				markup_context_put(ctx, "<h", 2);
-				markup_context_put(ctx, &level, 1);
-				markup_context_put(ctx, ">", 1);
-			} else {
-				markup_context_put(ctx, "</h", 3);
-				markup_context_put(ctx, &level, 1);
-				markup_context_put(ctx, ">", 1);
-				markup_context_set_needs_new_line(ctx);
-			}
-			break;
-		}
-		case S_NODE_DESCRIPTION:
-			render_p_tag_in_markup_context(ctx, entering);
-			break;
-		case S_NODE_SIMULTANEOUS_CUES:
-			render_div_tag_to_markup_context("simultaneous_cues", 17, entering, ctx);
-			break;
-		case S_NODE_FACSIMILE:
-			render_div_tag_to_markup_context("facsimile", 9, entering, ctx);
-			break;
-		case S_NODE_THEMATIC_BREAK:
-			if (entering) {
-				markup_context_set_needs_new_line(ctx);
-				markup_context_put(ctx, "<hr />", 6);
-				markup_context_set_needs_new_line(ctx);
-			}
-			break;
-		case S_NODE_END:
-			render_div_tag_to_markup_context("end", 3, entering, ctx);
-			break;
-		case S_NODE_CUE:
-			render_div_tag_to_markup_context("cue", 3, entering, ctx);
-			break;
-		case S_NODE_LYRIC_DIRECTION:
-			render_div_tag_to_markup_context("lyrics", 6, entering, ctx);
-			break;
-		case S_NODE_PLAIN_DIRECTION:
-			render_div_tag_to_markup_context("direction", 9, entering, ctx);
-			break;
-		case S_NODE_LINE:
-			render_p_tag_in_markup_context(ctx, entering);
-			break;
-		case S_NODE_KEYWORD:
-			break;
-		case S_NODE_IDENTIFIER:
-			break;
-		case S_NODE_TITLE:
-			break;
-		case S_NODE_NAME:
-			break;
-		case S_NODE_LITERAL:
-			break;
-		case S_NODE_EMPHASIS:
-			break;
-		case S_NODE_STRONG:
-			break;
-		case S_NODE_REFERENCE:
-			break;
-		case S_NODE_PARENTHETICAL:
-			break;
-		default:
-			break;
+								   void *info)
+{
+	markup_context_put(info, header_close_tags[header_level(node)], 5);
+	markup_context_set_needs_new_line(info);
+	return 0;
+}
+
+static inline int html_enter_p(ASTNode *node,
+							   const char *source,
+							   void *info)
+{
+	render_p_tag_in_markup_context(info, 1);
+	return 0;
+}
+
+static inline int html_exit_p(ASTNode *node,
+							  const char *source,
+							  void *info)
+{
+	render_p_tag_in_markup_context(info, 0);
+	return 0;
+}
+
+// Defines the enter and exit callbacks of a node rendered as a div of class `class`.
+#define HTML_DIV_CALLBACKS(name, class) \
+	static inline int html_enter_##name(ASTNode *node, const char *source, void *info) \
+	{ \
+		render_div_tag_to_markup_context(class, sizeof(class) - 1, 1, info); \
+		return 0; \
+	} \
+	static inline int html_exit_##name(ASTNode *node, const char *source, void *info) \
+	{ \
+		render_div_tag_to_markup_context(class, sizeof(class) - 1, 0, info); \
+		return 0; \
+	}
+
+HTML_DIV_CALLBACKS(simultaneous_cues, "simultaneous_cues")
+HTML_DIV_CALLBACKS(facsimile, "facsimile")
+HTML_DIV_CALLBACKS(end_div, "end")
+HTML_DIV_CALLBACKS(cue, "cue")
+HTML_DIV_CALLBACKS(lyrics, "lyrics")
+HTML_DIV_CALLBACKS(direction, "direction")
+
+// Defines the enter and exit callbacks of a node rendered as the inline element `tag`.
+#define HTML_INLINE_CALLBACKS(name, tag) \
+	static inline int html_enter_##name(ASTNode *node, const char *source, void *info) \
+	{ \
+		render_inline_tag_to_markup_context(tag, sizeof(tag) - 1, EVENT_ENTER, info); \
+		return 0; \
+	} \
+	static inline int html_exit_##name(ASTNode *node, const char *source, void *info) \
+	{ \
+		render_inline_tag_to_markup_context(tag, sizeof(tag) - 1, EVENT_EXIT, info); \
+		return 0; \
 	}
+
+HTML_INLINE_CALLBACKS(emphasis, "em")
+HTML_INLINE_CALLBACKS(strong, "strong")
+
+static inline int html_enter_thematic_break(ASTNode *node,
+											const char *source,
+											void *info)
+{
+	markup_context_set_needs_new_line(info);
+	markup_context_put(info, "<hr />", 6);
+	markup_context_set_needs_new_line(info);
+	return 0;
+}
+
+static inline int html_enter_end(ASTNode *node,
+								 const char *source,
+								 void *info)
+{
+	html_enter_end_div(node, source, info);
+	
+	// The end's range runs on through its line break.
+	uint32_t length = node->range.length;
+	while (length && is_html_space(source[node->range.location + length - 1]))
+		--length;
+	
+	markup_context_put_escaped(info, source + node->range.location, length);
+	return 0;
+}
+
+static inline int html_enter_text(ASTNode *node,
+								  const char *source,
+								  void *info)
+{
+	render_text_to_markup_context(node, source, info);
+	return 0;
+}
+
+static inline int html_enter_identifier(ASTNode *node,
+										const char *source,
+										void *info)
+{
+	markup_context_put(info, " ", 1);
+	render_text_to_markup_context(node, source, info);
+	return 0;
+}
+
+static inline int html_enter_title(ASTNode *node,
+								   const char *source,
+								   void *info)
+{
+	markup_context_put(info, " - ", 3);
+	render_span_tag_to_markup_context("title", 5, EVENT_ENTER, info);
+	return 0;
+}
+
+static inline int html_exit_span(ASTNode *node,
+								 const char *source,
+								 void *info)
+{
+	markup_context_put(info, "</span>", 7);
+	return 0;
+}
+
+static inline int html_enter_name(ASTNode *node,
+								  const char *source,
+								  void *info)
+{
+	markup_context_set_needs_new_line(info);
+	markup_context_put(info, "<p class=\"name\">", 16);
+	render_text_to_markup_context(node, source, info);
+	markup_context_put(info, "</p>", 4);
+	markup_context_set_needs_new_line(info);
+	return 0;
+}
+
+// The reference renders its own text, so its children are skipped.
+static inline int html_enter_reference(ASTNode *node,
+									   const char *source,
+									   void *info)
+{
+	render_reference_to_markup_context(node, source, info);
+	return 1;
+}
+
+static inline int html_enter_parenthetical(ASTNode *node,
+										   const char *source,
+										   void *info)
+{
+	render_span_tag_to_markup_context("parenthetical", 13, EVENT_ENTER, info);
+	markup_context_put(info, "(", 1);
+	return 0;
+}
+
+static inline int html_exit_parenthetical(ASTNode *node,
+										  const char *source,
+										  void *info)
+{
+	markup_context_put(info, ")", 1);
+	markup_context_put(info, "</span>", 7);
+	return 0;
+}
+
+// Comments are hidden.
+static inline int html_enter_comment(ASTNode *node,
+									 const char *source,
+									 void *info)
+{
+	return 1;
+}
+
+#define HTML_RENDERER(X) \
+	X(S_NODE_HEADER, html_enter_header, html_exit_header) \
+	X(S_NODE_DESCRIPTION, html_enter_p, html_exit_p) \
+	X(S_NODE_SIMULTANEOUS_CUES, html_enter_simultaneous_cues, html_exit_simultaneous_cues) \
+	X(S_NODE_FACSIMILE, html_enter_facsimile, html_exit_facsimile) \
+	X(S_NODE_THEMATIC_BREAK, html_enter_thematic_break, render_nothing) \
+	X(S_NODE_END, html_enter_end, html_exit_end_div) \
+	X(S_NODE_CUE, html_enter_cue, html_exit_cue) \
+	X(S_NODE_LYRIC_DIRECTION, html_enter_lyrics, html_exit_lyrics) \
+	X(S_NODE_PLAIN_DIRECTION, html_enter_direction, html_exit_direction) \
+	X(S_NODE_LINE, html_enter_p, html_exit_p) \
+	X(S_NODE_KEYWORD, html_enter_text, render_nothing) \
+	X(S_NODE_IDENTIFIER, html_enter_identifier, render_nothing) \
+	X(S_NODE_TITLE, html_enter_title, html_exit_span) \
+	X(S_NODE_NAME, html_enter_name, render_nothing) \
+	X(S_NODE_LITERAL, html_enter_text, render_nothing) \
+	X(S_NODE_EMPHASIS, html_enter_emphasis, html_exit_emphasis) \
+	X(S_NODE_STRONG, html_enter_strong, html_exit_strong) \
+	X(S_NODE_REFERENCE, html_enter_reference, render_nothing) \
+	X(S_NODE_PARENTHETICAL, html_enter_parenthetical, html_exit_parenthetical) \
+	X(S_NODE_COMMENT, html_enter_comment, render_nothing)
+
+static const RendererCallbacks html_callbacks = RENDERER_CALLBACKS(HTML_RENDERER);
+
+RENDERER_DEFINE(render_html, HTML_RENDERER)
+
+const RendererCallbacks *html_renderer_callbacks()
+{
+	return &html_callbacks;
 }
 
 void render_html_to_markup_context(MarkupContext *ctx,
 								   ASTNode *root,
 								   const char *source)
 {
-	Walker *walker = walker_new(root);
-	WalkerEvent event;
+	render_html(root, source, ctx);
+}
+
+// A run of consecutive blocks rendered by one thread into a context of its own.
+typedef struct
+{
+	ASTNode **blocks;
+	const char *source;
+	size_t first;
+	size_t last;
 	
-	while ((event = walker_next(walker)) != EVENT_DONE) {
-		ASTNode *current = walker_get_current_node(walker);
+	MarkupContext *ctx;
+} HTMLWorker;
+
+static void *html_worker_run(void *data)
+{
+	HTMLWorker *worker = data;
+	
+	// Every top-level block ends by asking for a new line, with nothing left indented.
+	if (worker->first)
+		markup_context_resume(worker->ctx, 0, 1);
+	
+	for (size_t i = worker->first; i < worker->last; ++i)
+		render_html(worker->blocks[i], worker->source, worker->ctx);
+	
+	return NULL;
+}
+
+void render_html_parallel(MarkupContext *ctx,
+						  ASTNode **blocks,
+						  size_t count,
+						  const char *source,
+						  int nthreads)
+{
+	if (!count)
+		return;
+	
+	size_t worker_count = nthreads > 1 ? (size_t)nthreads : 1;
+	if (worker_count > count)
+		worker_count = count;
+	
+	HTMLWorker *workers = c_calloc(worker_count, sizeof(HTMLWorker));
+	
+	// Share the blocks out by the size of their source, which output size follows closely.
+	uint32_t start = blocks[0]->range.location;
+	uint32_t length = s_range_max(blocks[count - 1]->range) - start;
+	size_t b = 0;
+	
+	for (size_t t = 0; t < worker_count; ++t) {
+		HTMLWorker *worker = workers + t;
+		uint64_t target = start + (uint64_t)length * (t + 1) / worker_count;
+		
+		worker->blocks = blocks;
+		worker->source = source;
+		worker->first = b;
 		
-		render_node_to_markup_context(current, event, source, ctx);
+		while (b < count && (t + 1 == worker_count || blocks[b]->range.location < target))
+			++b;
+		
+		worker->last = b;
+		worker->ctx = markup_context_new();
+		
+		// HTML runs to about three times the size of its source.
+		if (worker->last > worker->first) {
+			uint32_t end = s_range_max(blocks[worker->last - 1]->range);
+			markup_context_reserve(worker->ctx, 3 * (size_t)(end - blocks[worker->first]->range.location));
+		}
 	}
 	
-	free(walker);
+	pthread_t *threads = c_malloc(worker_count * sizeof(pthread_t));
+	int *started = c_calloc(worker_count, sizeof(int));
+	
+	// The calling thread takes the first share. A thread that fails to start has its share run here instead.
+	for (size_t t = 1; t < worker_count; ++t)
+		started[t] = pthread_create(threads + t, NULL, html_worker_run, workers + t) == 0;
+	
+	html_worker_run(workers);
+	
+	for (size_t t = 1; t < worker_count; ++t) {
+		if (started[t])
+			pthread_join(threads[t], NULL);
+		else
+			html_worker_run(workers + t);
+	}
+	
+	size_t total = 0;
+	for (size_t t = 0; t < worker_count; ++t)
+		total += markup_context_get_string(workers[t].ctx)->length;
+	
+	markup_context_reserve(ctx, total);
+	
+	// The first block starts on a new line like any other, which `ctx` adds only if it already has output.
+	markup_context_set_needs_new_line(ctx);
+	int wrote = 0;
+	
+	for (size_t t = 0; t < worker_count; ++t) {
+		StringBuffer *string = markup_context_get_string(workers[t].ctx);
+		const char *bytes = string->buffer;
+		size_t size = string->length;
+		
+		// A resumed run starts with the new line that separates it from the runs before, unless they were all empty.
+		if (!wrote && t && size) {
+			++bytes;
+			--size;
+		}
+		
+		if (size) {
+			markup_context_put(ctx, bytes, size);
+			wrote = 1;
+		}
+		
+		markup_context_free(workers[t].ctx);
+	}
+	
+	if (wrote)
+		markup_context_set_needs_new_line(ctx);
+	
+	free(started);
+	free(threads);
+	free(workers);
 }
@@ -4,4 +4,33 @@
 
 #include <stdio.h>
 
+#include "nodes.h"
+#include "MarkupContext.h"
+#include "Renderer.h"
+
+/** Renders `root` and its descendants as HTML into `ctx`. `root` may be the
+ * document or any node in it, such as a single top-level block.
+ */
+void render_html_to_markup_context(MarkupContext *ctx,
+								   ASTNode *root,
+								   const char *source);
+
+/** Renders `blocks`, the top-level blocks of a document, as HTML on up to
+ * `nthreads` threads. Each thread renders a contiguous run of blocks into a
+ * buffer of its own, and the buffers are copied into `ctx` in order, so the
+ * output is the same as `render_html_to_markup_context` on the document.
+ * `ctx` should be at the top level, with no indent.
+ */
+void render_html_parallel(MarkupContext *ctx,
+						  ASTNode **blocks,
+						  size_t count,
+						  const char *source,
+						  int nthreads);
+
+/** Returns the HTML renderer as a callback table for
+ * `render_with_callbacks`, with a `MarkupContext` as its context. Copy it to
+ * change how some node types render.
+ */
+const RendererCallbacks *html_renderer_callbacks(void);
+
 #endif /* HTML_h */
@@ -0,0 +1,150 @@
+
+#ifndef Hash_h
+#define Hash_h
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "mem.h"
+
+// Hash functions and the open-addressed table shared by the indexes, the text index builder and the render cache.
+
+#define FNV_OFFSET_BASIS 2166136261u
+#define FNV_PRIME 16777619u
+
+#define FNV_OFFSET_BASIS_64 14695981039346656037ull
+#define FNV_PRIME_64 1099511628211ull
+
+#define HASH_MULTIPLIER 0x9E3779B97F4A7C15ull
+
+// Mixes the 8 bytes in `w` into `h`.
+static inline uint64_t hash_mix_word(uint64_t h,
+									 uint64_t w)
+{
+	h = (h ^ w) * HASH_MULTIPLIER;
+	
+	return h ^ (h >> 29);
+}
+
+// Hashes `n` bytes of `s` a word at a time, starting from `h`. Not for anything an attacker chooses the keys of.
+static inline uint64_t hash_bytes(const char *s,
+								  size_t n,
+								  uint64_t h)
+{
+	uint64_t w;
+	
+	for (; n >= 8; s += 8, n -= 8) {
+		memcpy(&w, s, 8);
+		h = hash_mix_word(h, w);
+	}
+	
+	w = 0;
+	memcpy(&w, s, n);
+	h = (h ^ w) * HASH_MULTIPLIER;
+	
+	return h ^ (h >> 32);
+}
+
+// A slot keeps the hash of its entry, so probing rarely has to touch the entry itself. `entry` is the entry's index plus one, so that 0 marks an empty slot.
+typedef struct
+{
+	uint32_t hash;
+	uint32_t entry;
+} HashSlot;
+
+// Slots probed linearly from `hash & (count - 1)`. The count is a power of two, and the table grows to stay at most half full.
+typedef struct
+{
+	HashSlot *slots;
+	size_t count;
+	size_t len;
+} HashTable;
+
+static inline void hash_table_init(HashTable *table,
+								   size_t count)
+{
+	table->slots = c_calloc(count, sizeof(HashSlot));
+	table->count = count;
+	table->len = 0;
+}
+
+static inline void hash_table_free(HashTable *table)
+{
+	free(table->slots);
+}
+
+// Returns the slot of the entry with `hash` that `equals` accepts, or the empty slot where it belongs. `equals` is passed `context` and the index of each candidate entry.
+static inline HashSlot *hash_table_find(HashTable *table,
+										uint32_t hash,
+										int (*equals)(const void *context, uint32_t entry),
+										const void *context)
+{
+	size_t mask = table->count - 1;
+	
+	for (size_t i = hash & mask;; i = (i + 1) & mask) {
+		HashSlot *slot = table->slots + i;
+		if (!slot->entry || (slot->hash == hash && equals(context, slot->entry - 1)))
+			return slot;
+	}
+}
+
+static inline void hash_table_grow(HashTable *table)
+{
+	HashSlot *old = table->slots;
+	size_t old_count = table->count;
+	
+	table->count *= 2;
+	table->slots = c_calloc(table->count, sizeof(HashSlot));
+	
+	size_t mask = table->count - 1;
+	
+	for (size_t k = 0; k < old_count; ++k) {
+		if (!old[k].entry)
+			continue;
+		
+		size_t i = old[k].hash & mask;
+		while (table->slots[i].entry)
+			i = (i + 1) & mask;
+		
+		table->slots[i] = old[k];
+	}
+	
+	free(old);
+}
+
+// Stores `entry` in `slot`, an empty slot returned by `hash_table_find`. The table may grow, which moves every slot.
+static inline void hash_table_insert(HashTable *table,
+									 HashSlot *slot,
+									 uint32_t hash,
+									 uint32_t entry)
+{
+	slot->hash = hash;
+	slot->entry = entry + 1;
+	
+	if (++table->len * 2 > table->count)
+		hash_table_grow(table);
+}
+
+// Empties `slot`, moving later slots of the same run back so that lookups never stop short.
+static inline void hash_table_remove(HashTable *table,
+									 HashSlot *slot)
+{
+	size_t mask = table->count - 1;
+	size_t hole = slot - table->slots;
+	
+	for (size_t i = (hole + 1) & mask; table->slots[i].entry; i = (i + 1) & mask) {
+		size_t home = table->slots[i].hash & mask;
+		
+		// Only a slot whose home isn't between the hole and itself can fill the hole.
+		if (((i - home) & mask) >= ((i - hole) & mask)) {
+			table->slots[hole] = table->slots[i];
+			hole = i;
+		}
+	}
+	
+	table->slots[hole].entry = 0;
+	--table->len;
+}
+
+#endif /* Hash_h */
@@ -1,23 +1,204 @@
 
 #include "HeaderCounter.h"
 
+#include <string.h>
+
 void header_counter_increment_header_count(HeaderCounter *counter,
 										   HeaderType header_type)
+{
+	header_counter_set_header_count(counter, header_type, header_counter_get_header_count(counter, header_type) + 1);
+}
+
+void header_counter_set_header_count(HeaderCounter *counter,
+									 HeaderType header_type,
+									 int count)
 {
 	switch (header_type) {
 		case HEADER_ACT:
-			counter->act_count++;
+			counter->act_count = count;
+			counter->scene_count = 0;
+			counter->page_count = 0;
+			counter->frame_count = 0;
 			break;
 		case HEADER_SCENE:
-			counter->scene_count++;
+			counter->scene_count = count;
+			counter->page_count = 0;
+			counter->frame_count = 0;
 			break;
 		case HEADER_PAGE:
-			counter->page_count++;
+			counter->page_count = count;
+			counter->frame_count = 0;
 			break;
 		case HEADER_FRAME:
-			counter->frame_count++;
+			counter->frame_count = count;
 			break;
 		default:
 			break;
 	}
 }
+
+int header_counter_get_header_count(HeaderCounter *counter,
+									HeaderType header_type)
+{
+	switch (header_type) {
+		case HEADER_ACT:
+			return counter->act_count;
+		case HEADER_SCENE:
+			return counter->scene_count;
+		case HEADER_PAGE:
+			return counter->page_count;
+		case HEADER_FRAME:
+			return counter->frame_count;
+		default:
+			return 0;
+	}
+}
+
+static int roman_digit_value(char c)
+{
+	switch (c) {
+		case 'I': return 1;
+		case 'V': return 5;
+		case 'X': return 10;
+		case 'L': return 50;
+		case 'C': return 100;
+		case 'D': return 500;
+		case 'M': return 1000;
+		default: return 0;
+	}
+}
+
+static int parse_arabic_number(const char *s, uint32_t len)
+{
+	int value = 0;
+	
+	for (uint32_t i = 0; i < len; ++i) {
+		if (s[i] < '0' || s[i] > '9' || value > 100000)
+			return 0;
+		
+		value = value * 10 + (s[i] - '0');
+	}
+	
+	return value;
+}
+
+static int parse_roman_number(const char *s, uint32_t len)
+{
+	int value = 0;
+	
+	for (uint32_t i = 0; i < len; ++i) {
+		int digit = roman_digit_value(s[i]);
+		if (!digit)
+			return 0;
+		
+		int next = (i + 1 < len) ? roman_digit_value(s[i+1]) : 0;
+		value += (digit < next) ? -digit : digit;
+	}
+	
+	return value > 0 ? value : 0;
+}
+
+static const char *number_words[] = {
+	"zero", "one", "two", "three", "four", "five", "six", "seven", "eight", "nine", "ten",
+	"eleven", "twelve", "thirteen", "fourteen", "fifteen", "sixteen", "seventeen", "eighteen", "nineteen"
+};
+
+static const char *tens_words[] = {
+	"", "", "twenty", "thirty", "forty", "fifty", "sixty", "seventy", "eighty", "ninety"
+};
+
+static int word_equals(const char *s, uint32_t len, const char *word)
+{
+	if (strlen(word) != len)
+		return 0;
+	
+	for (uint32_t i = 0; i < len; ++i) {
+		char c = s[i];
+		if (c >= 'A' && c <= 'Z')
+			c += 'a' - 'A';
+		
+		if (c != word[i])
+			return 0;
+	}
+	
+	return 1;
+}
+
+// Parses numbers written out in English, from "One" to "Ninety Nine".
+static int parse_word_number(const char *s, uint32_t len)
+{
+	uint32_t split = 0;
+	while (split < len && s[split] != ' ')
+		++split;
+	
+	uint32_t rest = split;
+	while (rest < len && s[rest] == ' ')
+		++rest;
+	
+	for (int i = 1; i < 20; ++i) {
+		if (rest == len && word_equals(s, split, number_words[i]))
+			return i;
+	}
+	
+	for (int t = 2; t < 10; ++t) {
+		if (!word_equals(s, split, tens_words[t]))
+			continue;
+		
+		if (rest == len)
+			return t * 10;
+		
+		for (int i = 1; i < 10; ++i) {
+			if (word_equals(s + rest, len - rest, number_words[i]))
+				return t * 10 + i;
+		}
+	}
+	
+	return 0;
+}
+
+static int parse_identifier_number(const char *s, uint32_t len)
+{
+	int value;
+	
+	if ((value = parse_arabic_number(s, len)) ||
+		(value = parse_roman_number(s, len)) ||
+		(value = parse_word_number(s, len))) {
+		return value;
+	}
+	
+	return 0;
+}
+
+void header_counter_number_header(HeaderCounter *counter,
+								  ASTNode *header,
+								  const char *source,
+								  uint32_t *numbers)
+{
+	HeaderType type = header->as.header.type;
+	ASTNode *id = header->as.header.id;
+	
+	if (type != HEADER_FORCED) {
+		int explicit_number = 0;
+		if (id)
+			explicit_number = parse_identifier_number(source + id->range.location, id->range.length);
+		
+		if (explicit_number)
+			header_counter_set_header_count(counter, type, explicit_number);
+		else
+			header_counter_increment_header_count(counter, type);
+	}
+	
+	numbers[HEADER_ACT] = counter->act_count;
+	numbers[HEADER_SCENE] = counter->scene_count;
+	numbers[HEADER_PAGE] = counter->page_count;
+	numbers[HEADER_FRAME] = counter->frame_count;
+}
+
+void header_counter_restore(HeaderCounter *counter,
+							const uint32_t *numbers)
+{
+	counter->act_count = numbers[HEADER_ACT];
+	counter->scene_count = numbers[HEADER_SCENE];
+	counter->page_count = numbers[HEADER_PAGE];
+	counter->frame_count = numbers[HEADER_FRAME];
+}
@@ -11,7 +11,33 @@ typedef struct {
 	int frame_count;
 } HeaderCounter;
 
+/** Advances the count for `type`. Counts nest Act > Scene > Page > Frame, so
+ * advancing one resets every count below it.
+ */
 void header_counter_increment_header_count(HeaderCounter *counter,
 										   HeaderType type);
 
+/** Sets the count for `type` to `count`, resetting every count below it. */
+void header_counter_set_header_count(HeaderCounter *counter,
+									 HeaderType type,
+									 int count);
+
+int header_counter_get_header_count(HeaderCounter *counter,
+									HeaderType type);
+
+/** Numbers `header` and advances `counter` past it, storing the resolved act,
+ * scene, page and frame numbers in `numbers`, indexed by `HeaderType`. A
+ * header whose identifier is a number (arabic, roman, or written out in
+ * English) takes that number; any other header gets the next one in
+ * sequence. Forced headers keep the current numbers without advancing them.
+ */
+void header_counter_number_header(HeaderCounter *counter,
+								  ASTNode *header,
+								  const char *source,
+								  uint32_t *numbers);
+
+/** Sets `counter` to `numbers`, the numbers resolved for some header. */
+void header_counter_restore(HeaderCounter *counter,
+							const uint32_t *numbers);
+
 #endif /* HeaderCounter_h */
@@ -0,0 +1,147 @@
+
+#include "Highlight.h"
+
+#include "Renderer.h"
+
+typedef struct
+{
+	const char *source;
+	uint32_t start;
+	uint32_t end;
+	
+	CueSpan *out;
+	size_t cap;
+	size_t count;
+} Highlighter;
+
+static inline int is_space(char c)
+{
+	return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+// Literals, streams and lines only divide up the text of the node above them, so their text is styled as that node's.
+static inline uint32_t styled_type(ASTNode *node)
+{
+	while (node->parent && (node->type == S_NODE_LITERAL || node->type == S_NODE_STREAM || node->type == S_NODE_LINE))
+		node = node->parent;
+	
+	return node->type;
+}
+
+// Adds a span for the source between `location` and `end`, less any whitespace at either end, if it's in range.
+static void highlight_add(Highlighter *h,
+						  uint32_t location,
+						  uint32_t end,
+						  ASTNode *node,
+						  uint32_t flags)
+{
+	if (location >= h->end || end <= h->start)
+		return;
+	
+	while (location < end && is_space(h->source[location]))
+		++location;
+	
+	while (end > location && is_space(h->source[end - 1]))
+		--end;
+	
+	if (location == end || location >= h->end || end <= h->start)
+		return;
+	
+	if (h->count < h->cap) {
+		CueSpan *span = h->out + h->count;
+		span->range.location = location;
+		span->range.length = end - location;
+		span->type = styled_type(node);
+		span->flags = flags;
+	}
+	
+	++h->count;
+}
+
+// Whatever a node covers before its first child, between its children and after its last child is its delimiters. Each gap is added by the first of its neighbours that the walk visits, so the gaps at either edge of the range are kept too.
+static void highlight_add_gap_before(Highlighter *h,
+									 ASTNode *node)
+{
+	ASTNode *parent = node->parent;
+	uint32_t location = node->prev ? s_range_max(node->prev->range) : parent->range.location;
+	
+	highlight_add(h, location, node->range.location, parent, CUE_SPAN_DELIMITER);
+}
+
+static int highlight_enter(ASTNode *node,
+						   const char *source,
+						   void *info)
+{
+	Highlighter *h = info;
+	ASTNode *parent = node->parent;
+	
+	// The blank lines between blocks belong to no node.
+	if (parent && parent->type != S_NODE_DOCUMENT)
+		highlight_add_gap_before(h, node);
+	
+	if (!node->first_child) {
+		highlight_add(h, node->range.location, s_range_max(node->range), node, 0);
+		return 0;
+	}
+	
+	// The walk only visits children that overlap the range, so if none do, the range lies in the gap before the first child past it.
+	ASTNode *child = node->first_child;
+	while (child && s_range_max(child->range) <= h->start)
+		child = child->next;
+	
+	if (child && child->range.location >= h->end)
+		highlight_add_gap_before(h, child);
+	
+	return 0;
+}
+
+static int highlight_exit(ASTNode *node,
+						  const char *source,
+						  void *info)
+{
+	Highlighter *h = info;
+	ASTNode *parent = node->parent;
+	
+	if (node->last_child && node->type != S_NODE_DOCUMENT)
+		highlight_add(h, s_range_max(node->last_child->range), s_range_max(node->range), node, CUE_SPAN_DELIMITER);
+	
+	// The next sibling won't be visited if it starts past the range, so the gap up to it is added here.
+	if (parent && parent->type != S_NODE_DOCUMENT && node->next && node->next->range.location >= h->end)
+		highlight_add_gap_before(h, node->next);
+	
+	return 0;
+}
+
+#define HIGHLIGHT_ENTRY(type) [type] = highlight_enter,
+#define HIGHLIGHT_EXIT_ENTRY(type) [type] = highlight_exit,
+
+#define HIGHLIGHT_TYPES(X) \
+	X(S_NODE_HEADER) X(S_NODE_DESCRIPTION) X(S_NODE_SIMULTANEOUS_CUES) X(S_NODE_FACSIMILE) \
+	X(S_NODE_THEMATIC_BREAK) X(S_NODE_END) X(S_NODE_CUE) X(S_NODE_LYRIC_DIRECTION) \
+	X(S_NODE_PLAIN_DIRECTION) X(S_NODE_LINE) X(S_NODE_STREAM) X(S_NODE_KEYWORD) \
+	X(S_NODE_IDENTIFIER) X(S_NODE_TITLE) X(S_NODE_NAME) X(S_NODE_URL) X(S_NODE_LITERAL) \
+	X(S_NODE_EMPHASIS) X(S_NODE_STRONG) X(S_NODE_REFERENCE) X(S_NODE_PARENTHETICAL) \
+	X(S_NODE_COMMENT)
+
+static const RendererCallbacks highlight_callbacks = {
+	{ HIGHLIGHT_TYPES(HIGHLIGHT_ENTRY) },
+	{ HIGHLIGHT_TYPES(HIGHLIGHT_EXIT_ENTRY) }
+};
+
+size_t highlight_spans(ASTNode **blocks,
+					   size_t count,
+					   SRange range,
+					   const char *source,
+					   CueSpan *out,
+					   size_t cap)
+{
+	Highlighter h = { source, range.location, s_range_max(range), out, cap, 0 };
+	
+	// As when rendering, an empty range stands for the character at its location.
+	if (!range.length)
+		++h.end;
+	
+	render_range_with_callbacks(&highlight_callbacks, blocks, count, range, source, &h);
+	
+	return h.count;
+}
@@ -0,0 +1,45 @@
+
+#ifndef Highlight_h
+#define Highlight_h
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "nodes.h"
+
+/** Marks a span as punctuation that marks up its node, like the `**` around
+ * strong text, rather than the node's text.
+ */
+#define CUE_SPAN_DELIMITER (1 << 0)
+
+/** A run of source to highlight as one token. `type` is the `ASTNodeType` of
+ * the innermost node the run belongs to, not counting literals, streams and
+ * lines, so the text of `**loud**` is `S_NODE_STRONG` and the text of a
+ * lyric is `S_NODE_LYRIC_DIRECTION`. Delimiters, which the tree only covers
+ * as the space between a node's range and its children, take the type of the
+ * node they mark up: a dual cue's `^` and a name's `:` are `S_NODE_CUE`, a
+ * lyric line's `~` is `S_NODE_LYRIC_DIRECTION` and a comment's `//` is
+ * `S_NODE_COMMENT`.
+ */
+typedef struct
+{
+	SRange range;
+	uint32_t type;
+	uint32_t flags;
+} CueSpan;
+
+/** Fills `out` with up to `cap` spans for the source in `range`, in source
+ * order, given `blocks`, the top-level blocks of a document in order.
+ * Whitespace gets no span. Spans that straddle the edges of `range` are
+ * returned whole. Returns the number of spans in `range`, which may be more
+ * than `cap`. The first block is found by binary search and nothing is
+ * allocated, so the cost depends on how much of the document `range` covers.
+ */
+size_t highlight_spans(ASTNode **blocks,
+					   size_t count,
+					   SRange range,
+					   const char *source,
+					   CueSpan *out,
+					   size_t cap);
+
+#endif /* Highlight_h */
@@ -0,0 +1,224 @@
+
+#include "JSON.h"
+
+#include <string.h>
+
+#include "mem.h"
+#include "Escape.h"
+#include "Format.h"
+#include "Renderer.h"
+
+// Nodes are small, so they're gathered here and passed to the context in blocks.
+#define JSON_BUFFER_SIZE 16384
+
+// Enough for any node up to its children or text: the opening, two numbers for the range, a header type and four numbers.
+#define JSON_NODE_MAX 192
+
+typedef struct
+{
+	MarkupContext *ctx;
+	ASTNode *root;
+	TableOfContents *toc;
+	int options;
+	
+	size_t length;
+	char buffer[JSON_BUFFER_SIZE];
+} JSONWriter;
+
+typedef struct
+{
+	const char *string;
+	uint32_t length;
+} JSONPiece;
+
+#define JSON_PIECE(s) { s, sizeof(s) - 1 }
+#define JSON_OPENING(name) JSON_PIECE("{\"type\":\"" name "\",\"range\":[")
+
+// Everything a node writes before its range.
+static const JSONPiece openings[S_NODE_TYPE_COUNT] = {
+	[S_NODE_DOCUMENT] = JSON_OPENING("document"),
+	[S_NODE_HEADER] = JSON_OPENING("header"),
+	[S_NODE_DESCRIPTION] = JSON_OPENING("description"),
+	[S_NODE_SIMULTANEOUS_CUES] = JSON_OPENING("simultaneous_cues"),
+	[S_NODE_FACSIMILE] = JSON_OPENING("facsimile"),
+	[S_NODE_THEMATIC_BREAK] = JSON_OPENING("thematic_break"),
+	[S_NODE_END] = JSON_OPENING("end"),
+	[S_NODE_CUE] = JSON_OPENING("cue"),
+	[S_NODE_LYRIC_DIRECTION] = JSON_OPENING("lyric_direction"),
+	[S_NODE_PLAIN_DIRECTION] = JSON_OPENING("plain_direction"),
+	[S_NODE_LINE] = JSON_OPENING("line"),
+	[S_NODE_STREAM] = JSON_OPENING("stream"),
+	[S_NODE_KEYWORD] = JSON_OPENING("keyword"),
+	[S_NODE_IDENTIFIER] = JSON_OPENING("identifier"),
+	[S_NODE_TITLE] = JSON_OPENING("title"),
+	[S_NODE_NAME] = JSON_OPENING("name"),
+	[S_NODE_URL] = JSON_OPENING("url"),
+	[S_NODE_LITERAL] = JSON_OPENING("literal"),
+	[S_NODE_EMPHASIS] = JSON_OPENING("emphasis"),
+	[S_NODE_STRONG] = JSON_OPENING("strong"),
+	[S_NODE_REFERENCE] = JSON_OPENING("reference"),
+	[S_NODE_PARENTHETICAL] = JSON_OPENING("parenthetical"),
+	[S_NODE_COMMENT] = JSON_OPENING("comment")
+};
+
+static const JSONPiece header_types[HEADER_FORCED + 1] = {
+	JSON_PIECE(",\"header_type\":\"act\""),
+	JSON_PIECE(",\"header_type\":\"scene\""),
+	JSON_PIECE(",\"header_type\":\"page\""),
+	JSON_PIECE(",\"header_type\":\"frame\""),
+	JSON_PIECE(",\"header_type\":\"forced\"")
+};
+
+static const JSONPiece numbers_opening = JSON_PIECE(",\"numbers\":[");
+static const JSONPiece children_opening = JSON_PIECE(",\"children\":[");
+static const JSONPiece text_opening = JSON_PIECE(",\"text\":\"");
+static const JSONPiece dual = JSON_PIECE(",\"dual\":true");
+static const JSONPiece not_dual = JSON_PIECE(",\"dual\":false");
+
+static inline char *json_put_piece(char *p,
+								   JSONPiece piece)
+{
+	memcpy(p, piece.string, piece.length);
+	
+	return p + piece.length;
+}
+
+static void json_flush(JSONWriter *writer)
+{
+	if (writer->length)
+		markup_context_put(writer->ctx, writer->buffer, writer->length);
+	
+	writer->length = 0;
+}
+
+// Returns where the next `length` bytes go, flushing first if they don't fit.
+static inline char *json_reserve(JSONWriter *writer,
+								 size_t length)
+{
+	if (length > JSON_BUFFER_SIZE - writer->length)
+		json_flush(writer);
+	
+	return writer->buffer + writer->length;
+}
+
+static inline void json_write(JSONWriter *writer,
+							  const char *bytes,
+							  size_t length)
+{
+	// Long runs of text skip the buffer.
+	if (length > JSON_BUFFER_SIZE / 2) {
+		json_flush(writer);
+		markup_context_put(writer->ctx, bytes, length);
+		return;
+	}
+	
+	memcpy(json_reserve(writer, length), bytes, length);
+	writer->length += length;
+}
+
+static void json_write_escaped(JSONWriter *writer,
+							   const char *text,
+							   size_t length)
+{
+	size_t start = 0;
+	
+	while (start < length) {
+		size_t i = start + escape_find_json(text + start, length - start);
+		json_write(writer, text + start, i - start);
+		
+		if (i == length)
+			break;
+		
+		uint32_t sequence_length;
+		const char *sequence = escape_json_sequence((unsigned char)text[i], &sequence_length);
+		json_write(writer, sequence, sequence_length);
+		
+		start = i + 1;
+	}
+}
+
+// Writes everything up to a node's children or text in one piece.
+static inline int json_enter(ASTNode *node,
+							 const char *source,
+							 void *info)
+{
+	JSONWriter *writer = info;
+	char *p = json_reserve(writer, JSON_NODE_MAX);
+	
+	if (node != writer->root && node->prev)
+		*p++ = ',';
+	
+	p = json_put_piece(p, openings[node->type]);
+	p = format_uint32(p, node->range.location);
+	*p++ = ',';
+	p = format_uint32(p, node->range.length);
+	*p++ = ']';
+	
+	if (node->type == S_NODE_HEADER) {
+		p = json_put_piece(p, header_types[node->as.header.type]);
+		
+		TOCEntry *entry = writer->toc ? table_of_contents_entry_for_header(writer->toc, node) : NULL;
+		
+		if (entry) {
+			p = json_put_piece(p, numbers_opening);
+			
+			for (int i = 0; i < HEADER_FORCED; ++i) {
+				if (i)
+					*p++ = ',';
+				p = format_uint32(p, entry->numbers[i]);
+			}
+			
+			*p++ = ']';
+		}
+	} else if (node->type == S_NODE_CUE) {
+		p = json_put_piece(p, node->as.cue.isDual ? dual : not_dual);
+	}
+	
+	if (node->first_child) {
+		p = json_put_piece(p, children_opening);
+	} else if (writer->options & JSON_INCLUDE_TEXT) {
+		p = json_put_piece(p, text_opening);
+		writer->length = p - writer->buffer;
+		
+		json_write_escaped(writer, source + node->range.location, node->range.length);
+		p = json_reserve(writer, 1);
+		*p++ = '"';
+	}
+	
+	writer->length = p - writer->buffer;
+	
+	return 0;
+}
+
+static inline void json_exit(ASTNode *node,
+							 const char *source,
+							 void *info)
+{
+	JSONWriter *writer = info;
+	char *p = json_reserve(writer, 2);
+	
+	if (node->first_child)
+		*p++ = ']';
+	*p++ = '}';
+	
+	writer->length = p - writer->buffer;
+}
+
+void render_json_to_markup_context(MarkupContext *ctx,
+								   ASTNode *root,
+								   const char *source,
+								   TableOfContents *toc,
+								   int options)
+{
+	JSONWriter *writer = c_malloc(sizeof(JSONWriter));
+	writer->ctx = ctx;
+	writer->root = root;
+	writer->toc = toc;
+	writer->options = options;
+	writer->length = 0;
+	
+	RENDERER_WALK(root, source, writer, json_enter, json_exit);
+	
+	json_flush(writer);
+	free(writer);
+}
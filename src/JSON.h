@@ -0,0 +1,31 @@
+
+#ifndef JSON_h
+#define JSON_h
+
+#include "nodes.h"
+#include "MarkupContext.h"
+#include "TableOfContents.h"
+
+/** Options for `render_json_to_markup_context`, combined with `|`. */
+#define JSON_DEFAULT 0
+
+/** Include the source text of nodes without children, such as literals and
+ * names.
+ */
+#define JSON_INCLUDE_TEXT (1 << 0)
+
+/** Writes `root` and its descendants into `ctx` as a single line of compact
+ * JSON. Each node is an object with its `type`, its `range` as `[location,
+ * length]` in bytes and its `children`, if it has any. Headers add their
+ * `header_type` and, if `toc` isn't NULL, the resolved `numbers` from their
+ * entry in `toc`, indexed by `HeaderType`. Cues add whether they're `dual`.
+ * Pair it with a context made with `markup_context_new_with_fd` to stream a
+ * document of any size.
+ */
+void render_json_to_markup_context(MarkupContext *ctx,
+								   ASTNode *root,
+								   const char *source,
+								   TableOfContents *toc,
+								   int options);
+
+#endif /* JSON_h */
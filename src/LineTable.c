@@ -0,0 +1,129 @@
+
+#include "LineTable.h"
+
+#include "mem.h"
+
+struct LineTable
+{
+	uint32_t *starts;
+	size_t len;
+	size_t cap;
+	uint32_t length;
+};
+
+LineTable *line_table_new()
+{
+	LineTable *table = c_calloc(1, sizeof(LineTable));
+	
+	size_t cap = 256;
+	
+	table->starts = c_malloc(cap * sizeof(uint32_t));
+	table->cap = cap;
+	
+	return table;
+}
+
+void line_table_free(LineTable *table)
+{
+	free(table->starts);
+	
+	free(table);
+}
+
+static void line_table_push(LineTable *table,
+							uint32_t start)
+{
+	if (table->len >= table->cap) {
+		table->cap *= 2;
+		table->starts = c_realloc(table->starts, table->cap * sizeof(uint32_t));
+	}
+	
+	table->starts[table->len++] = start;
+}
+
+void line_table_add_line(LineTable *table,
+						 const char *source,
+						 uint32_t bol)
+{
+	if (bol) {
+		char prev = source[bol-1];
+		
+		// The scanner also breaks lines at vertical tabs and form feeds, and treats "\r\n" as two breaks.
+		if (prev != '\n' && prev != '\r')
+			return;
+		
+		if (prev == '\r' && source[bol] == '\n')
+			return;
+	}
+	
+	line_table_push(table, bol);
+}
+
+void line_table_finalize(LineTable *table,
+						 const char *source,
+						 uint32_t length)
+{
+	table->length = length;
+	
+	if (!table->len) {
+		line_table_push(table, 0);
+	} else if (length) {
+		char last = source[length-1];
+		
+		if ((last == '\n' || last == '\r') && table->starts[table->len-1] != length)
+			line_table_push(table, length);
+	}
+}
+
+size_t line_table_count(LineTable *table)
+{
+	return table->len;
+}
+
+int line_table_offset_to_line_col(LineTable *table,
+								  uint32_t offset,
+								  uint32_t *line,
+								  uint32_t *column)
+{
+	if (offset > table->length)
+		return 0;
+	
+	// Find the last line that starts at or before offset.
+	size_t lo = 0;
+	size_t hi = table->len;
+	
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+		
+		if (table->starts[mid] <= offset)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	
+	*line = (uint32_t)(lo - 1);
+	*column = offset - table->starts[lo - 1];
+	
+	return 1;
+}
+
+int line_table_line_col_to_offset(LineTable *table,
+								  const char *source,
+								  uint32_t line,
+								  uint32_t column,
+								  uint32_t *offset)
+{
+	if (line >= table->len)
+		return 0;
+	
+	uint32_t start = table->starts[line];
+	uint32_t end = (line + 1 < table->len) ? table->starts[line+1] : table->length;
+	
+	// Stop before the line break.
+	while (end > start && (source[end-1] == '\n' || source[end-1] == '\r'))
+		--end;
+	
+	*offset = (column < end - start) ? start + column : end;
+	
+	return 1;
+}
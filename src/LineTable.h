@@ -0,0 +1,49 @@
+
+#ifndef LineTable_h
+#define LineTable_h
+
+#include <stdint.h>
+#include <stddef.h>
+
+/** The offsets at which each line of a source string begins. Lines end at
+ * "\n", "\r\n" or "\r".
+ */
+typedef struct LineTable LineTable;
+
+LineTable *line_table_new(void);
+
+void line_table_free(LineTable *table);
+
+/** Records a line break candidate at `bol`, as reported by the scanner. Lines
+ * the scanner splits that editors don't, such as the "\n" of "\r\n", are
+ * ignored. Offsets must be added in increasing order.
+ */
+void line_table_add_line(LineTable *table,
+						 const char *source,
+						 uint32_t bol);
+
+/** Adds the final empty line when `source` ends with a line break. */
+void line_table_finalize(LineTable *table,
+						 const char *source,
+						 uint32_t length);
+
+size_t line_table_count(LineTable *table);
+
+/** Converts a byte offset into a 0-based line and byte column. Returns 0 if
+ * `offset` lies past the end of the source.
+ */
+int line_table_offset_to_line_col(LineTable *table,
+								  uint32_t offset,
+								  uint32_t *line,
+								  uint32_t *column);
+
+/** Converts a 0-based line and byte column into an offset. Columns past the
+ * end of the line are clamped to it. Returns 0 if there is no such line.
+ */
+int line_table_line_col_to_offset(LineTable *table,
+								  const char *source,
+								  uint32_t line,
+								  uint32_t column,
+								  uint32_t *offset);
+
+#endif /* LineTable_h */
@@ -2,28 +2,142 @@
 #include "MarkupContext.h"
 
 #include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/uio.h>
 
 #include "mem.h"
+#include "Escape.h"
+
+#ifndef IOV_MAX
+#define IOV_MAX 1024
+#endif
+
+typedef enum
+{
+	SINK_STRING,
+	SINK_CALLBACK,
+	SINK_CHUNKS,
+	SINK_COUNTING
+} SinkType;
 
 struct MarkupContext {
 	StringBuffer *string;
 	int indent;
 	int needsNewLine;
+	
+	// Set when output is known to come before this context's, so that its first line needs a new line too.
+	int continues;
+	
+	SinkType sink;
+	MarkupWriteFunc write;
+	void *info;
+	int fd;
+	int failed;
+	
+	// Bytes that have been passed on or moved into finished chunks, and are no longer in `string`.
+	size_t passed;
+	
+	// Finished chunks, in order. Each owns its buffer.
+	struct iovec *chunks;
+	size_t chunk_count;
+	size_t chunk_cap;
+	size_t chunk_size;
+	
+	MarkupContextStats stats;
 };
 
-MarkupContext *markup_context_new()
+static MarkupContext *markup_context_new_with_sink(SinkType sink,
+												   size_t buffer_size)
 {
-	MarkupContext *ctx = c_malloc(sizeof(MarkupContext));
+	MarkupContext *ctx = c_calloc(1, sizeof(MarkupContext));
 	
 	ctx->string = string_buffer_new();
-	ctx->indent = 0;
-	ctx->needsNewLine = 0;
+	ctx->sink = sink;
+	ctx->fd = -1;
+	
+	if (buffer_size > ctx->string->capacity)
+		string_buffer_reserve(ctx->string, buffer_size);
+	
+	ctx->chunk_size = ctx->string->capacity;
+	ctx->stats.peak_memory = ctx->string->capacity;
 	
 	return ctx;
 }
 
+MarkupContext *markup_context_new()
+{
+	return markup_context_new_with_sink(SINK_STRING, 0);
+}
+
+MarkupContext *markup_context_new_with_callback(MarkupWriteFunc write,
+												void *info,
+												size_t buffer_size)
+{
+	MarkupContext *ctx = markup_context_new_with_sink(SINK_CALLBACK, buffer_size);
+	
+	ctx->write = write;
+	ctx->info = info;
+	
+	return ctx;
+}
+
+// Writes all of `bytes`, retrying after partial writes and interruptions. Gives up for good after an error.
+static void write_to_fd(void *info,
+						const char *bytes,
+						size_t length)
+{
+	MarkupContext *ctx = info;
+	
+	while (length && !ctx->failed) {
+		ssize_t n = write(ctx->fd, bytes, length);
+		
+		if (n < 0) {
+			if (errno != EINTR)
+				ctx->failed = 1;
+			continue;
+		}
+		
+		bytes += n;
+		length -= n;
+	}
+}
+
+MarkupContext *markup_context_new_with_fd(int fd,
+										  size_t buffer_size)
+{
+	MarkupContext *ctx = markup_context_new_with_sink(SINK_CALLBACK, buffer_size);
+	
+	ctx->write = write_to_fd;
+	ctx->info = ctx;
+	ctx->fd = fd;
+	
+	return ctx;
+}
+
+MarkupContext *markup_context_new_chunked(size_t chunk_size)
+{
+	return markup_context_new_with_sink(SINK_CHUNKS, chunk_size);
+}
+
+MarkupContext *markup_context_new_counting()
+{
+	return markup_context_new_with_sink(SINK_COUNTING, 0);
+}
+
+static void markup_context_free_chunks(MarkupContext *ctx)
+{
+	for (size_t i = 0; i < ctx->chunk_count; ++i)
+		free(ctx->chunks[i].iov_base);
+	
+	ctx->chunk_count = 0;
+}
+
 void markup_context_free(MarkupContext *ctx)
 {
+	markup_context_free_chunks(ctx);
+	free(ctx->chunks);
 	string_buffer_free(ctx->string);
 	
 	free(ctx);
@@ -34,24 +148,253 @@ StringBuffer *markup_context_get_string(MarkupContext *ctx)
 	return ctx->string;
 }
 
-void markup_context_add_indent(MarkupContext *ctx)
+size_t markup_context_get_length(MarkupContext *ctx)
+{
+	return ctx->passed + ctx->string->length;
+}
+
+MarkupContextStats markup_context_get_stats(MarkupContext *ctx)
+{
+	MarkupContextStats stats = ctx->stats;
+	stats.bytes_written = markup_context_get_length(ctx);
+	
+	return stats;
+}
+
+static void markup_context_update_peak(MarkupContext *ctx)
+{
+	// Finished chunks are still held, while anything passed to a callback is gone.
+	size_t held = ctx->string->capacity + (ctx->sink == SINK_CHUNKS ? ctx->passed : 0);
+	
+	if (held > ctx->stats.peak_memory)
+		ctx->stats.peak_memory = held;
+}
+
+void markup_context_reserve(MarkupContext *ctx,
+							size_t length)
+{
+	if (ctx->sink != SINK_STRING)
+		return;
+	
+	if (string_buffer_reserve(ctx->string, length))
+		ctx->stats.bytes_copied += ctx->string->length;
+	
+	markup_context_update_peak(ctx);
+}
+
+int markup_context_flush(MarkupContext *ctx)
 {
-	for (int i = 0; i < ctx->indent; ++i) {
-		string_buffer_put(ctx->string, "\t", 1);
+	StringBuffer *string = ctx->string;
+	
+	if (ctx->sink == SINK_CALLBACK && string->length) {
+		ctx->write(ctx->info, string->buffer, string->length);
+		ctx->passed += string->length;
+		string->length = 0;
+		++ctx->stats.flushes;
 	}
+	
+	return !ctx->failed;
 }
 
-void markup_context_put(MarkupContext *ctx,
-						const char *a_string,
-						uint32_t a_length)
+// Moves the current buffer to the end of the chunk list and starts a new one big enough for `length` bytes.
+static void markup_context_finish_chunk(MarkupContext *ctx,
+										size_t length)
+{
+	StringBuffer *string = ctx->string;
+	
+	if (ctx->chunk_count >= ctx->chunk_cap) {
+		ctx->chunk_cap = ctx->chunk_cap ? ctx->chunk_cap * 2 : 16;
+		ctx->chunks = c_realloc(ctx->chunks, ctx->chunk_cap * sizeof(struct iovec));
+	}
+	
+	ctx->chunks[ctx->chunk_count].iov_base = string->buffer;
+	ctx->chunks[ctx->chunk_count].iov_len = string->length;
+	++ctx->chunk_count;
+	++ctx->stats.chunks;
+	
+	ctx->passed += string->length;
+	
+	string->capacity = length > ctx->chunk_size ? length : ctx->chunk_size;
+	string->buffer = c_malloc(string->capacity);
+	string->length = 0;
+}
+
+// Called when `length` bytes don't fit in the buffer. Returns 1 once they do, or 0 if the bytes have been dealt with already.
+static int markup_context_make_room(MarkupContext *ctx,
+									const char *bytes,
+									size_t length)
+{
+	StringBuffer *string = ctx->string;
+	
+	switch (ctx->sink) {
+		case SINK_STRING:
+			++ctx->stats.growths;
+			if (string_buffer_reserve(string, length))
+				ctx->stats.bytes_copied += string->length;
+			break;
+		case SINK_CALLBACK:
+			markup_context_flush(ctx);
+			
+			// Anything bigger than the buffer goes straight through.
+			if (length > string->capacity) {
+				ctx->write(ctx->info, bytes, length);
+				ctx->passed += length;
+				++ctx->stats.flushes;
+				return 0;
+			}
+			break;
+		case SINK_CHUNKS:
+			if (string->length) {
+				markup_context_finish_chunk(ctx, length);
+			} else {
+				string_buffer_reserve(string, length);
+			}
+			break;
+		case SINK_COUNTING:
+			ctx->passed += string->length + length;
+			string->length = 0;
+			return 0;
+	}
+	
+	markup_context_update_peak(ctx);
+	
+	return 1;
+}
+
+static inline void markup_context_write(MarkupContext *ctx,
+										const char *bytes,
+										size_t length)
+{
+	StringBuffer *string = ctx->string;
+	
+	if (length > string->capacity - string->length && !markup_context_make_room(ctx, bytes, length))
+		return;
+	
+	memcpy(string->buffer + string->length, bytes, length);
+	string->length += length;
+}
+
+int markup_context_write_chunks(MarkupContext *ctx,
+								int fd)
+{
+	if (ctx->sink != SINK_CHUNKS && ctx->sink != SINK_STRING)
+		return 0;
+	
+	size_t count = ctx->chunk_count + 1;
+	struct iovec *iov = c_malloc(count * sizeof(struct iovec));
+	
+	if (ctx->chunk_count)
+		memcpy(iov, ctx->chunks, ctx->chunk_count * sizeof(struct iovec));
+	
+	iov[ctx->chunk_count].iov_base = ctx->string->buffer;
+	iov[ctx->chunk_count].iov_len = ctx->string->length;
+	
+	// Partial writes leave `iov` pointing at what's left.
+	struct iovec *next = iov;
+	int ok = 1;
+	
+	while (count) {
+		ssize_t n = writev(fd, next, count < IOV_MAX ? (int)count : IOV_MAX);
+		
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			
+			ok = 0;
+			break;
+		}
+		
+		while (count && (size_t)n >= next->iov_len) {
+			n -= next->iov_len;
+			++next;
+			--count;
+		}
+		
+		if (count) {
+			next->iov_base = (char *)next->iov_base + n;
+			next->iov_len -= n;
+		}
+	}
+	
+	free(iov);
+	
+	return ok;
+}
+
+void markup_context_clear(MarkupContext *ctx)
+{
+	markup_context_free_chunks(ctx);
+	
+	ctx->string->length = 0;
+	ctx->indent = 0;
+	ctx->needsNewLine = 0;
+	ctx->continues = 0;
+	ctx->failed = 0;
+	ctx->passed = 0;
+	
+	memset(&ctx->stats, 0, sizeof(MarkupContextStats));
+	ctx->stats.peak_memory = ctx->string->capacity;
+}
+
+void markup_context_add_indent(MarkupContext *ctx)
+{
+	static const char tabs[] = "\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t";
+	
+	for (int left = ctx->indent; left > 0; left -= 16)
+		markup_context_write(ctx, tabs, left < 16 ? left : 16);
+}
+
+// The first line of output doesn't need a new line before it.
+static inline void markup_context_begin_put(MarkupContext *ctx)
 {
 	if (ctx->needsNewLine) {
-		string_buffer_put(ctx->string, "\n", 1);
+		if (ctx->passed || ctx->string->length || ctx->continues)
+			markup_context_write(ctx, "\n", 1);
+		
 		markup_context_add_indent(ctx);
 		ctx->needsNewLine = 0;
 	}
+}
+
+void markup_context_resume(MarkupContext *ctx,
+						   int indent,
+						   int needs_new_line)
+{
+	ctx->indent = indent;
+	ctx->needsNewLine = needs_new_line;
+	ctx->continues = 1;
+}
+
+void markup_context_put(MarkupContext *ctx,
+						const char *a_string,
+						size_t a_length)
+{
+	markup_context_begin_put(ctx);
 	
-	string_buffer_put(ctx->string, a_string, a_length);
+	markup_context_write(ctx, a_string, a_length);
+}
+
+void markup_context_put_escaped(MarkupContext *ctx,
+								const char *a_string,
+								size_t a_length)
+{
+	markup_context_begin_put(ctx);
+	
+	size_t start = 0;
+	
+	while (start < a_length) {
+		size_t i = start + escape_find(a_string + start, a_length - start);
+		markup_context_write(ctx, a_string + start, i - start);
+		
+		if (i == a_length)
+			break;
+		
+		uint32_t length;
+		const char *entity = escape_entity((unsigned char)a_string[i], &length);
+		markup_context_write(ctx, entity, length);
+		
+		start = i + 1;
+	}
 }
 
 void markup_context_push_indent(MarkupContext *ctx)
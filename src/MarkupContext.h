@@ -2,19 +2,116 @@
 #ifndef MarkupContext_h
 #define MarkupContext_h
 
+#include <stddef.h>
+
 #include "StringBuffer.h"
 
 typedef struct MarkupContext MarkupContext;
 
+/** Receives output from a context made with
+ * `markup_context_new_with_callback`, in order.
+ */
+typedef void (*MarkupWriteFunc)(void *info,
+								const char *bytes,
+								size_t length);
+
+/** Counts of the work a context has done since it was made or cleared.
+ * `bytes_copied` counts the bytes moved when the buffer grew, which a
+ * reservation or a chunked context avoids, and `peak_memory` is the most
+ * output the context held at once, including buffer space not yet used.
+ */
+typedef struct
+{
+	size_t bytes_written;
+	size_t bytes_copied;
+	size_t growths;
+	size_t flushes;
+	size_t chunks;
+	size_t peak_memory;
+} MarkupContextStats;
+
+/** Makes a context that keeps its whole output in one growing buffer. */
 MarkupContext *markup_context_new(void);
 
+/** Makes a context that passes its output to `write` whenever
+ * `buffer_size` bytes have built up, so it never holds more than that.
+ * Call `markup_context_flush` once rendering is done.
+ */
+MarkupContext *markup_context_new_with_callback(MarkupWriteFunc write,
+												void *info,
+												size_t buffer_size);
+
+/** Like `markup_context_new_with_callback`, writing to the file descriptor
+ * `fd`.
+ */
+MarkupContext *markup_context_new_with_fd(int fd,
+										  size_t buffer_size);
+
+/** Makes a context that keeps its output in a list of chunks of at least
+ * `chunk_size` bytes, so that output is never copied as it grows.
+ * `markup_context_write_chunks` writes them all out at once.
+ */
+MarkupContext *markup_context_new_chunked(size_t chunk_size);
+
+/** Makes a context that only counts the bytes it's given, for finding how
+ * much to reserve in another.
+ */
+MarkupContext *markup_context_new_counting(void);
+
 void markup_context_free(MarkupContext *ctx);
 
+/** Returns the output that hasn't been passed on yet. For a context made
+ * with `markup_context_new` that's all of it.
+ */
 StringBuffer *markup_context_get_string(MarkupContext *ctx);
 
+/** Returns the total number of bytes written to `ctx`. */
+size_t markup_context_get_length(MarkupContext *ctx);
+
+MarkupContextStats markup_context_get_stats(MarkupContext *ctx);
+
+/** Makes room for `length` more bytes in a context made with
+ * `markup_context_new`, so that output up to that size never moves. Has no
+ * effect on other contexts.
+ */
+void markup_context_reserve(MarkupContext *ctx,
+							size_t length);
+
+/** Passes buffered output on to the callback or file descriptor. Returns 0
+ * if writing to the file descriptor has failed.
+ */
+int markup_context_flush(MarkupContext *ctx);
+
+/** Writes the whole output of a chunked or growing context to `fd`, with a
+ * single `writev` unless there are more chunks than it takes. Returns 0 on
+ * failure.
+ */
+int markup_context_write_chunks(MarkupContext *ctx,
+								int fd);
+
+/** Empties `ctx` and resets its indent and statistics, keeping its buffer
+ * for reuse.
+ */
+void markup_context_clear(MarkupContext *ctx);
+
+/** Starts an empty `ctx` as though it followed earlier output, with
+ * `indent` and a pending new line carried over from it. Rendering part of a
+ * document this way produces the same bytes as rendering it in place.
+ */
+void markup_context_resume(MarkupContext *ctx,
+						   int indent,
+						   int needs_new_line);
+
 void markup_context_put(MarkupContext *ctx,
 						const char *a_string,
-						uint32_t a_length);
+						size_t a_length);
+
+/** Like `markup_context_put`, but escapes `&`, `<`, `>`, `"` and `'` so that
+ * `a_string` can be used as HTML or XML text or attribute values.
+ */
+void markup_context_put_escaped(MarkupContext *ctx,
+								const char *a_string,
+								size_t a_length);
 
 void markup_context_push_indent(MarkupContext *ctx);
 
@@ -0,0 +1,121 @@
+
+#include "NodeIndex.h"
+
+#include <string.h>
+
+#include "mem.h"
+
+typedef struct
+{
+	ASTNode **nodes;
+	size_t len;
+	size_t cap;
+} NodeList;
+
+struct NodeIndex
+{
+	NodeList lists[S_NODE_TYPE_COUNT];
+};
+
+NodeIndex *node_index_new()
+{
+	return c_calloc(1, sizeof(NodeIndex));
+}
+
+void node_index_free(NodeIndex *index)
+{
+	for (size_t t = 0; t < S_NODE_TYPE_COUNT; ++t)
+		free(index->lists[t].nodes);
+	
+	free(index);
+}
+
+static void node_list_push(NodeList *list,
+						   ASTNode *node)
+{
+	if (list->len >= list->cap) {
+		list->cap = list->cap ? list->cap * 2 : 16;
+		list->nodes = c_realloc(list->nodes, list->cap * sizeof(ASTNode*));
+	}
+	
+	list->nodes[list->len++] = node;
+}
+
+void node_index_add_subtree(NodeIndex *index,
+							ASTNode *node)
+{
+	ASTNode *root = node;
+	
+	for (;;) {
+		node_list_push(index->lists + node->type, node);
+		
+		if (node->first_child) {
+			node = node->first_child;
+			continue;
+		}
+		
+		while (node != root && !node->next)
+			node = node->parent;
+		
+		if (node == root)
+			break;
+		
+		node = node->next;
+	}
+}
+
+// Inserts `node` after every node of its type that starts at or before it.
+static void node_list_insert(NodeList *list,
+							 ASTNode *node)
+{
+	size_t lo = 0;
+	size_t hi = list->len;
+	
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+		
+		if (list->nodes[mid]->range.location <= node->range.location)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	
+	node_list_push(list, node);
+	memmove(list->nodes + lo + 1, list->nodes + lo, (list->len - 1 - lo) * sizeof(ASTNode*));
+	list->nodes[lo] = node;
+}
+
+void node_index_insert_subtree(NodeIndex *index,
+							   ASTNode *node)
+{
+	ASTNode *root = node;
+	
+	for (;;) {
+		node_list_insert(index->lists + node->type, node);
+		
+		if (node->first_child) {
+			node = node->first_child;
+			continue;
+		}
+		
+		while (node != root && !node->next)
+			node = node->parent;
+		
+		if (node == root)
+			break;
+		
+		node = node->next;
+	}
+}
+
+size_t node_index_count(NodeIndex *index,
+						ASTNodeType type)
+{
+	return index->lists[type].len;
+}
+
+ASTNode **node_index_get_nodes(NodeIndex *index,
+							   ASTNodeType type)
+{
+	return index->lists[type].nodes;
+}
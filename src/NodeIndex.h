@@ -0,0 +1,36 @@
+
+#ifndef NodeIndex_h
+#define NodeIndex_h
+
+#include <stddef.h>
+
+#include "nodes.h"
+
+/** Keeps the nodes of a document grouped by type, each group in document
+ * order.
+ */
+typedef struct NodeIndex NodeIndex;
+
+NodeIndex *node_index_new(void);
+
+void node_index_free(NodeIndex *index);
+
+/** Appends `node` and all of its descendants. Nodes must be added in
+ * document order.
+ */
+void node_index_add_subtree(NodeIndex *index,
+							ASTNode *node);
+
+/** Inserts `node` and all of its descendants among the nodes already indexed,
+ * keeping each group in document order.
+ */
+void node_index_insert_subtree(NodeIndex *index,
+							   ASTNode *node);
+
+size_t node_index_count(NodeIndex *index,
+						ASTNodeType type);
+
+ASTNode **node_index_get_nodes(NodeIndex *index,
+							   ASTNodeType type);
+
+#endif /* NodeIndex_h */
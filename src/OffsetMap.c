@@ -0,0 +1,128 @@
+
+#include "OffsetMap.h"
+
+#include "mem.h"
+#include "UTF8.h"
+
+#define OFFSET_MAP_SHIFT 8
+#define OFFSET_MAP_BLOCK (1 << OFFSET_MAP_SHIFT)
+
+struct OffsetMap
+{
+	// units[i] is the UTF-16 offset of byte i * OFFSET_MAP_BLOCK.
+	uint32_t *units;
+	size_t len;
+	size_t cap;
+	
+	uint32_t length;
+	uint32_t total_units;
+};
+
+OffsetMap *offset_map_new()
+{
+	OffsetMap *map = c_calloc(1, sizeof(OffsetMap));
+	
+	size_t cap = 64;
+	
+	map->units = c_malloc(cap * sizeof(uint32_t));
+	map->units[0] = 0;
+	map->len = 1;
+	map->cap = cap;
+	
+	return map;
+}
+
+void offset_map_free(OffsetMap *map)
+{
+	free(map->units);
+	
+	free(map);
+}
+
+void offset_map_extend(OffsetMap *map,
+					   const char *source,
+					   uint32_t end)
+{
+	size_t blocks = end >> OFFSET_MAP_SHIFT;
+	
+	while (map->len <= blocks) {
+		if (map->len >= map->cap) {
+			map->cap *= 2;
+			map->units = c_realloc(map->units, map->cap * sizeof(uint32_t));
+		}
+		
+		const char *block = source + ((map->len - 1) << OFFSET_MAP_SHIFT);
+		
+		map->units[map->len] = map->units[map->len - 1] + (uint32_t)utf8_count_utf16_units(block, OFFSET_MAP_BLOCK);
+		++map->len;
+	}
+}
+
+void offset_map_finalize(OffsetMap *map,
+						 const char *source,
+						 uint32_t length)
+{
+	offset_map_extend(map, source, length);
+	
+	uint32_t last = (uint32_t)(map->len - 1) << OFFSET_MAP_SHIFT;
+	
+	map->length = length;
+	map->total_units = map->units[map->len - 1] + (uint32_t)utf8_count_utf16_units(source + last, length - last);
+}
+
+int offset_map_utf8_to_utf16(OffsetMap *map,
+							 const char *source,
+							 uint32_t offset,
+							 uint32_t *utf16_offset)
+{
+	if (offset > map->length)
+		return 0;
+	
+	uint32_t block = offset >> OFFSET_MAP_SHIFT;
+	uint32_t start = block << OFFSET_MAP_SHIFT;
+	
+	*utf16_offset = map->units[block] + (uint32_t)utf8_count_utf16_units(source + start, offset - start);
+	
+	return 1;
+}
+
+int offset_map_utf16_to_utf8(OffsetMap *map,
+							 const char *source,
+							 uint32_t utf16_offset,
+							 uint32_t *offset)
+{
+	if (utf16_offset > map->total_units)
+		return 0;
+	
+	// Find the last checkpoint at or before utf16_offset.
+	size_t lo = 0;
+	size_t hi = map->len;
+	
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+		
+		if (map->units[mid] <= utf16_offset)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	
+	uint32_t units = map->units[lo - 1];
+	uint32_t p = (uint32_t)(lo - 1) << OFFSET_MAP_SHIFT;
+	
+	for (; p < map->length; ++p) {
+		unsigned char c = source[p];
+		if ((c & 0xC0) == 0x80)
+			continue;
+		
+		uint32_t width = (c >= 0xF0) ? 2 : 1;
+		if (units + width > utf16_offset)
+			break;
+		
+		units += width;
+	}
+	
+	*offset = p;
+	
+	return 1;
+}
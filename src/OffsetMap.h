@@ -0,0 +1,42 @@
+
+#ifndef OffsetMap_h
+#define OffsetMap_h
+
+#include <stdint.h>
+
+/** Maps UTF-8 byte offsets to UTF-16 code unit offsets and back. The map
+ * records the UTF-16 offset of every 256th byte, so a conversion counts at
+ * most 256 bytes past a checkpoint.
+ */
+typedef struct OffsetMap OffsetMap;
+
+OffsetMap *offset_map_new(void);
+
+void offset_map_free(OffsetMap *map);
+
+/** Records checkpoints for every complete block of `source` before `end`.
+ * Call with increasing `end`s as the source is scanned.
+ */
+void offset_map_extend(OffsetMap *map,
+					   const char *source,
+					   uint32_t end);
+
+void offset_map_finalize(OffsetMap *map,
+						 const char *source,
+						 uint32_t length);
+
+/** Returns 0 if `offset` is past the end of the source. */
+int offset_map_utf8_to_utf16(OffsetMap *map,
+							 const char *source,
+							 uint32_t offset,
+							 uint32_t *utf16_offset);
+
+/** Returns the offset of the character containing `utf16_offset`, or 0 if it
+ * is past the end of the source.
+ */
+int offset_map_utf16_to_utf8(OffsetMap *map,
+							 const char *source,
+							 uint32_t utf16_offset,
+							 uint32_t *offset);
+
+#endif /* OffsetMap_h */
@@ -0,0 +1,35 @@
+
+#include "Outline.h"
+
+#include "Scanner.h"
+
+void cue_scan_outline(const char *source,
+					  size_t length,
+					  OutlineCallback callback,
+					  void *data)
+{
+	Scanner s = { source, (uint32_t)length, 0, 0, 0, 0, 0 };
+	OutlineItem item;
+	
+	while (scanner_advance_to_next_line(&s) < length) {
+		if (scanner_is_at_eol(&s))
+			continue;
+		
+		// Every header begins with '.' or the first letter of a keyword, so most lines can be rejected by their first character.
+		switch (s.source[s.loc]) {
+			case '.':
+				if (scan_forced_header_outline(&s, &item))
+					callback(&item, data);
+				break;
+			case 'A':
+			case 'S':
+			case 'P':
+			case 'F':
+				if (scan_header_outline(&s, &item))
+					callback(&item, data);
+				break;
+			default:
+				break;
+		}
+	}
+}
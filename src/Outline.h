@@ -0,0 +1,34 @@
+
+#ifndef Outline_h
+#define Outline_h
+
+#include <stddef.h>
+
+#include "nodes.h"
+
+/** A header found by `cue_scan_outline`. `range` covers the whole line. An
+ * identifier or title that isn't present has a length of 0.
+ */
+typedef struct
+{
+	HeaderType type;
+	SRange range;
+	SRange keyword;
+	SRange identifier;
+	SRange title;
+} OutlineItem;
+
+typedef void (*OutlineCallback)(const OutlineItem *item,
+								void *data);
+
+/** Reports every header in `source` to `callback`, in order, without building
+ * a document. Lines are split and headers recognized exactly as in
+ * `cue_document_from_utf8`, but nothing else is parsed and nothing is
+ * allocated.
+ */
+void cue_scan_outline(const char *source,
+					  size_t length,
+					  OutlineCallback callback,
+					  void *data);
+
+#endif /* Outline_h */
@@ -0,0 +1,670 @@
+
+#include "Pagination.h"
+
+#include <string.h>
+
+#include "mem.h"
+#include "Renderer.h"
+
+// Headers stay on the same page as the start of the block after them.
+#define BLOCK_KEEP_WITH_NEXT (1 << 0)
+
+// A speech, which gains (MORE) and (CONT'D) lines when it's split.
+#define BLOCK_DIALOGUE (1 << 1)
+
+typedef struct
+{
+	// The block's range, to tell after an edit whether it's still the same block. Blocks from `Pagination.gap` on keep their distance from `Pagination.end` in `position` rather than their location, so that an edit doesn't have to move every block after it.
+	uint32_t position;
+	uint32_t length;
+	
+	uint32_t height;
+	
+	// The fewest and most of a block's lines a page can end after, or 0 if it can't be split.
+	uint32_t first_break;
+	uint32_t last_break;
+	
+	uint32_t flags;
+} BlockLayout;
+
+struct Pagination
+{
+	PageLayout layout;
+	
+	// The end of the document, moved along by every edit. Only differences from it are used, so it may wrap.
+	uint32_t end;
+	
+	// Blocks before `gap` keep their location, and blocks after it their distance from `end`. Each edit moves it to where the edit was.
+	size_t gap;
+	
+	BlockLayout *blocks;
+	size_t count;
+	size_t cap;
+	
+	// prefix[i] is the number of lines blocks before i take up, counting a blank line before each block that prints anything. Entries past `prefix_valid` are out of date and filled in as pagination reaches them.
+	uint32_t *prefix;
+	size_t prefix_valid;
+	
+	PageBreak *breaks;
+	size_t break_count;
+	size_t break_cap;
+	
+	// The breaks an update replaces, kept until pagination falls back into step with them.
+	PageBreak *old_breaks;
+	size_t old_cap;
+	
+	size_t laid_out;
+};
+
+PageLayout page_layout_default(void)
+{
+	PageLayout layout = { 54, 61, 35, 28, 2, 2 };
+	
+	return layout;
+}
+
+Pagination *pagination_new(const PageLayout *layout)
+{
+	Pagination *pagination = c_calloc(1, sizeof(Pagination));
+	
+	pagination->layout = *layout;
+	pagination->prefix = c_calloc(1, sizeof(uint32_t));
+	
+	pagination->break_cap = 16;
+	pagination->breaks = c_calloc(pagination->break_cap, sizeof(PageBreak));
+	pagination->break_count = 1;
+	
+	return pagination;
+}
+
+void pagination_free(Pagination *pagination)
+{
+	free(pagination->blocks);
+	free(pagination->prefix);
+	free(pagination->breaks);
+	free(pagination->old_breaks);
+	
+	free(pagination);
+}
+
+// Counts the lines text takes up when wrapped at word boundaries to `width` characters.
+typedef struct
+{
+	const char *source;
+	uint32_t width;
+	
+	// Characters on the current line, and in the word being read that hasn't been placed yet.
+	uint32_t column;
+	uint32_t word;
+	
+	uint32_t lines;
+} Measure;
+
+static void measure_place_word(Measure *m)
+{
+	if (!m->word)
+		return;
+	
+	if (!m->column) {
+		m->column = m->word;
+	} else if (m->column + 1 + m->word <= m->width) {
+		m->column += 1 + m->word;
+	} else {
+		++m->lines;
+		m->column = m->word;
+	}
+	
+	// Words longer than a line are broken across lines.
+	while (m->column > m->width) {
+		++m->lines;
+		m->column -= m->width;
+	}
+	
+	m->word = 0;
+}
+
+static void measure_end_line(Measure *m)
+{
+	measure_place_word(m);
+	
+	if (m->column) {
+		++m->lines;
+		m->column = 0;
+	}
+}
+
+static void measure_feed(Measure *m,
+						 const char *s,
+						 size_t length)
+{
+	for (size_t i = 0; i < length; ++i) {
+		unsigned char c = s[i];
+		
+		if (c == ' ' || c == '\t' || c == '\r') {
+			measure_place_word(m);
+		} else if (c == '\n') {
+			measure_end_line(m);
+		} else if ((c & 0xc0) != 0x80) {
+			// Characters are counted rather than bytes, skipping UTF-8 continuation bytes.
+			++m->word;
+		}
+	}
+}
+
+static inline void measure_feed_node(Measure *m,
+									 ASTNode *node)
+{
+	measure_feed(m, m->source + node->range.location, node->range.length);
+}
+
+static inline int measure_enter(ASTNode *node,
+								const char *source,
+								void *info)
+{
+	Measure *m = info;
+	
+	switch (node->type) {
+		case S_NODE_LITERAL:
+		case S_NODE_KEYWORD:
+		case S_NODE_END:
+			measure_feed_node(m, node);
+			return 0;
+		case S_NODE_IDENTIFIER:
+			measure_feed(m, " ", 1);
+			measure_feed_node(m, node);
+			return 0;
+		case S_NODE_TITLE:
+			measure_feed(m, " - ", 3);
+			return 0;
+		case S_NODE_PARENTHETICAL:
+			measure_feed(m, "(", 1);
+			return 0;
+		case S_NODE_REFERENCE:
+			measure_feed_node(m, node);
+			return 1;
+		case S_NODE_NAME:
+		case S_NODE_THEMATIC_BREAK:
+			++m->lines;
+			return 1;
+		case S_NODE_COMMENT:
+			return 1;
+		default:
+			return 0;
+	}
+}
+
+static inline void measure_exit(ASTNode *node,
+								const char *source,
+								void *info)
+{
+	Measure *m = info;
+	
+	switch (node->type) {
+		case S_NODE_PARENTHETICAL:
+			measure_feed(m, ")", 1);
+			break;
+		case S_NODE_HEADER:
+		case S_NODE_DESCRIPTION:
+		case S_NODE_PLAIN_DIRECTION:
+		case S_NODE_LINE:
+		case S_NODE_END:
+			measure_end_line(m);
+			break;
+	}
+}
+
+static uint32_t measure_node(ASTNode *root,
+							 const char *source,
+							 uint32_t width)
+{
+	Measure m = { source, width ? width : 1, 0, 0, 0 };
+	
+	RENDERER_WALK(root, source, &m, measure_enter, measure_exit);
+	
+	return m.lines;
+}
+
+static BlockLayout layout_block(const PageLayout *layout,
+								ASTNode *block,
+								const char *source)
+{
+	BlockLayout result = { block->range.location, block->range.length, 0, 0, 0, 0 };
+	uint32_t before = layout->orphan_lines;
+	
+	switch (block->type) {
+		case S_NODE_SIMULTANEOUS_CUES:
+			// Dual dialogue sits side by side and is never split.
+			if (block->first_child && block->first_child != block->last_child) {
+				for (ASTNode *cue = block->first_child; cue; cue = cue->next) {
+					uint32_t height = measure_node(cue, source, layout->dual_dialogue_width);
+					if (height > result.height)
+						result.height = height;
+				}
+				
+				return result;
+			}
+			
+			// Otherwise it's a single speech.
+		case S_NODE_CUE:
+			result.height = measure_node(block, source, layout->dialogue_width);
+			result.flags = BLOCK_DIALOGUE;
+			
+			// The character's name doesn't count towards the lines left before a break.
+			++before;
+			break;
+		case S_NODE_HEADER:
+			result.height = measure_node(block, source, layout->description_width);
+			if (!result.height)
+				result.height = 1;
+			
+			result.flags = BLOCK_KEEP_WITH_NEXT;
+			return result;
+		case S_NODE_DESCRIPTION:
+		case S_NODE_FACSIMILE:
+			result.height = measure_node(block, source, layout->description_width);
+			break;
+		default:
+			result.height = measure_node(block, source, layout->description_width);
+			return result;
+	}
+	
+	uint32_t after = layout->widow_lines ? layout->widow_lines : 1;
+	
+	if (before < 1)
+		before = 1;
+	
+	if (result.height >= before + after) {
+		result.first_break = before;
+		result.last_break = result.height - after;
+	}
+	
+	return result;
+}
+
+static void pagination_reserve(Pagination *pagination,
+							   size_t count)
+{
+	if (count <= pagination->cap)
+		return;
+	
+	while (pagination->cap < count)
+		pagination->cap = pagination->cap ? pagination->cap * 2 : 256;
+	
+	pagination->blocks = c_realloc(pagination->blocks, pagination->cap * sizeof(BlockLayout));
+	pagination->prefix = c_realloc(pagination->prefix, (pagination->cap + 1) * sizeof(uint32_t));
+}
+
+static void pagination_add_break(Pagination *pagination,
+								 uint32_t block,
+								 uint32_t line,
+								 uint32_t continued)
+{
+	if (pagination->break_count >= pagination->break_cap) {
+		pagination->break_cap *= 2;
+		pagination->breaks = c_realloc(pagination->breaks, pagination->break_cap * sizeof(PageBreak));
+	}
+	
+	PageBreak *page = pagination->breaks + pagination->break_count++;
+	page->block = block;
+	page->line = line;
+	page->continued = continued;
+}
+
+static uint32_t prefix_at(Pagination *pagination,
+						  size_t i)
+{
+	while (pagination->prefix_valid < i) {
+		size_t k = pagination->prefix_valid++;
+		uint32_t height = pagination->blocks[k].height;
+		
+		pagination->prefix[k + 1] = pagination->prefix[k] + (height ? height + 1 : 0);
+	}
+	
+	return pagination->prefix[i];
+}
+
+// Returns the lines that blocks from `b` up to `k` add to a page with `used` lines on it. There's no blank line at the top of a page.
+static inline uint32_t run_cost(Pagination *pagination,
+								size_t b,
+								size_t k,
+								uint32_t used)
+{
+	uint32_t cost = prefix_at(pagination, k) - prefix_at(pagination, b);
+	
+	return (cost && !used) ? cost - 1 : cost;
+}
+
+// Returns the end of the longest run of whole blocks from `b` that fits on a page with `used` lines on it. Gallops, so the cost grows with the log of the run's length.
+static size_t fit_run(Pagination *pagination,
+					  size_t b,
+					  uint32_t used)
+{
+	uint32_t room = pagination->layout.lines_per_page - used;
+	size_t lo = b;
+	size_t step = 1;
+	
+	while (lo < pagination->count) {
+		size_t hi = lo + step < pagination->count ? lo + step : pagination->count;
+		
+		if (run_cost(pagination, b, hi, used) <= room) {
+			lo = hi;
+			step *= 2;
+			continue;
+		}
+		
+		while (hi - lo > 1) {
+			size_t mid = lo + (hi - lo) / 2;
+			
+			if (run_cost(pagination, b, mid, used) <= room)
+				lo = mid;
+			else
+				hi = mid;
+		}
+		
+		break;
+	}
+	
+	return lo;
+}
+
+// Paginates from the page at `start`, replacing the breaks after it. Once a page starts at the same place among the unchanged blocks from `suffix_start` on as one of `old` did, the rest of `old` is copied with its block indices moved by `shift`.
+static void paginate(Pagination *pagination,
+					 size_t start,
+					 size_t suffix_start,
+					 const PageBreak *old,
+					 size_t old_count,
+					 ptrdiff_t shift)
+{
+	uint32_t lines = pagination->layout.lines_per_page;
+	PageBreak page = pagination->breaks[start];
+	pagination->break_count = start + 1;
+	
+	size_t b = page.block;
+	uint32_t done = page.line;
+	
+	// Lines at the top of the current page before any block: the (CONT'D) line of a continued speech.
+	uint32_t top = page.continued;
+	uint32_t used = top;
+	size_t o = 0;
+	
+	while (b < pagination->count) {
+		BlockLayout *block = pagination->blocks + b;
+		uint32_t room;
+		
+		if (!done) {
+			size_t k = fit_run(pagination, b, used);
+			
+			if (k > b) {
+				BlockLayout *last = pagination->blocks + k - 1;
+				
+				// A header that would end the page moves to the next one with the block after it, unless it's already at the top.
+				if (k < pagination->count && (last->flags & BLOCK_KEEP_WITH_NEXT) && (k - 1 > b || used > top)) {
+					BlockLayout *next = pagination->blocks + k;
+					uint32_t after = used + run_cost(pagination, b, k, used) + 1;
+					uint32_t needed = next->last_break ? next->first_break + ((next->flags & BLOCK_DIALOGUE) ? 1 : 0) : next->height;
+					
+					if (after + needed > lines) {
+						used += run_cost(pagination, b, k - 1, used);
+						b = k - 1;
+						goto new_page;
+					}
+				}
+				
+				used += run_cost(pagination, b, k, used);
+				b = k;
+				continue;
+			}
+			
+			uint32_t gap = used ? 1 : 0;
+			room = used + gap < lines ? lines - used - gap : 0;
+		} else {
+			room = used < lines ? lines - used : 0;
+			
+			if (block->height - done <= room) {
+				used += block->height - done;
+				done = 0;
+				++b;
+				continue;
+			}
+		}
+		
+		// The block doesn't fit, so it's split here if the rules allow, or else moved to the next page.
+		uint32_t more = (block->flags & BLOCK_DIALOGUE) ? 1 : 0;
+		uint32_t take = 0;
+		
+		if (block->last_break) {
+			take = room > more ? room - more : 0;
+			
+			if (done + take > block->last_break)
+				take = block->last_break > done ? block->last_break - done : 0;
+			
+			if (!done && take < block->first_break)
+				take = 0;
+		}
+		
+		// On a page with nothing else on it the block has to be split anyway, however it breaks the rules.
+		if (!take && used == top) {
+			take = room > more ? room - more : 1;
+			
+			// A page too short for even that holds the rest of the block.
+			if (take >= block->height - done) {
+				used = lines;
+				done = 0;
+				++b;
+				continue;
+			}
+		}
+		
+		done += take;
+	
+	new_page:
+		// Starts with the block at `b`, or carries on a split speech.
+		page.block = (uint32_t)b;
+		page.line = done;
+		page.continued = (done && (pagination->blocks[b].flags & BLOCK_DIALOGUE)) ? 1 : 0;
+		
+		pagination_add_break(pagination, page.block, page.line, page.continued);
+		
+		if (b >= suffix_start && old_count) {
+			size_t ob = b - shift;
+			
+			while (o < old_count && (old[o].block < ob || (old[o].block == ob && old[o].line < done)))
+				++o;
+			
+			if (o < old_count && old[o].block == ob && old[o].line == done && old[o].continued == page.continued) {
+				// Everything from here on is as it was, moved along.
+				for (++o; o < old_count; ++o)
+					pagination_add_break(pagination, (uint32_t)(old[o].block + shift), old[o].line, old[o].continued);
+				
+				return;
+			}
+		}
+		
+		top = page.continued;
+		used = top;
+	}
+}
+
+void pagination_layout(Pagination *pagination,
+					   ASTNode **blocks,
+					   size_t count,
+					   const char *source)
+{
+	pagination_reserve(pagination, count);
+	pagination->end = count ? s_range_max(blocks[count - 1]->range) : 0;
+	pagination->gap = count;
+	
+	for (size_t i = 0; i < count; ++i)
+		pagination->blocks[i] = layout_block(&pagination->layout, blocks[i], source);
+	
+	pagination->count = count;
+	pagination->laid_out = count;
+	pagination->prefix_valid = 0;
+	
+	pagination->break_count = 1;
+	memset(pagination->breaks, 0, sizeof(PageBreak));
+	
+	paginate(pagination, 0, count, NULL, 0, 0);
+}
+
+// Moves the boundary between blocks that keep their location and blocks that keep their distance from the end, converting the blocks in between.
+static void pagination_move_gap(Pagination *pagination,
+								size_t gap)
+{
+	BlockLayout *blocks = pagination->blocks;
+	uint32_t end = pagination->end;
+	
+	for (; pagination->gap < gap; ++pagination->gap)
+		blocks[pagination->gap].position = end - blocks[pagination->gap].position;
+	
+	while (pagination->gap > gap) {
+		--pagination->gap;
+		blocks[pagination->gap].position = end - blocks[pagination->gap].position;
+	}
+}
+
+void pagination_edit(Pagination *pagination,
+					 ASTNode **blocks,
+					 size_t count,
+					 const char *source,
+					 uint32_t location,
+					 uint32_t old_length,
+					 uint32_t new_length)
+{
+	size_t old_count = pagination->count;
+	
+	// The first block that reaches the edit. Blocks that only touch it may have changed too.
+	size_t lo = 0;
+	size_t hi = count;
+	
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+		
+		if (s_range_max(blocks[mid]->range) < location)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	
+	size_t first = lo < old_count ? lo : old_count;
+	pagination_move_gap(pagination, first);
+	
+	// The text before the edit is the same, so blocks before that are too, except that the last of them may once have run on into the edit.
+	while (first && (pagination->blocks[first - 1].position != blocks[first - 1]->range.location ||
+					 pagination->blocks[first - 1].length != blocks[first - 1]->range.length))
+		pagination_move_gap(pagination, --first);
+	
+	// Blocks that start after the edit are the old document's last blocks, moved along. If the edit split or joined blocks the first of them may be new, but once one is where it was the rest are too.
+	uint32_t edit_end = location + new_length;
+	pagination->end += new_length - old_length;
+	hi = count;
+	
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+		
+		if (blocks[mid]->range.location <= edit_end)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	
+	size_t suffix = count - lo;
+	
+	if (suffix > old_count - first)
+		suffix = old_count - first;
+	
+	while (suffix) {
+		ASTNode *block = blocks[count - suffix];
+		BlockLayout *old = pagination->blocks + old_count - suffix;
+		
+		if (old->position == pagination->end - block->range.location && old->length == block->range.length)
+			break;
+		
+		--suffix;
+	}
+	
+	pagination_reserve(pagination, count);
+	
+	if (count != old_count)
+		memmove(pagination->blocks + count - suffix, pagination->blocks + old_count - suffix, suffix * sizeof(BlockLayout));
+	
+	for (size_t i = first; i < count - suffix; ++i)
+		pagination->blocks[i] = layout_block(&pagination->layout, blocks[i], source);
+	
+	pagination->gap = count - suffix;
+	pagination->count = count;
+	pagination->laid_out = count - suffix - first;
+	
+	if (pagination->prefix_valid > first)
+		pagination->prefix_valid = first;
+	
+	// Restart from the page holding the block before the edit, in case it's a header that has to move with the block after it.
+	size_t restart = first ? first - 1 : 0;
+	lo = 0;
+	hi = pagination->break_count;
+	
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+		PageBreak *page = pagination->breaks + mid;
+		
+		if (page->block < restart || (page->block == restart && !page->line))
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	
+	size_t start = lo ? lo - 1 : 0;
+	
+	// A page that starts with that block may only start there because it's a header that was pushed off the page before, so restart from that one instead.
+	if (start && pagination->breaks[start].block == restart && !pagination->breaks[start].line)
+		--start;
+	
+	size_t old_breaks = pagination->break_count - start - 1;
+	
+	if (old_breaks > pagination->old_cap) {
+		pagination->old_cap = old_breaks;
+		pagination->old_breaks = c_realloc(pagination->old_breaks, old_breaks * sizeof(PageBreak));
+	}
+	
+	if (old_breaks)
+		memcpy(pagination->old_breaks, pagination->breaks + start + 1, old_breaks * sizeof(PageBreak));
+	
+	paginate(pagination, start, count - suffix, pagination->old_breaks, old_breaks, (ptrdiff_t)count - (ptrdiff_t)old_count);
+}
+
+size_t pagination_get_page_count(Pagination *pagination)
+{
+	return pagination->break_count;
+}
+
+const PageBreak *pagination_get_breaks(Pagination *pagination,
+									   size_t *count)
+{
+	*count = pagination->break_count;
+	
+	return pagination->breaks;
+}
+
+size_t pagination_page_of_block(Pagination *pagination,
+								size_t block)
+{
+	size_t lo = 0;
+	size_t hi = pagination->break_count;
+	
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+		PageBreak *page = pagination->breaks + mid;
+		
+		if (page->block < block || (page->block == block && !page->line))
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	
+	return lo ? lo - 1 : 0;
+}
+
+size_t pagination_get_blocks_laid_out(Pagination *pagination)
+{
+	return pagination->laid_out;
+}
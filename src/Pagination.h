@@ -0,0 +1,90 @@
+
+#ifndef Pagination_h
+#define Pagination_h
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "nodes.h"
+
+/** The page and column sizes pagination lays text out in, counted in lines
+ * and characters of a monospaced font. `orphan_lines` is the fewest lines of
+ * a paragraph or speech that can be left at the bottom of a page, and
+ * `widow_lines` the fewest that can be carried over to the next.
+ */
+typedef struct
+{
+	uint32_t lines_per_page;
+	uint32_t description_width;
+	uint32_t dialogue_width;
+	uint32_t dual_dialogue_width;
+	uint32_t orphan_lines;
+	uint32_t widow_lines;
+} PageLayout;
+
+/** Returns the usual screenplay layout: 54 lines a page, 61 characters for
+ * description, 35 for dialogue and 28 for each side of dual dialogue, and at
+ * least 2 lines either side of a break.
+ */
+PageLayout page_layout_default(void);
+
+/** Where a page starts: at `line` of the top-level block at `block`, which
+ * is 0 unless the block was split. `continued` is set when the page carries
+ * on a speech, so that the page before ends with (MORE) and this one starts
+ * with the character's name and (CONT'D).
+ */
+typedef struct
+{
+	uint32_t block;
+	uint32_t line;
+	uint32_t continued;
+} PageBreak;
+
+/** Breaks a document into pages. Each top-level block is laid out once and
+ * its line count kept, so after an edit only the blocks it touched are laid
+ * out again, and page breaks are only recomputed from the page before the
+ * first of them until they fall back into step with the old ones.
+ */
+typedef struct Pagination Pagination;
+
+Pagination *pagination_new(const PageLayout *layout);
+
+void pagination_free(Pagination *pagination);
+
+/** Lays out and paginates every one of `blocks`, the top-level blocks of a
+ * document in order.
+ */
+void pagination_layout(Pagination *pagination,
+					   ASTNode **blocks,
+					   size_t count,
+					   const char *source);
+
+/** Updates `pagination` after an edit replaced `old_length` bytes at
+ * `location` with `new_length` bytes, given the blocks of the document
+ * parsed again. Blocks that end before the edit or start after it are
+ * taken to be unchanged.
+ */
+void pagination_edit(Pagination *pagination,
+					 ASTNode **blocks,
+					 size_t count,
+					 const char *source,
+					 uint32_t location,
+					 uint32_t old_length,
+					 uint32_t new_length);
+
+size_t pagination_get_page_count(Pagination *pagination);
+
+/** Returns the start of every page in order and stores their number in
+ * `count`.
+ */
+const PageBreak *pagination_get_breaks(Pagination *pagination,
+									   size_t *count);
+
+/** Returns the 0-based page that the block at `block` starts on. */
+size_t pagination_page_of_block(Pagination *pagination,
+								size_t block);
+
+/** Returns the number of blocks laid out by the last update. */
+size_t pagination_get_blocks_laid_out(Pagination *pagination);
+
+#endif /* Pagination_h */
@@ -0,0 +1,556 @@
+
+#include "Query.h"
+
+#include <string.h>
+
+#include "mem.h"
+
+typedef enum
+{
+	COMBINATOR_NONE,
+	COMBINATOR_DESCENDANT,
+	COMBINATOR_CHILD,
+	COMBINATOR_SIBLING
+} Combinator;
+
+#define ANY_TYPE -1
+
+typedef struct
+{
+	int type;
+	int header_type;
+	int dual;
+	Combinator combinator;
+	
+	// Offsets into the query's copy of the selector. A length of zero means the attribute wasn't given.
+	size_t id_location, id_length;
+	size_t text_location, text_length;
+} QueryStep;
+
+/* Each step of a selector is a state of the automaton. Matching runs all states at once as a bit set: for every node we compute which steps it satisfies from the states of its parent and preceding siblings. */
+typedef struct
+{
+	uint32_t matched;
+	uint32_t ancestors;
+	uint32_t siblings;
+	
+	// For each step in `siblings`, the ranks of the headers that opened it. Bit 7 marks a match that never closes.
+	uint8_t open[CUE_QUERY_MAX_STEPS];
+} QueryFrame;
+
+struct CueQuery
+{
+	char *selector;
+	QueryStep steps[CUE_QUERY_MAX_STEPS];
+	size_t len;
+	
+	// Steps whose successor uses the sibling combinator.
+	uint32_t sibling_steps;
+	
+	// Node types required by steps k through the last, used to skip subtrees that can't finish a match.
+	uint32_t suffix_types[CUE_QUERY_MAX_STEPS];
+	
+	QueryFrame *frames;
+	size_t frames_cap;
+};
+
+#define SIBLING_NEVER_CLOSES 0x80
+
+static const char *query_type_names[S_NODE_TYPE_COUNT] = {
+	"document",
+	"header",
+	"description",
+	"simultaneous_cues",
+	"facsimile",
+	"thematic_break",
+	"end",
+	"cue",
+	"lyric_direction",
+	"plain_direction",
+	"line",
+	"stream",
+	"keyword",
+	"identifier",
+	"title",
+	"name",
+	"url",
+	"literal",
+	"emphasis",
+	"strong",
+	"reference",
+	"parenthetical",
+	"comment"
+};
+
+static const char *query_header_type_names[] = {
+	"act",
+	"scene",
+	"page",
+	"frame",
+	"forced"
+};
+
+// Forced headers open a section at the same level as an act.
+static int header_rank(uint32_t header_type)
+{
+	return header_type == HEADER_FORCED ? HEADER_ACT : header_type;
+}
+
+static int is_ident_char(char c)
+{
+	return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_' || c == '-' || c == '.' || (unsigned char)c >= 0x80;
+}
+
+static int is_space(char c)
+{
+	return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+static int match_word(const char *s, size_t len, const char *word)
+{
+	size_t wlen = strlen(word);
+	
+	return len == wlen && memcmp(s, word, len) == 0;
+}
+
+typedef struct
+{
+	const char *s;
+	size_t len;
+	size_t loc;
+} QueryParser;
+
+static void query_parser_skip_space(QueryParser *p)
+{
+	while (p->loc < p->len && is_space(p->s[p->loc]))
+		++p->loc;
+}
+
+static size_t query_parser_scan_ident(QueryParser *p)
+{
+	size_t start = p->loc;
+	
+	while (p->loc < p->len && is_ident_char(p->s[p->loc]))
+		++p->loc;
+	
+	return p->loc - start;
+}
+
+// Scans a bare or double-quoted attribute value.
+static int query_parser_scan_value(QueryParser *p,
+								   size_t *location,
+								   size_t *length)
+{
+	if (p->loc < p->len && p->s[p->loc] == '"') {
+		size_t start = ++p->loc;
+		
+		while (p->loc < p->len && p->s[p->loc] != '"')
+			++p->loc;
+		
+		if (p->loc >= p->len || p->loc == start)
+			return 0;
+		
+		*location = start;
+		*length = p->loc++ - start;
+		
+		return 1;
+	}
+	
+	*location = p->loc;
+	*length = query_parser_scan_ident(p);
+	
+	return *length != 0;
+}
+
+static int query_parser_scan_attribute(QueryParser *p,
+									   QueryStep *step)
+{
+	// Assumes p->loc is just past '['
+	size_t nstart = p->loc;
+	size_t nlen = query_parser_scan_ident(p);
+	const char *name = p->s + nstart;
+	
+	if (match_word(name, nlen, "dual")) {
+		if (step->type != S_NODE_CUE)
+			return 0;
+		
+		step->dual = 1;
+	} else {
+		if (p->loc >= p->len || p->s[p->loc] != '=')
+			return 0;
+		++p->loc;
+		
+		size_t vloc, vlen;
+		if (!query_parser_scan_value(p, &vloc, &vlen))
+			return 0;
+		
+		if (match_word(name, nlen, "type")) {
+			if (step->type != S_NODE_HEADER)
+				return 0;
+			
+			size_t n = sizeof(query_header_type_names) / sizeof(*query_header_type_names);
+			for (size_t i = 0; i < n; ++i) {
+				if (match_word(p->s + vloc, vlen, query_header_type_names[i]))
+					step->header_type = (int)i;
+			}
+			
+			if (step->header_type < 0)
+				return 0;
+		} else if (match_word(name, nlen, "id")) {
+			if (step->type != S_NODE_HEADER)
+				return 0;
+			
+			step->id_location = vloc;
+			step->id_length = vlen;
+		} else if (match_word(name, nlen, "text")) {
+			step->text_location = vloc;
+			step->text_length = vlen;
+		} else {
+			return 0;
+		}
+	}
+	
+	if (p->loc >= p->len || p->s[p->loc] != ']')
+		return 0;
+	++p->loc;
+	
+	return 1;
+}
+
+static int query_parser_scan_step(QueryParser *p,
+								  QueryStep *step)
+{
+	step->type = ANY_TYPE;
+	step->header_type = -1;
+	step->dual = 0;
+	step->id_length = 0;
+	step->text_length = 0;
+	
+	if (p->loc < p->len && p->s[p->loc] == '*') {
+		++p->loc;
+	} else {
+		size_t tstart = p->loc;
+		size_t tlen = query_parser_scan_ident(p);
+		
+		for (int t = 0; t < S_NODE_TYPE_COUNT; ++t) {
+			if (match_word(p->s + tstart, tlen, query_type_names[t]))
+				step->type = t;
+		}
+		
+		if (step->type == ANY_TYPE) {
+			p->loc = tstart;
+			return 0;
+		}
+	}
+	
+	while (p->loc < p->len && p->s[p->loc] == '[') {
+		++p->loc;
+		
+		if (!query_parser_scan_attribute(p, step))
+			return 0;
+	}
+	
+	return 1;
+}
+
+CueQuery *cue_query_compile(const char *selector,
+							size_t length,
+							size_t *error_offset)
+{
+	CueQuery *q = c_calloc(1, sizeof(CueQuery));
+	
+	q->selector = c_malloc(length + 1);
+	memcpy(q->selector, selector, length);
+	q->selector[length] = '\0';
+	
+	QueryParser p = { q->selector, length, 0 };
+	
+	query_parser_skip_space(&p);
+	
+	Combinator combinator = COMBINATOR_NONE;
+	for (;;) {
+		if (q->len >= CUE_QUERY_MAX_STEPS)
+			goto error;
+		
+		QueryStep *step = q->steps + q->len++;
+		
+		if (!query_parser_scan_step(&p, step))
+			goto error;
+		
+		step->combinator = combinator;
+		if (combinator == COMBINATOR_SIBLING)
+			q->sibling_steps |= (uint32_t)1 << (q->len - 2);
+		
+		size_t before = p.loc;
+		query_parser_skip_space(&p);
+		
+		if (p.loc >= p.len)
+			break;
+		
+		char c = p.s[p.loc];
+		if (c == '>' || c == '~') {
+			combinator = (c == '>') ? COMBINATOR_CHILD : COMBINATOR_SIBLING;
+			++p.loc;
+			query_parser_skip_space(&p);
+		} else if (p.loc > before) {
+			combinator = COMBINATOR_DESCENDANT;
+		} else {
+			goto error;
+		}
+	}
+	
+	uint32_t types = 0;
+	for (size_t k = q->len; k-- > 0;) {
+		if (q->steps[k].type != ANY_TYPE)
+			types |= S_NODE_MASK(q->steps[k].type);
+		
+		q->suffix_types[k] = types;
+	}
+	
+	return q;
+
+error:
+	if (error_offset)
+		*error_offset = p.loc;
+	
+	cue_query_free(q);
+	
+	return NULL;
+}
+
+void cue_query_free(CueQuery *query)
+{
+	free(query->selector);
+	free(query->frames);
+	
+	free(query);
+}
+
+static int query_text_equals(const char *source,
+							 ASTNode *node,
+							 const char *value,
+							 size_t length)
+{
+	return node && node->range.length == length && memcmp(source + node->range.location, value, length) == 0;
+}
+
+static int query_step_accepts(CueQuery *q,
+							  QueryStep *step,
+							  ASTNode *node,
+							  const char *source)
+{
+	if (step->type != ANY_TYPE && step->type != (int)node->type)
+		return 0;
+	
+	if (step->header_type >= 0 && (int)node->as.header.type != step->header_type)
+		return 0;
+	
+	if (step->dual && !node->as.cue.isDual)
+		return 0;
+	
+	if (step->id_length && !query_text_equals(source, node->as.header.id, q->selector + step->id_location, step->id_length))
+		return 0;
+	
+	if (step->text_length && !query_text_equals(source, node, q->selector + step->text_location, step->text_length))
+		return 0;
+	
+	return 1;
+}
+
+static uint32_t query_match_node(CueQuery *q,
+								 QueryFrame *parent,
+								 ASTNode *node,
+								 const char *source)
+{
+	uint32_t matched = 0;
+	
+	for (size_t i = 0; i < q->len; ++i) {
+		QueryStep *step = q->steps + i;
+		uint32_t prev = (uint32_t)1 << i >> 1;
+		
+		switch (step->combinator) {
+			case COMBINATOR_NONE:
+				break;
+			case COMBINATOR_DESCENDANT:
+				if (!(parent->ancestors & prev))
+					continue;
+				break;
+			case COMBINATOR_CHILD:
+				if (!(parent->matched & prev))
+					continue;
+				break;
+			case COMBINATOR_SIBLING:
+				if (!(parent->siblings & prev))
+					continue;
+				break;
+		}
+		
+		if (query_step_accepts(q, step, node, source))
+			matched |= (uint32_t)1 << i;
+	}
+	
+	return matched;
+}
+
+// A header ends the sections of every earlier header of the same or lower rank.
+static void query_frame_close_sections(CueQuery *q,
+									   QueryFrame *parent,
+									   ASTNode *header)
+{
+	int rank = header_rank(header->as.header.type);
+	uint8_t keep = (uint8_t)(((1 << rank) - 1) | SIBLING_NEVER_CLOSES);
+	
+	for (size_t j = 0; j < q->len; ++j) {
+		uint32_t bit = (uint32_t)1 << j;
+		if (!(parent->siblings & bit))
+			continue;
+		
+		parent->open[j] &= keep;
+		if (!parent->open[j])
+			parent->siblings &= ~bit;
+	}
+}
+
+// Records `node`'s matches in its parent so that later siblings can see them.
+static void query_frame_open_siblings(CueQuery *q,
+									  QueryFrame *parent,
+									  ASTNode *node,
+									  uint32_t matched)
+{
+	uint32_t live = matched & q->sibling_steps;
+	if (!live)
+		return;
+	
+	uint8_t rank_bit = SIBLING_NEVER_CLOSES;
+	if (node->type == S_NODE_HEADER)
+		rank_bit = (uint8_t)(1 << header_rank(node->as.header.type));
+	
+	for (size_t j = 0; j < q->len; ++j) {
+		uint32_t bit = (uint32_t)1 << j;
+		if (!(live & bit))
+			continue;
+		
+		if (!(parent->siblings & bit))
+			parent->open[j] = 0;
+		
+		parent->open[j] |= rank_bit;
+		parent->siblings |= bit;
+	}
+}
+
+// Returns true if some match could still finish inside `node`'s subtree.
+static int query_can_match_below(CueQuery *q,
+								 QueryFrame *frame,
+								 ASTNode *node)
+{
+	uint32_t reachable = ast_node_type_descendant_mask(node->type);
+	
+	for (size_t k = 0; k < q->len; ++k) {
+		if (q->suffix_types[k] & ~reachable)
+			continue;
+		
+		uint32_t prev = (uint32_t)1 << k >> 1;
+		
+		switch (q->steps[k].combinator) {
+			case COMBINATOR_NONE:
+				return 1;
+			case COMBINATOR_DESCENDANT:
+				if (frame->ancestors & prev)
+					return 1;
+				break;
+			case COMBINATOR_CHILD:
+				if (frame->matched & prev)
+					return 1;
+				break;
+			case COMBINATOR_SIBLING:
+				break;
+		}
+	}
+	
+	return 0;
+}
+
+static QueryFrame *query_frame_at(CueQuery *q,
+								  size_t depth)
+{
+	if (depth >= q->frames_cap) {
+		q->frames_cap = q->frames_cap ? q->frames_cap * 2 : 16;
+		q->frames = c_realloc(q->frames, q->frames_cap * sizeof(QueryFrame));
+	}
+	
+	return q->frames + depth;
+}
+
+// Enters `node` at `depth` and returns true if its children should be visited.
+static int query_enter_node(CueQuery *q,
+							ASTNode *node,
+							size_t depth,
+							const char *source,
+							ASTNode **out,
+							size_t cap,
+							size_t *count)
+{
+	// Reserve first, since growing the stack may move the parent frame.
+	QueryFrame *frame = query_frame_at(q, depth);
+	QueryFrame *parent = frame - 1;
+	
+	if (node->type == S_NODE_HEADER && parent->siblings)
+		query_frame_close_sections(q, parent, node);
+	
+	uint32_t matched = query_match_node(q, parent, node, source);
+	
+	if (matched & ((uint32_t)1 << (q->len - 1))) {
+		if (*count < cap)
+			out[*count] = node;
+		++*count;
+	}
+	
+	query_frame_open_siblings(q, parent, node, matched);
+	
+	frame->matched = matched;
+	frame->ancestors = matched | parent->ancestors;
+	frame->siblings = 0;
+	
+	return node->first_child && query_can_match_below(q, frame, node);
+}
+
+size_t cue_query_run(CueQuery *query,
+					 ASTNode *root,
+					 const char *source,
+					 ASTNode **out,
+					 size_t cap)
+{
+	size_t count = 0;
+	
+	// Frame 0 stands in for the root's parent.
+	QueryFrame *base = query_frame_at(query, 0);
+	base->matched = 0;
+	base->ancestors = 0;
+	base->siblings = 0;
+	
+	ASTNode *node = root;
+	size_t depth = 1;
+	int descend = query_enter_node(query, node, depth, source, out, cap, &count);
+	
+	for (;;) {
+		if (descend) {
+			node = node->first_child;
+			++depth;
+			descend = query_enter_node(query, node, depth, source, out, cap, &count);
+			continue;
+		}
+		
+		while (node != root && !node->next) {
+			node = node->parent;
+			--depth;
+		}
+		
+		if (node == root)
+			break;
+		
+		node = node->next;
+		descend = query_enter_node(query, node, depth, source, out, cap, &count);
+	}
+	
+	return count;
+}
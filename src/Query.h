@@ -0,0 +1,46 @@
+
+#ifndef Query_h
+#define Query_h
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "nodes.h"
+
+/** A compiled structural query. Selectors are written as a chain of node
+ * types separated by combinators:
+ *
+ *     header[type=scene][id=12] ~ simultaneous_cues > cue > name
+ *
+ * `a b` matches b anywhere below a, `a > b` matches b directly below a, and
+ * `a ~ b` matches b among the following siblings of a. When a is a header,
+ * `~` stops at the next header of the same or higher rank, so it selects the
+ * blocks in that header's section. `*` matches any node type.
+ *
+ * Attributes: `[type=act|scene|page|frame|forced]` and `[id=...]` on headers,
+ * `[dual]` on cues, and `[text=...]` on any node. Values may be quoted.
+ */
+typedef struct CueQuery CueQuery;
+
+#define CUE_QUERY_MAX_STEPS 32
+
+/** Compiles `selector`. Returns NULL on a syntax error and, if `error_offset`
+ * isn't NULL, stores the offset into `selector` where compilation failed.
+ */
+CueQuery *cue_query_compile(const char *selector,
+							size_t length,
+							size_t *error_offset);
+
+void cue_query_free(CueQuery *query);
+
+/** Runs `query` over the tree rooted at `root`, storing up to `cap` matches
+ * into `out` in document order. Returns the total number of matches, which
+ * may be larger than `cap`.
+ */
+size_t cue_query_run(CueQuery *query,
+					 ASTNode *root,
+					 const char *source,
+					 ASTNode **out,
+					 size_t cap);
+
+#endif /* Query_h */
@@ -0,0 +1,253 @@
+
+#include "ReferenceTable.h"
+
+#include <string.h>
+
+#include "mem.h"
+#include "Hash.h"
+
+struct ReferenceTable
+{
+	ReferenceEntry *entries;
+	size_t len;
+	size_t cap;
+	
+	// Entries by trimmed target.
+	HashTable slots;
+	
+	// Every reference in document order along with the index of its entry, until finalizing groups them by entry.
+	ASTNode **occurrences;
+	uint32_t *owners;
+	size_t occurrence_count;
+	size_t occurrence_cap;
+	
+	// The scenes of every entry, back to back.
+	ASTNode **scenes;
+};
+
+ReferenceTable *reference_table_new()
+{
+	ReferenceTable *table = c_calloc(1, sizeof(ReferenceTable));
+	
+	hash_table_init(&table->slots, 64);
+	
+	return table;
+}
+
+void reference_table_free(ReferenceTable *table)
+{
+	free(table->entries);
+	hash_table_free(&table->slots);
+	free(table->occurrences);
+	free(table->owners);
+	free(table->scenes);
+	
+	free(table);
+}
+
+static inline int is_target_space(char c)
+{
+	return c == ' ' || c == '\t';
+}
+
+// Trims whitespace from both ends of `*target` and returns the 32-bit FNV-1a hash of what's left.
+static uint32_t trim_target(const char **target,
+							size_t *length)
+{
+	const char *s = *target;
+	size_t n = *length;
+	
+	while (n && is_target_space(s[0])) {
+		++s;
+		--n;
+	}
+	
+	while (n && is_target_space(s[n - 1]))
+		--n;
+	
+	uint32_t h = FNV_OFFSET_BASIS;
+	for (size_t i = 0; i < n; ++i)
+		h = (h ^ (unsigned char)s[i]) * FNV_PRIME;
+	
+	*target = s;
+	*length = n;
+	
+	return h;
+}
+
+typedef struct
+{
+	ReferenceTable *table;
+	const char *target;
+	size_t length;
+} TargetKey;
+
+static int target_equals(const void *context,
+						 uint32_t e)
+{
+	const TargetKey *key = context;
+	ReferenceEntry *entry = key->table->entries + e;
+	
+	return entry->target_length == key->length && memcmp(entry->target, key->target, key->length) == 0;
+}
+
+// Returns the slot that holds `target`, or the empty slot where it belongs.
+static HashSlot *find_slot(ReferenceTable *table,
+						   const char *target,
+						   size_t length,
+						   uint32_t hash)
+{
+	TargetKey key = { table, target, length };
+	
+	return hash_table_find(&table->slots, hash, target_equals, &key);
+}
+
+void reference_table_add(ReferenceTable *table,
+						 ASTNode *reference,
+						 const char *source)
+{
+	// The node's range includes its brackets.
+	const char *target = source + reference->range.location + 1;
+	size_t length = reference->range.length >= 2 ? reference->range.length - 2 : 0;
+	uint32_t hash = trim_target(&target, &length);
+	
+	HashSlot *slot = find_slot(table, target, length, hash);
+	uint32_t owner = slot->entry - 1;
+	
+	if (!slot->entry) {
+		if (table->len >= table->cap) {
+			table->cap = table->cap ? table->cap * 2 : 32;
+			table->entries = c_realloc(table->entries, table->cap * sizeof(ReferenceEntry));
+		}
+		
+		size_t e = table->len++;
+		
+		memset(table->entries + e, 0, sizeof(ReferenceEntry));
+		table->entries[e].target = target;
+		table->entries[e].target_length = (uint32_t)length;
+		
+		hash_table_insert(&table->slots, slot, hash, (uint32_t)e);
+		owner = (uint32_t)e;
+	}
+	
+	if (table->occurrence_count >= table->occurrence_cap) {
+		table->occurrence_cap = table->occurrence_cap ? table->occurrence_cap * 2 : 64;
+		table->occurrences = c_realloc(table->occurrences, table->occurrence_cap * sizeof(ASTNode*));
+		table->owners = c_realloc(table->owners, table->occurrence_cap * sizeof(uint32_t));
+	}
+	
+	table->occurrences[table->occurrence_count] = reference;
+	table->owners[table->occurrence_count] = owner;
+	++table->occurrence_count;
+}
+
+void reference_table_finalize(ReferenceTable *table,
+							  ASTNode *root)
+{
+	ReferenceEntry *entries = table->entries;
+	size_t count = table->occurrence_count;
+	
+	// Counting sort the occurrences by entry, keeping document order within each.
+	for (size_t i = 0; i < count; ++i)
+		++entries[table->owners[i]].occurrence_count;
+	
+	ASTNode **grouped = c_malloc((count + 1) * sizeof(ASTNode*));
+	table->scenes = c_malloc((count + 1) * sizeof(ASTNode*));
+	
+	size_t start = 0;
+	for (size_t e = 0; e < table->len; ++e) {
+		entries[e].occurrences = grouped + start;
+		entries[e].scenes = table->scenes + start;
+		start += entries[e].occurrence_count;
+		entries[e].occurrence_count = 0;
+	}
+	
+	// Occurrences are in document order, so one pass over the blocks finds the scene of each. An act ends its last scene.
+	ASTNode *block = root->first_child;
+	ASTNode *scene = NULL;
+	
+	for (size_t i = 0; i < count; ++i) {
+		ASTNode *reference = table->occurrences[i];
+		
+		ASTNode *top = reference;
+		while (top->parent && top->parent != root)
+			top = top->parent;
+		
+		// A scene header's own title counts as part of the scene.
+		for (; block; block = block->next) {
+			if (block->type == S_NODE_HEADER && block->as.header.type <= HEADER_SCENE)
+				scene = (block->as.header.type == HEADER_SCENE) ? block : NULL;
+			
+			if (block == top)
+				break;
+		}
+		
+		ReferenceEntry *entry = entries + table->owners[i];
+		entry->occurrences[entry->occurrence_count++] = reference;
+		
+		if (scene && (!entry->scene_count || entry->scenes[entry->scene_count - 1] != scene))
+			entry->scenes[entry->scene_count++] = scene;
+	}
+	
+	free(table->occurrences);
+	free(table->owners);
+	table->occurrences = grouped;
+	table->owners = NULL;
+}
+
+void reference_table_update_scenes(ReferenceTable *table,
+								   uint32_t start,
+								   uint32_t end,
+								   ASTNode *(*scene_at)(void *context, uint32_t offset),
+								   void *context)
+{
+	for (size_t e = 0; e < table->len; ++e) {
+		ReferenceEntry *entry = table->entries + e;
+		
+		// Find the first occurrence at or after start.
+		size_t lo = 0;
+		size_t hi = entry->occurrence_count;
+		
+		while (lo < hi) {
+			size_t mid = lo + (hi - lo) / 2;
+			
+			if (entry->occurrences[mid]->range.location < start)
+				lo = mid + 1;
+			else
+				hi = mid;
+		}
+		
+		if (lo == entry->occurrence_count || entry->occurrences[lo]->range.location >= end)
+			continue;
+		
+		// An entry never has more scenes than occurrences, so its list is rebuilt where it is.
+		entry->scene_count = 0;
+		
+		for (size_t i = 0; i < entry->occurrence_count; ++i) {
+			ASTNode *scene = scene_at(context, entry->occurrences[i]->range.location);
+			
+			if (scene && (!entry->scene_count || entry->scenes[entry->scene_count - 1] != scene))
+				entry->scenes[entry->scene_count++] = scene;
+		}
+	}
+}
+
+size_t reference_table_count(ReferenceTable *table)
+{
+	return table->len;
+}
+
+ReferenceEntry *reference_table_get_entries(ReferenceTable *table)
+{
+	return table->entries;
+}
+
+ReferenceEntry *reference_table_lookup(ReferenceTable *table,
+									   const char *target,
+									   size_t length)
+{
+	uint32_t hash = trim_target(&target, &length);
+	HashSlot *slot = find_slot(table, target, length, hash);
+	
+	return slot->entry ? table->entries + (slot->entry - 1) : NULL;
+}
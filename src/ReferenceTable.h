@@ -0,0 +1,73 @@
+
+#ifndef ReferenceTable_h
+#define ReferenceTable_h
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "nodes.h"
+
+/** Every use of one reference target. `target` is the text between the
+ * brackets with surrounding whitespace trimmed, and points into the source
+ * of its first occurrence. `occurrences` holds the reference nodes in
+ * document order, and `scenes` the distinct scene headers they fall under,
+ * also in document order. Occurrences before the first scene of an act
+ * aren't under any.
+ */
+typedef struct
+{
+	const char *target;
+	uint32_t target_length;
+	
+	ASTNode **occurrences;
+	uint32_t occurrence_count;
+	
+	ASTNode **scenes;
+	uint32_t scene_count;
+} ReferenceEntry;
+
+/** Groups the references of a document by target, so that each target only
+ * needs resolving once. Targets are compared byte for byte, since they
+ * usually name files.
+ */
+typedef struct ReferenceTable ReferenceTable;
+
+ReferenceTable *reference_table_new(void);
+
+void reference_table_free(ReferenceTable *table);
+
+/** Records `reference` under its target. References must be added in
+ * document order.
+ */
+void reference_table_add(ReferenceTable *table,
+						 ASTNode *reference,
+						 const char *source);
+
+/** Groups the occurrences of each target and finds their scenes among the
+ * blocks of `root`. Must be called once the whole document is parsed.
+ */
+void reference_table_finalize(ReferenceTable *table,
+							  ASTNode *root);
+
+/** Finds the scenes again for every target with an occurrence between
+ * `start` and `end`, after a header has been inserted there. `scene_at`
+ * returns the scene that `offset` falls under, or NULL. Requires a finalized
+ * table.
+ */
+void reference_table_update_scenes(ReferenceTable *table,
+								   uint32_t start,
+								   uint32_t end,
+								   ASTNode *(*scene_at)(void *context, uint32_t offset),
+								   void *context);
+
+size_t reference_table_count(ReferenceTable *table);
+
+/** Returns every target in order of its first occurrence. */
+ReferenceEntry *reference_table_get_entries(ReferenceTable *table);
+
+/** Returns the entry for `target` after trimming, or NULL. */
+ReferenceEntry *reference_table_lookup(ReferenceTable *table,
+									   const char *target,
+									   size_t length);
+
+#endif /* ReferenceTable_h */
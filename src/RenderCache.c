@@ -0,0 +1,265 @@
+
+#include "RenderCache.h"
+
+#include <string.h>
+
+#include "mem.h"
+#include "Hash.h"
+
+// Marks the end of the LRU list or of the free list.
+#define NO_ENTRY UINT32_MAX
+
+// What a fragment was rendered from. The hash covers everything, but the block's type and length are kept as well so that a collision between different blocks is caught on a hit.
+typedef struct
+{
+	uint64_t hash;
+	uint32_t type;
+	uint32_t length;
+} BlockKey;
+
+typedef struct
+{
+	BlockKey key;
+	char *fragment;
+	uint32_t length;
+	
+	// Neighbours in the LRU list, most recently used first.
+	uint32_t prev;
+	uint32_t next;
+	
+	// The next free entry, once evicted.
+	uint32_t next_free;
+} CacheEntry;
+
+struct RenderCache
+{
+	RenderBlockFunc render;
+	size_t byte_limit;
+	
+	CacheEntry *entries;
+	size_t len;
+	size_t cap;
+	uint32_t free_list;
+	
+	// Entries by key.
+	HashTable slots;
+	
+	uint32_t head;
+	uint32_t tail;
+	
+	RenderCacheStats stats;
+	
+	// Misses are rendered here before they're stored.
+	MarkupContext *scratch;
+};
+
+RenderCache *render_cache_new(RenderBlockFunc render,
+							  size_t byte_limit)
+{
+	RenderCache *cache = c_calloc(1, sizeof(RenderCache));
+	
+	cache->render = render;
+	cache->byte_limit = byte_limit;
+	cache->free_list = NO_ENTRY;
+	cache->head = NO_ENTRY;
+	cache->tail = NO_ENTRY;
+	
+	hash_table_init(&cache->slots, 512);
+	
+	cache->scratch = markup_context_new();
+	
+	return cache;
+}
+
+void render_cache_free(RenderCache *cache)
+{
+	for (size_t i = 0; i < cache->len; ++i)
+		free(cache->entries[i].fragment);
+	
+	free(cache->entries);
+	hash_table_free(&cache->slots);
+	markup_context_free(cache->scratch);
+	
+	free(cache);
+}
+
+static BlockKey block_key(ASTNode *block,
+						  const char *source)
+{
+	uint64_t h = ((uint64_t)block->type << 32 | block->range.length) * HASH_MULTIPLIER;
+	
+	BlockKey key = { hash_bytes(source + block->range.location, block->range.length, h), block->type, block->range.length };
+	
+	return key;
+}
+
+static void lru_unlink(RenderCache *cache,
+					   uint32_t e)
+{
+	CacheEntry *entry = cache->entries + e;
+	
+	if (entry->prev != NO_ENTRY)
+		cache->entries[entry->prev].next = entry->next;
+	else
+		cache->head = entry->next;
+	
+	if (entry->next != NO_ENTRY)
+		cache->entries[entry->next].prev = entry->prev;
+	else
+		cache->tail = entry->prev;
+}
+
+static void lru_push_front(RenderCache *cache,
+						   uint32_t e)
+{
+	CacheEntry *entry = cache->entries + e;
+	
+	entry->prev = NO_ENTRY;
+	entry->next = cache->head;
+	
+	if (cache->head != NO_ENTRY)
+		cache->entries[cache->head].prev = e;
+	else
+		cache->tail = e;
+	
+	cache->head = e;
+}
+
+typedef struct
+{
+	RenderCache *cache;
+	const BlockKey *key;
+} EntryKey;
+
+static int entry_key_equals(const void *context,
+							uint32_t e)
+{
+	const EntryKey *key = context;
+	const BlockKey *stored = &key->cache->entries[e].key;
+	
+	return stored->hash == key->key->hash && stored->type == key->key->type && stored->length == key->key->length;
+}
+
+// Returns the slot that holds `key`, or the empty slot where it belongs.
+static HashSlot *find_slot(RenderCache *cache,
+						   const BlockKey *key)
+{
+	EntryKey context = { cache, key };
+	
+	return hash_table_find(&cache->slots, (uint32_t)key->hash, entry_key_equals, &context);
+}
+
+static void evict_entry(RenderCache *cache,
+						uint32_t e)
+{
+	CacheEntry *entry = cache->entries + e;
+	
+	hash_table_remove(&cache->slots, find_slot(cache, &entry->key));
+	lru_unlink(cache, e);
+	
+	cache->stats.bytes -= entry->length;
+	--cache->stats.count;
+	++cache->stats.evictions;
+	
+	free(entry->fragment);
+	entry->fragment = NULL;
+	
+	entry->next_free = cache->free_list;
+	cache->free_list = e;
+}
+
+static void insert_entry(RenderCache *cache,
+						 const BlockKey *key,
+						 const char *fragment,
+						 uint32_t length)
+{
+	// A fragment that can never fit is rendered every time.
+	if (length > cache->byte_limit)
+		return;
+	
+	while (cache->stats.bytes + length > cache->byte_limit)
+		evict_entry(cache, cache->tail);
+	
+	uint32_t e = cache->free_list;
+	
+	if (e != NO_ENTRY) {
+		cache->free_list = cache->entries[e].next_free;
+	} else {
+		if (cache->len >= cache->cap) {
+			cache->cap = cache->cap ? cache->cap * 2 : 256;
+			cache->entries = c_realloc(cache->entries, cache->cap * sizeof(CacheEntry));
+		}
+		
+		e = (uint32_t)cache->len++;
+	}
+	
+	CacheEntry *entry = cache->entries + e;
+	entry->key = *key;
+	entry->length = length;
+	entry->fragment = c_malloc(length ? length : 1);
+	memcpy(entry->fragment, fragment, length);
+	
+	lru_push_front(cache, e);
+	
+	cache->stats.bytes += length;
+	++cache->stats.count;
+	
+	hash_table_insert(&cache->slots, find_slot(cache, key), (uint32_t)key->hash, e);
+}
+
+// Every block starts on a new line at the top level, so a fragment rendered on its own only lacks the new line before it.
+static void render_cache_put_fragment(MarkupContext *ctx,
+									  const char *fragment,
+									  size_t length)
+{
+	if (!length)
+		return;
+	
+	markup_context_set_needs_new_line(ctx);
+	markup_context_put(ctx, fragment, length);
+}
+
+void render_cache_render(RenderCache *cache,
+						 ASTNode **blocks,
+						 size_t count,
+						 const char *source,
+						 MarkupContext *ctx)
+{
+	for (size_t i = 0; i < count; ++i) {
+		BlockKey key = block_key(blocks[i], source);
+		HashSlot *slot = find_slot(cache, &key);
+		
+		if (slot->entry) {
+			uint32_t e = slot->entry - 1;
+			++cache->stats.hits;
+			
+			lru_unlink(cache, e);
+			lru_push_front(cache, e);
+			
+			render_cache_put_fragment(ctx, cache->entries[e].fragment, cache->entries[e].length);
+			continue;
+		}
+		
+		++cache->stats.misses;
+		
+		markup_context_clear(cache->scratch);
+		cache->render(cache->scratch, blocks[i], source);
+		
+		StringBuffer *fragment = markup_context_get_string(cache->scratch);
+		render_cache_put_fragment(ctx, fragment->buffer, fragment->length);
+		insert_entry(cache, &key, fragment->buffer, (uint32_t)fragment->length);
+	}
+}
+
+RenderCacheStats render_cache_get_stats(RenderCache *cache)
+{
+	return cache->stats;
+}
+
+void render_cache_clear(RenderCache *cache)
+{
+	while (cache->tail != NO_ENTRY)
+		evict_entry(cache, cache->tail);
+	
+	memset(&cache->stats, 0, sizeof(RenderCacheStats));
+}
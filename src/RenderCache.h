@@ -0,0 +1,57 @@
+
+#ifndef RenderCache_h
+#define RenderCache_h
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "nodes.h"
+#include "MarkupContext.h"
+
+/** Renders one top-level block into `ctx`, the way
+ * `render_html_to_markup_context` does.
+ */
+typedef void (*RenderBlockFunc)(MarkupContext *ctx,
+								ASTNode *block,
+								const char *source);
+
+typedef struct
+{
+	uint64_t hits;
+	uint64_t misses;
+	uint64_t evictions;
+	
+	// Fragments currently held, and their total size in bytes.
+	size_t count;
+	size_t bytes;
+} RenderCacheStats;
+
+/** Keeps the rendered output of top-level blocks between renders, so that
+ * re-rendering a document after an edit only renders the blocks that
+ * changed. Fragments are keyed by a hash of each block's type and source,
+ * which is everything a `RenderBlockFunc` can see. The least recently used
+ * fragments are dropped once they take up more than the cache's byte limit.
+ */
+typedef struct RenderCache RenderCache;
+
+RenderCache *render_cache_new(RenderBlockFunc render,
+							  size_t byte_limit);
+
+void render_cache_free(RenderCache *cache);
+
+/** Renders `blocks` in order into `ctx`, reusing cached fragments where it
+ * can. Starting from an empty context, the output is the same as rendering
+ * the whole document at once.
+ */
+void render_cache_render(RenderCache *cache,
+						 ASTNode **blocks,
+						 size_t count,
+						 const char *source,
+						 MarkupContext *ctx);
+
+RenderCacheStats render_cache_get_stats(RenderCache *cache);
+
+/** Drops every fragment and zeroes the statistics. */
+void render_cache_clear(RenderCache *cache);
+
+#endif /* RenderCache_h */
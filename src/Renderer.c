@@ -1,2 +1,90 @@
 
 #include "Renderer.h"
+
+// Table entries may be NULL, so the engine checks before each call.
+#define CALLBACK_ENTER(node, source, info) (callbacks->enter[node->type] && callbacks->enter[node->type](node, source, info))
+#define CALLBACK_EXIT(node, source, info) ((void)(callbacks->exit[node->type] && callbacks->exit[node->type](node, source, info)))
+
+void render_with_callbacks(const RendererCallbacks *callbacks,
+						   ASTNode *root,
+						   const char *source,
+						   void *info)
+{
+	RENDERER_WALK(root, source, info, CALLBACK_ENTER, CALLBACK_EXIT);
+}
+
+// Returns `node` or the first sibling after it that ends after `start`, or NULL once siblings begin at or past `end`.
+static inline ASTNode *first_intersecting(ASTNode *node,
+										  uint32_t start,
+										  uint32_t end)
+{
+	for (; node && node->range.location < end; node = node->next) {
+		if (s_range_max(node->range) > start)
+			return node;
+	}
+	
+	return NULL;
+}
+
+// `RENDERER_WALK`, stepping over the children and siblings that lie outside [start, end).
+static void render_block_in_range(const RendererCallbacks *callbacks,
+								  ASTNode *root,
+								  uint32_t start,
+								  uint32_t end,
+								  const char *source,
+								  void *info)
+{
+	ASTNode *node = root;
+	ASTNode *next;
+	
+	for (;;) {
+		if (!CALLBACK_ENTER(node, source, info) && (next = first_intersecting(node->first_child, start, end))) {
+			node = next;
+			continue;
+		}
+		
+		for (;;) {
+			CALLBACK_EXIT(node, source, info);
+			if (node == root)
+				return;
+			
+			if ((next = first_intersecting(node->next, start, end))) {
+				node = next;
+				break;
+			}
+			
+			node = node->parent;
+		}
+	}
+}
+
+void render_range_with_callbacks(const RendererCallbacks *callbacks,
+								 ASTNode **blocks,
+								 size_t count,
+								 SRange range,
+								 const char *source,
+								 void *info)
+{
+	uint32_t start = range.location;
+	uint32_t end = s_range_max(range);
+	
+	// An empty range stands for the character at its location.
+	if (!range.length)
+		++end;
+	
+	// Blocks are ordered and disjoint, so their ends are ordered too. Find the first that ends after `start`.
+	size_t lo = 0;
+	size_t hi = count;
+	
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+		
+		if (s_range_max(blocks[mid]->range) <= start)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	
+	for (size_t i = lo; i < count && blocks[i]->range.location < end; ++i)
+		render_block_in_range(callbacks, blocks[i], start, end, source, info);
+}
@@ -2,19 +2,124 @@
 #ifndef Renderer_h
 #define Renderer_h
 
+#include <stddef.h>
+
 #include "nodes.h"
-#include "MarkupContext.h"
 
+/** Renders one node as a renderer enters or exits it. `info` is the
+ * renderer's own context. Returning nonzero on entering skips the node's
+ * children, though it's still exited. The return value of an exit is
+ * ignored.
+ */
+typedef int (*RenderFunc)(ASTNode *node,
+						  const char *source,
+						  void *info);
+
+/** A renderer as a table of callbacks indexed by `ASTNodeType`. NULL entries
+ * render nothing.
+ */
 typedef struct {
-	void (*header)(MarkupContext*,ASTNode*);
-	void (*description)(MarkupContext*,ASTNode*);
-	void (*simultaneous_cues)(MarkupContext*,ASTNode*);
-	void (*lyrics)(MarkupContext*,ASTNode*);
-	void (*facsimile)(MarkupContext*,ASTNode*);
-	void (*thematic_break)(MarkupContext*,ASTNode*);
-	void (*end)(MarkupContext*,ASTNode*);
+	RenderFunc enter[S_NODE_TYPE_COUNT];
+	RenderFunc exit[S_NODE_TYPE_COUNT];
 } RendererCallbacks;
 
-void render_header(MarkupContext *ctx, char *keyword, char *identifier, char *title);
+/** Walks `root` and its descendants in document order, calling the entries
+ * of `callbacks` for each node.
+ */
+void render_with_callbacks(const RendererCallbacks *callbacks,
+						   ASTNode *root,
+						   const char *source,
+						   void *info);
+
+/** Like `render_with_callbacks` over `blocks`, the top-level blocks of a
+ * document in order, but only for the nodes whose ranges intersect `range`.
+ * A node that starts inside `range` is entered and exited along with every
+ * container it's in, so the output stays balanced at the edges. The first
+ * block is found by binary search, so the cost depends on how much of the
+ * document `range` covers rather than on where it is. An empty `range`
+ * renders the nodes at its location.
+ */
+void render_range_with_callbacks(const RendererCallbacks *callbacks,
+								 ASTNode **blocks,
+								 size_t count,
+								 SRange range,
+								 const char *source,
+								 void *info);
+
+/** A callback that does nothing, for table entries. */
+static inline int render_nothing(ASTNode *node,
+								 const char *source,
+								 void *info)
+{
+	return 0;
+}
+
+/* Renderers known at compile time can be written once as a list of
+ * `X(type, enter, exit)` entries and turned into either form:
+ *
+ *     #define PLAIN_RENDERER(X) \
+ *         X(S_NODE_DESCRIPTION, render_nothing, plain_exit_line) \
+ *         X(S_NODE_LITERAL, plain_enter_literal, render_nothing)
+ *
+ *     static const RendererCallbacks plain_callbacks = RENDERER_CALLBACKS(PLAIN_RENDERER);
+ *     RENDERER_DEFINE(render_plain, PLAIN_RENDERER)
+ *
+ * `RENDERER_DEFINE` defines `static void render_plain(ASTNode *root, const
+ * char *source, void *info)`, which dispatches with a switch over node types
+ * that calls each entry directly, so the entries can be inlined.
+ */
+#define RENDERER_ENTER_ENTRY(type, enter, exit) [type] = enter,
+#define RENDERER_EXIT_ENTRY(type, enter, exit) [type] = exit,
+
+#define RENDERER_CALLBACKS(TABLE) { { TABLE(RENDERER_ENTER_ENTRY) }, { TABLE(RENDERER_EXIT_ENTRY) } }
+
+#define RENDERER_ENTER_CASE(type, enter, exit) case type: return enter(node, source, info);
+#define RENDERER_EXIT_CASE(type, enter, exit) case type: exit(node, source, info); return;
+
+/* The walk shared by `render_with_callbacks` and `RENDERER_DEFINE`. It
+ * follows sibling and parent links, so it needs no allocation or stack.
+ */
+#define RENDERER_WALK(root, source, info, ENTER, EXIT) \
+	do { \
+		ASTNode *node = (root); \
+		for (;;) { \
+			if (!ENTER(node, source, info) && node->first_child) { \
+				node = node->first_child; \
+				continue; \
+			} \
+			for (;;) { \
+				EXIT(node, source, info); \
+				if (node == (root)) \
+					break; \
+				if (node->next) { \
+					node = node->next; \
+					break; \
+				} \
+				node = node->parent; \
+			} \
+			if (node == (root)) \
+				break; \
+		} \
+	} while (0)
+
+#define RENDERER_DEFINE(name, TABLE) \
+	static inline int name##_enter(ASTNode *node, const char *source, void *info) \
+	{ \
+		switch ((ASTNodeType)node->type) { \
+			TABLE(RENDERER_ENTER_CASE) \
+			default: return 0; \
+		} \
+	} \
+	static inline void name##_exit(ASTNode *node, const char *source, void *info) \
+	{ \
+		switch ((ASTNodeType)node->type) { \
+			TABLE(RENDERER_EXIT_CASE) \
+			default: return; \
+		} \
+	} \
+	static void name(ASTNode *root, const char *source, void *info) \
+	{ \
+		RENDERER_WALK(root, source, info, name##_enter, name##_exit); \
+	}
 
 #endif /* Renderer_h */
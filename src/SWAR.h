@@ -0,0 +1,35 @@
+
+#ifndef SWAR_h
+#define SWAR_h
+
+#include <stdint.h>
+
+// Helpers for scanning eight bytes at a time in a uint64_t, shared by the word counters, the validators, the scanner and the escapers.
+
+#if defined(__GNUC__)
+#define popcount32(x) __builtin_popcount(x)
+#define popcount64(x) __builtin_popcountll(x)
+#else
+static inline int popcount64(uint64_t x)
+{
+	int count = 0;
+	
+	for (; x; x &= x - 1)
+		++count;
+	
+	return count;
+}
+#define popcount32(x) popcount64(x)
+#endif
+
+#define ONES ((uint64_t)0x0101010101010101)
+#define LOWS ((uint64_t)0x7F7F7F7F7F7F7F7F)
+#define HIGHS ((uint64_t)0x8080808080808080)
+
+// Sets bit 7 of exactly the bytes of `w` that are zero.
+static inline uint64_t zero_bytes(uint64_t w)
+{
+	return ~(((w & LOWS) + LOWS) | w | LOWS);
+}
+
+#endif /* SWAR_h */
@@ -1,7 +1,11 @@
 
 #include "Scanner.h"
+
+#include <string.h>
+
 #include "inlines.h"
 #include "mem.h"
+#include "SWAR.h"
 
 Scanner *scanner_new(const char *source,
                      uint32_t length)
@@ -34,7 +38,7 @@ static int scanner_loc_is_escaped(Scanner *s)
 /*	Cue ignores whitespace so we can safely ignore the "\r\n" case (the parser will interpret '\n' as an empty line and discard it). */
 static inline int is_newline(const char c)
 {
-	return c == '\n' || c == 11 || c == 12 || c == '\r';
+	return (unsigned char)(c - '\n') <= '\r' - '\n';
 }
 
 static inline int is_whitespace(const char c)
@@ -42,17 +46,41 @@ static inline int is_whitespace(const char c)
 	return c == ' ' || c == '\t' || is_newline(c);
 }
 
+/* Newlines are bytes 10 through 13, which all look like 0b00001xxx. This flags words holding any byte of that form, so it may report tabs and a few other control characters as well, but never misses a newline. */
+static inline int word_may_contain_newline(uint64_t w)
+{
+	uint64_t v = (w & (ONES * 0xF8)) ^ (ONES * 0x08);
+	
+	return ((v - ONES) & ~v & HIGHS) != 0;
+}
+
 uint32_t scanner_advance_to_next_line(Scanner *s)
 {
 	s->bol = s->eol;
 	s->loc = s->bol;
 	
-	for (uint32_t i = s->eol; i < s->length; ++i) {
-		s->eol++;
-		if (is_newline(s->source[i]))
+	uint32_t i = s->eol;
+	
+	// Skip ahead a word at a time until a newline might be near.
+	while (i + 8 <= s->length) {
+		uint64_t w;
+		memcpy(&w, s->source + i, 8);
+		
+		if (word_may_contain_newline(w))
+			break;
+		
+		i += 8;
+	}
+	
+	for (; i < s->length; ++i) {
+		if (is_newline(s->source[i])) {
+			++i;
 			break;
+		}
 	}
 	
+	s->eol = i;
+	
 	scanner_trim_whitespace(s);
 	
 	return s->bol;
@@ -114,7 +142,8 @@ uint32_t scanner_advance_to_colon(Scanner *s,
 
 void scanner_trim_whitespace(Scanner *s)
 {
-	// trim left
+	// trim left, bounded by the end of the current line
+	s->ewc = s->eol;
 	scanner_advance_to_first_nonspace(s);
 	s->wc = s->loc;
 	
@@ -232,25 +261,25 @@ ASTNode *scan_for_thematic_break(Scanner *s,
 	return ast_node_new(node_allocator, S_NODE_THEMATIC_BREAK, s->bol, s->eol - s->bol);
 }
 
-ASTNode *scan_title(Scanner *s,
-					NodeAllocator *node_allocator)
+static void scan_title_range(Scanner *s,
+							 SRange *title)
 {
-	ASTNode *title = NULL;
+	title->location = s->ewc;
+	title->length = 0;
 	
 	if (!scanner_is_at_eol(s)) {
 		uint32_t tstart = scanner_advance_to_first_nonspace(s);
 		
-		title = ast_node_new(node_allocator, S_NODE_TITLE, tstart, s->ewc - tstart);
+		title->location = tstart;
+		title->length = s->ewc - tstart;
 	}
-	
-	return title;
 }
 
-ASTNode *scan_for_forced_header(Scanner *s,
-								NodeAllocator *node_allocator)
+int scan_forced_header_outline(Scanner *s,
+							   OutlineItem *out)
 {
 	if (s->ewc - s->loc < 1 || s->source[s->loc] != '.')
-		return NULL;
+		return 0;
 	
 	uint32_t kstart = ++(s->loc);
 	uint32_t hstart = scanner_advance_to_hyphen(s);
@@ -260,25 +289,21 @@ ASTNode *scan_for_forced_header(Scanner *s,
 		++s->loc;
 	}
 	
-	ASTNode *head = ast_node_new(node_allocator, S_NODE_HEADER, s->bol, s->eol - s->bol);
+	SRange range = { s->bol, s->eol - s->bol };
+	SRange keyword = { kstart, kend - kstart };
+	SRange identifier = { kend, 0 };
 	
-	ASTNode *key = ast_node_new(node_allocator, S_NODE_KEYWORD, kstart, kend - kstart);
-	ast_node_add_child(head, key);
-	
-	ASTNode *title = scan_title(s, node_allocator);
-	if (title) {
-		ast_node_add_child(head, title);
-	}
+	out->type = HEADER_FORCED;
+	out->range = range;
+	out->keyword = keyword;
+	out->identifier = identifier;
+	scan_title_range(s, &out->title);
 	
-	head->as.header.type = HEADER_FORCED;
-	head->as.header.keyword = key;
-	head->as.header.title = title;
-	
-	return head;
+	return 1;
 }
 
-ASTNode *scan_for_header(Scanner *s,
-						 NodeAllocator *node_allocator)
+int scan_header_outline(Scanner *s,
+						OutlineItem *out)
 {
 	HeaderType type;
 	uint32_t kstart = s->loc;
@@ -297,13 +322,16 @@ ASTNode *scan_for_header(Scanner *s,
 		type = HEADER_FRAME;
 		kend += 5;
 	} else {
-		return NULL;
+		return 0;
 	}
-	uint32_t istart = scanner_advance_to_first_nonspace(s);
 	
-	if (scanner_is_at_eol(s))
-		return NULL;
+	// Keywords must stand alone, so that lines like "Actually..." aren't headers.
+	if (!scanner_is_at_eol(s) && !is_whitespace(s->source[s->loc]) && s->source[s->loc] != '-') {
+		s->loc = kstart;
+		return 0;
+	}
 	
+	uint32_t istart = scanner_advance_to_first_nonspace(s);
 	uint32_t hstart = scanner_advance_to_hyphen(s);
 	uint32_t iend = scanner_backtrack_to_first_nonspace(s);
 	
@@ -312,23 +340,40 @@ ASTNode *scan_for_header(Scanner *s,
 		++s->loc;
 	}
 	
-	ASTNode *head = ast_node_new(node_allocator, S_NODE_HEADER, s->bol, s->eol - s->bol);
+	SRange range = { s->bol, s->eol - s->bol };
+	SRange keyword = { kstart, kend - kstart };
+	SRange identifier = { istart, (istart < iend) ? iend - istart : 0 };
+	
+	out->type = type;
+	out->range = range;
+	out->keyword = keyword;
+	out->identifier = identifier;
+	scan_title_range(s, &out->title);
 	
-	ASTNode *key = ast_node_new(node_allocator, S_NODE_KEYWORD, kstart, kend - kstart);
+	return 1;
+}
+
+static ASTNode *header_from_outline(OutlineItem *item,
+								   NodeAllocator *node_allocator)
+{
+	ASTNode *head = ast_node_new(node_allocator, S_NODE_HEADER, item->range.location, item->range.length);
+	
+	ASTNode *key = ast_node_new(node_allocator, S_NODE_KEYWORD, item->keyword.location, item->keyword.length);
 	ast_node_add_child(head, key);
 	
 	ASTNode *id = NULL;
-	if (istart < iend) {
-		id = ast_node_new(node_allocator, S_NODE_IDENTIFIER, istart, iend - istart);
+	if (item->identifier.length) {
+		id = ast_node_new(node_allocator, S_NODE_IDENTIFIER, item->identifier.location, item->identifier.length);
 		ast_node_add_child(head, id);
 	}
 	
-	ASTNode *title = scan_title(s, node_allocator);
-	if (title) {
+	ASTNode *title = NULL;
+	if (item->title.length) {
+		title = ast_node_new(node_allocator, S_NODE_TITLE, item->title.location, item->title.length);
 		ast_node_add_child(head, title);
 	}
 	
-	head->as.header.type = type;
+	head->as.header.type = item->type;
 	head->as.header.keyword = key;
 	head->as.header.id = id;
 	head->as.header.title = title;
@@ -336,6 +381,28 @@ ASTNode *scan_for_header(Scanner *s,
 	return head;
 }
 
+ASTNode *scan_for_forced_header(Scanner *s,
+								NodeAllocator *node_allocator)
+{
+	OutlineItem item;
+	
+	if (!scan_forced_header_outline(s, &item))
+		return NULL;
+	
+	return header_from_outline(&item, node_allocator);
+}
+
+ASTNode *scan_for_header(Scanner *s,
+						 NodeAllocator *node_allocator)
+{
+	OutlineItem item;
+	
+	if (!scan_header_outline(s, &item))
+		return NULL;
+	
+	return header_from_outline(&item, node_allocator);
+}
+
 ASTNode *scan_for_end(Scanner *s,
 					  NodeAllocator *node_allocator)
 {
@@ -365,6 +432,7 @@ ASTNode *scan_for_facsimile(Scanner *s,
 		return NULL;
 	
 	if (s->source[s->loc] == '>' && !scanner_loc_is_escaped(s)) {
+		++(s->loc);
 		uint32_t bstart = scanner_advance_to_first_nonspace(s);
 		
 		ASTNode *facs = ast_node_new(node_allocator, S_NODE_FACSIMILE, s->bol, s->eol - s->bol);
@@ -474,6 +542,7 @@ int scan_delimiter_token(Scanner *s,
 			case '/': {
 				uint32_t bt = s->loc++;
 				if (!scanner_is_at_eol(s) && s->source[s->loc] == '/') {
+					++s->loc;
 					scanner_advance_to_first_nonspace(s);
 					*out = delimiter_token_init(S_NODE_COMMENT, 1, bt, s->loc - bt);
 					s->loc = s->ewc;
@@ -5,6 +5,7 @@
 #include <stdint.h>
 
 #include "nodes.h"
+#include "Outline.h"
 
 typedef struct DelimiterToken DelimiterToken;
 
@@ -32,6 +33,15 @@ void scanner_trim_whitespace(Scanner *s);
 ASTNode *scan_for_thematic_break(Scanner *s,
 								 NodeAllocator *node_allocator);
 
+/* These match headers like `scan_for_forced_header` and `scan_for_header`,
+ * but only report their ranges rather than building nodes.
+ */
+int scan_forced_header_outline(Scanner *s,
+							   OutlineItem *out);
+
+int scan_header_outline(Scanner *s,
+						OutlineItem *out);
+
 ASTNode *scan_for_forced_header(Scanner *s,
 								NodeAllocator *node_allocator);
 
@@ -0,0 +1,344 @@
+
+#include "Stats.h"
+
+#include <pthread.h>
+#include <string.h>
+
+#include "mem.h"
+#include "WordCounter.h"
+#include "CharacterIndex.h"
+
+#define COMMENT_MASK S_NODE_MASK(S_NODE_COMMENT)
+#define UNSPOKEN_MASK (S_NODE_MASK(S_NODE_PARENTHETICAL) | S_NODE_MASK(S_NODE_COMMENT))
+
+struct StatsTable
+{
+	SectionStats *sections;
+	size_t len;
+	
+	SectionStats totals;
+};
+
+// An open-addressed set of character keys, kept at most half full. Key 0 marks an empty slot, so it's tracked on its own.
+typedef struct
+{
+	uint64_t *slots;
+	size_t cap;
+	size_t len;
+	int has_zero;
+} KeySet;
+
+static void key_set_clear(KeySet *set)
+{
+	// Only the zero key may have been added, in which case nothing has been allocated.
+	if (set->slots)
+		memset(set->slots, 0, set->cap * sizeof(uint64_t));
+	
+	set->len = 0;
+	set->has_zero = 0;
+}
+
+static void key_set_add(KeySet *set,
+						uint64_t key)
+{
+	if (!key) {
+		set->len += !set->has_zero;
+		set->has_zero = 1;
+		return;
+	}
+	
+	if ((set->len + 1) * 2 > set->cap) {
+		uint64_t *old = set->slots;
+		size_t old_cap = set->cap;
+		
+		set->cap = set->cap ? set->cap * 2 : 64;
+		set->slots = c_calloc(set->cap, sizeof(uint64_t));
+		set->len = set->has_zero;
+		
+		for (size_t i = 0; i < old_cap; ++i) {
+			if (old[i])
+				key_set_add(set, old[i]);
+		}
+		
+		free(old);
+	}
+	
+	size_t mask = set->cap - 1;
+	for (size_t i = (key ^ (key >> 32)) & mask;; i = (i + 1) & mask) {
+		if (set->slots[i] == key)
+			return;
+		
+		if (!set->slots[i]) {
+			set->slots[i] = key;
+			++set->len;
+			return;
+		}
+	}
+}
+
+static void key_set_free(KeySet *set)
+{
+	free(set->slots);
+}
+
+// A run of consecutive sections computed by one thread. Sections only ever write their own entries, so workers share nothing but read-only nodes.
+typedef struct
+{
+	StatsTable *table;
+	ASTNode **blocks;
+	const char *source;
+	
+	// The index of the first block of every section, plus the block count.
+	size_t *first_blocks;
+	size_t first;
+	size_t last;
+	
+	// The speaking characters of the current section, and of every section so far.
+	KeySet section_keys;
+	KeySet keys;
+} StatsWorker;
+
+// Printed lines needed for `length` bytes at `width` bytes a line.
+static inline uint32_t lines_for_width(uint32_t length,
+									   uint32_t width)
+{
+	return length ? (length + width - 1) / width : 1;
+}
+
+// Returns the printed lines the cue takes, counting its name and the blank line after it.
+static uint32_t stats_worker_add_cue(StatsWorker *worker,
+									 SectionStats *stats,
+									 ASTNode *cue)
+{
+	SRange name = cue->as.cue.name->range;
+	ASTNode *dir = cue->as.cue.direction;
+	uint32_t lines = 2;
+	
+	++stats->cue_count;
+	uint64_t key = character_name_key(worker->source + name.location, name.length);
+	key_set_add(&worker->section_keys, key);
+	key_set_add(&worker->keys, key);
+	
+	if (dir->type == S_NODE_LYRIC_DIRECTION) {
+		for (ASTNode *line = dir->first_child; line; line = line->next) {
+			ASTNode *stream = line->first_child;
+			
+			++stats->lyric_lines;
+			stats->dialogue_words += word_counter_count_stream(stream, worker->source, UNSPOKEN_MASK);
+			lines += lines_for_width(stream->range.length, STATS_DIALOGUE_WIDTH);
+		}
+	} else if (dir->first_child) {
+		ASTNode *stream = dir->first_child;
+		
+		stats->dialogue_words += word_counter_count_stream(stream, worker->source, UNSPOKEN_MASK);
+		lines += lines_for_width(stream->range.length, STATS_DIALOGUE_WIDTH);
+	}
+	
+	return lines;
+}
+
+static void stats_worker_compute_section(StatsWorker *worker,
+										 size_t section)
+{
+	SectionStats *stats = worker->table->sections + section;
+	const char *source = worker->source;
+	uint32_t lines = 0;
+	
+	key_set_clear(&worker->section_keys);
+	
+	for (size_t b = worker->first_blocks[section]; b < worker->first_blocks[section + 1]; ++b) {
+		ASTNode *block = worker->blocks[b];
+		
+		switch (block->type) {
+			case S_NODE_DESCRIPTION: {
+				ASTNode *stream = block->first_child;
+				
+				stats->description_words += word_counter_count_stream(stream, source, COMMENT_MASK);
+				lines += lines_for_width(stream->range.length, STATS_DESCRIPTION_WIDTH) + 1;
+				break;
+			}
+			case S_NODE_FACSIMILE:
+				for (ASTNode *line = block->first_child; line; line = line->next) {
+					ASTNode *stream = line->first_child;
+					
+					stats->description_words += word_counter_count_stream(stream, source, COMMENT_MASK);
+					lines += lines_for_width(stream->range.length, STATS_DESCRIPTION_WIDTH);
+				}
+				
+				++lines;
+				break;
+			case S_NODE_SIMULTANEOUS_CUES:
+				for (ASTNode *cue = block->first_child; cue; cue = cue->next)
+					lines += stats_worker_add_cue(worker, stats, cue);
+				break;
+			default:
+				// Headers, thematic breaks and endings take a line and a blank one.
+				lines += 2;
+				break;
+		}
+	}
+	
+	stats->speaking_characters = (uint32_t)worker->section_keys.len;
+	
+	// Round to the nearest eighth, but never report an empty-looking section.
+	stats->page_eighths = (lines * 8 + STATS_LINES_PER_PAGE / 2) / STATS_LINES_PER_PAGE;
+	if (!stats->page_eighths)
+		stats->page_eighths = 1;
+}
+
+static void *stats_worker_run(void *data)
+{
+	StatsWorker *worker = data;
+	
+	for (size_t s = worker->first; s < worker->last; ++s)
+		stats_worker_compute_section(worker, s);
+	
+	return NULL;
+}
+
+static void stats_table_sum(StatsTable *table,
+							StatsWorker *workers,
+							size_t worker_count,
+							uint32_t length)
+{
+	SectionStats *totals = &table->totals;
+	
+	memset(totals, 0, sizeof(SectionStats));
+	totals->range.length = length;
+	
+	for (size_t s = 0; s < table->len; ++s) {
+		SectionStats *stats = table->sections + s;
+		
+		totals->description_words += stats->description_words;
+		totals->dialogue_words += stats->dialogue_words;
+		totals->cue_count += stats->cue_count;
+		totals->lyric_lines += stats->lyric_lines;
+		totals->page_eighths += stats->page_eighths;
+	}
+	
+	// Merge every other worker's characters into the first's.
+	KeySet *keys = &workers[0].keys;
+	
+	for (size_t t = 1; t < worker_count; ++t) {
+		KeySet *other = &workers[t].keys;
+		
+		if (other->has_zero)
+			key_set_add(keys, 0);
+		
+		for (size_t i = 0; i < other->cap; ++i) {
+			if (other->slots[i])
+				key_set_add(keys, other->slots[i]);
+		}
+	}
+	
+	totals->speaking_characters = (uint32_t)keys->len;
+}
+
+StatsTable *stats_table_compute(ASTNode **blocks,
+								size_t block_count,
+								const char *source,
+								uint32_t length,
+								int nthreads)
+{
+	StatsTable *table = c_calloc(1, sizeof(StatsTable));
+	
+	// Every header starts a section, as does the first block if it isn't one.
+	size_t *first_blocks = c_malloc((block_count + 1) * sizeof(size_t));
+	size_t len = 0;
+	
+	for (size_t b = 0; b < block_count; ++b) {
+		if (b == 0 || blocks[b]->type == S_NODE_HEADER)
+			first_blocks[len++] = b;
+	}
+	
+	first_blocks[len] = block_count;
+	
+	table->sections = c_calloc(len + 1, sizeof(SectionStats));
+	table->len = len;
+	
+	for (size_t s = 0; s < len; ++s) {
+		SectionStats *stats = table->sections + s;
+		ASTNode *first = blocks[first_blocks[s]];
+		uint32_t end = (s + 1 < len) ? blocks[first_blocks[s + 1]]->range.location : length;
+		
+		stats->header = (first->type == S_NODE_HEADER) ? first : NULL;
+		stats->range.location = first->range.location;
+		stats->range.length = end - first->range.location;
+	}
+	
+	size_t worker_count = nthreads > 1 ? (size_t)nthreads : 1;
+	if (worker_count > len)
+		worker_count = len ? len : 1;
+	
+	StatsWorker *workers = c_calloc(worker_count, sizeof(StatsWorker));
+	
+	// Share the sections out by size, so that a long act doesn't keep one thread busy while the others idle.
+	size_t s = 0;
+	for (size_t t = 0; t < worker_count; ++t) {
+		StatsWorker *worker = workers + t;
+		uint64_t target = (uint64_t)length * (t + 1) / worker_count;
+		
+		worker->table = table;
+		worker->blocks = blocks;
+		worker->source = source;
+		worker->first_blocks = first_blocks;
+		worker->first = s;
+		
+		while (s < len && (t + 1 == worker_count || table->sections[s].range.location < target))
+			++s;
+		
+		worker->last = s;
+	}
+	
+	pthread_t *threads = c_malloc(worker_count * sizeof(pthread_t));
+	int *started = c_calloc(worker_count, sizeof(int));
+	
+	// The calling thread takes the first share. A thread that fails to start has its share run here instead.
+	for (size_t t = 1; t < worker_count; ++t)
+		started[t] = pthread_create(threads + t, NULL, stats_worker_run, workers + t) == 0;
+	
+	stats_worker_run(workers);
+	
+	for (size_t t = 1; t < worker_count; ++t) {
+		if (started[t])
+			pthread_join(threads[t], NULL);
+		else
+			stats_worker_run(workers + t);
+	}
+	
+	stats_table_sum(table, workers, worker_count, length);
+	
+	for (size_t t = 0; t < worker_count; ++t) {
+		key_set_free(&workers[t].section_keys);
+		key_set_free(&workers[t].keys);
+	}
+	
+	free(started);
+	free(threads);
+	free(workers);
+	free(first_blocks);
+	
+	return table;
+}
+
+void stats_table_free(StatsTable *table)
+{
+	free(table->sections);
+	
+	free(table);
+}
+
+size_t stats_table_count(StatsTable *table)
+{
+	return table->len;
+}
+
+SectionStats *stats_table_get_sections(StatsTable *table)
+{
+	return table->sections;
+}
+
+SectionStats *stats_table_get_totals(StatsTable *table)
+{
+	return &table->totals;
+}
@@ -0,0 +1,61 @@
+
+#ifndef Stats_h
+#define Stats_h
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "nodes.h"
+
+/** Lines of a printed page, and how many bytes of description and dialogue
+ * fit on one line, for estimating page length.
+ */
+#define STATS_LINES_PER_PAGE 55
+#define STATS_DESCRIPTION_WIDTH 61
+#define STATS_DIALOGUE_WIDTH 35
+
+/** Metrics for one section of a document: a header and everything up to the
+ * next header of any kind. Description words include facsimiles, and
+ * dialogue words leave out parentheticals and comments. Length is estimated
+ * in eighths of a page, the way breakdowns are usually measured.
+ */
+typedef struct
+{
+	// NULL for anything before the first header.
+	ASTNode *header;
+	SRange range;
+	
+	uint32_t description_words;
+	uint32_t dialogue_words;
+	uint32_t cue_count;
+	uint32_t speaking_characters;
+	uint32_t lyric_lines;
+	uint32_t page_eighths;
+} SectionStats;
+
+/** The statistics of every section of a document, in document order. */
+typedef struct StatsTable StatsTable;
+
+/** Computes the statistics of the sections made of `blocks`, the top-level
+ * blocks of a document of `length` bytes. Sections are shared out between
+ * `nthreads` threads by size, and run on the calling thread if `nthreads`
+ * is 1 or less.
+ */
+StatsTable *stats_table_compute(ASTNode **blocks,
+								size_t block_count,
+								const char *source,
+								uint32_t length,
+								int nthreads);
+
+void stats_table_free(StatsTable *table);
+
+size_t stats_table_count(StatsTable *table);
+
+SectionStats *stats_table_get_sections(StatsTable *table);
+
+/** Returns the sum of every section. Speaking characters are counted once
+ * across the whole document.
+ */
+SectionStats *stats_table_get_totals(StatsTable *table);
+
+#endif /* Stats_h */
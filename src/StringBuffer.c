@@ -9,9 +9,9 @@ StringBuffer *string_buffer_new()
 {
 	StringBuffer *str = c_malloc(sizeof(StringBuffer));
 	
-	uint32_t cap = 32;
+	size_t cap = 32;
 	
-	str->buffer = malloc(sizeof(char) * cap);
+	str->buffer = c_malloc(sizeof(char) * cap);
 	str->length = 0;
 	str->capacity = cap;
 	
@@ -26,23 +26,38 @@ void string_buffer_free(StringBuffer *string)
 }
 
 void string_buffer_resize(StringBuffer *string,
-					   uint32_t new_cap)
+						  size_t new_cap)
 {
 	string->buffer = c_realloc(string->buffer, new_cap);
 	
 	string->capacity = new_cap;
 }
 
+int string_buffer_reserve(StringBuffer *string,
+						  size_t a_len)
+{
+	size_t needed = string->length + a_len;
+	if (needed <= string->capacity)
+		return 0;
+	
+	// Doubling keeps appends amortized O(1), and a large append gets exactly what it needs.
+	size_t new_cap = string->capacity * 2;
+	if (new_cap < needed)
+		new_cap = needed;
+	
+	char *old = string->buffer;
+	string_buffer_resize(string, new_cap);
+	
+	return string->buffer != old;
+}
+
 void string_buffer_put(StringBuffer *string,
 					   const char *a_string,
-					   uint32_t a_len)
+					   size_t a_len)
 {
-	while (string->length + a_len >= string->capacity)
-		string_buffer_resize(string, string->capacity * 2);
-	
-	void *base_ptr = string->buffer + string->length;
+	string_buffer_reserve(string, a_len);
 	
-	memmove(base_ptr, a_string, a_len);
+	memcpy(string->buffer + string->length, a_string, a_len);
 	
 	string->length += a_len;
 }
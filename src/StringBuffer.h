@@ -3,19 +3,26 @@
 #define string_h
 
 #include <stdint.h>
+#include <stddef.h>
 
 typedef struct {
 	char *buffer;
-	uint32_t length;
-	uint32_t capacity;
+	size_t length;
+	size_t capacity;
 } StringBuffer;
 
 StringBuffer *string_buffer_new(void);
 
 void string_buffer_free(StringBuffer *string);
 
+/** Makes room for at least `a_len` more bytes, growing the buffer in one
+ * step. Returns 1 if the buffer had to move.
+ */
+int string_buffer_reserve(StringBuffer *string,
+						  size_t a_len);
+
 void string_buffer_put(StringBuffer *string,
 					   const char *a_string,
-					   uint32_t a_len);
+					   size_t a_len);
 
 #endif /* string_h */
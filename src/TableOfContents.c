@@ -0,0 +1,234 @@
+
+#include "TableOfContents.h"
+
+#include <string.h>
+
+#include "mem.h"
+
+// Deep enough for Act > Scene > Page > Frame.
+#define TOC_MAX_DEPTH 4
+
+struct TableOfContents
+{
+	TOCEntry *entries;
+	size_t len;
+	size_t cap;
+	
+	// Indices of the sections that are still open, outermost first, along with the last child of each so that siblings can be linked as they arrive.
+	uint32_t open[TOC_MAX_DEPTH];
+	uint32_t last_child[TOC_MAX_DEPTH + 1];
+	size_t open_len;
+};
+
+TableOfContents *table_of_contents_new()
+{
+	TableOfContents *toc = c_calloc(1, sizeof(TableOfContents));
+	
+	toc->last_child[0] = TOC_NONE;
+	
+	return toc;
+}
+
+void table_of_contents_free(TableOfContents *toc)
+{
+	free(toc->entries);
+	
+	free(toc);
+}
+
+// Forced headers open a section at the same level as an act.
+static uint32_t header_rank(ASTNode *header)
+{
+	HeaderType type = header->as.header.type;
+	
+	return type == HEADER_FORCED ? HEADER_ACT : type;
+}
+
+static void table_of_contents_close(TableOfContents *toc,
+									uint32_t location)
+{
+	TOCEntry *entry = toc->entries + toc->open[--toc->open_len];
+	
+	entry->body.length = location - entry->body.location;
+}
+
+static void toc_entry_set_numbers(TOCEntry *entry,
+								  const uint32_t *numbers)
+{
+	HeaderType type = entry->node->as.header.type;
+	
+	memcpy(entry->numbers, numbers, sizeof(entry->numbers));
+	entry->number = (type == HEADER_FORCED) ? 0 : numbers[type];
+}
+
+// Places entry `idx` in the outline below the sections that are still open, and opens its own section.
+static void table_of_contents_link(TableOfContents *toc,
+								   uint32_t idx)
+{
+	TOCEntry *entry = toc->entries + idx;
+	uint32_t rank = header_rank(entry->node);
+	
+	// Close every open section that this header ends.
+	while (toc->open_len && header_rank(toc->entries[toc->open[toc->open_len - 1]].node) >= rank)
+		table_of_contents_close(toc, entry->range.location);
+	
+	entry->body.location = s_range_max(entry->range);
+	entry->body.length = 0;
+	entry->depth = (uint32_t)toc->open_len;
+	entry->parent = toc->open_len ? toc->open[toc->open_len - 1] : TOC_NONE;
+	entry->first_child = TOC_NONE;
+	entry->next_sibling = TOC_NONE;
+	
+	// Link into the parent's list of children.
+	uint32_t prev = toc->last_child[toc->open_len];
+	if (prev != TOC_NONE)
+		toc->entries[prev].next_sibling = idx;
+	else if (entry->parent != TOC_NONE)
+		toc->entries[entry->parent].first_child = idx;
+	
+	toc->last_child[toc->open_len] = idx;
+	toc->open[toc->open_len++] = idx;
+	toc->last_child[toc->open_len] = TOC_NONE;
+}
+
+static void table_of_contents_reserve(TableOfContents *toc)
+{
+	if (toc->len >= toc->cap) {
+		toc->cap = toc->cap ? toc->cap * 2 : 16;
+		toc->entries = c_realloc(toc->entries, toc->cap * sizeof(TOCEntry));
+	}
+}
+
+void table_of_contents_add_header(TableOfContents *toc,
+								  ASTNode *header,
+								  const uint32_t *numbers)
+{
+	table_of_contents_reserve(toc);
+	
+	uint32_t idx = (uint32_t)toc->len++;
+	TOCEntry *entry = toc->entries + idx;
+	
+	entry->node = header;
+	entry->range = header->range;
+	toc_entry_set_numbers(entry, numbers);
+	
+	table_of_contents_link(toc, idx);
+}
+
+void table_of_contents_finalize(TableOfContents *toc,
+								uint32_t length)
+{
+	while (toc->open_len)
+		table_of_contents_close(toc, length);
+}
+
+size_t table_of_contents_count(TableOfContents *toc)
+{
+	return toc->len;
+}
+
+TOCEntry *table_of_contents_get_entries(TableOfContents *toc)
+{
+	return toc->entries;
+}
+
+// Returns the number of headers that start at or before `offset`.
+static size_t table_of_contents_count_through(TableOfContents *toc,
+											  uint32_t offset)
+{
+	size_t lo = 0;
+	size_t hi = toc->len;
+	
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+		
+		if (toc->entries[mid].range.location <= offset)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	
+	return lo;
+}
+
+TOCEntry *table_of_contents_entry_at_offset(TableOfContents *toc,
+											uint32_t offset)
+{
+	// Find the last header that starts at or before offset. Sections nest, so its section is the innermost one that contains offset.
+	size_t n = table_of_contents_count_through(toc, offset);
+	
+	return n ? toc->entries + n - 1 : NULL;
+}
+
+TOCEntry *table_of_contents_entry_for_header(TableOfContents *toc,
+											 ASTNode *header)
+{
+	TOCEntry *entry = table_of_contents_entry_at_offset(toc, header->range.location);
+	
+	return (entry && entry->node == header) ? entry : NULL;
+}
+
+void table_of_contents_set_numbers(TableOfContents *toc,
+								   size_t index,
+								   const uint32_t *numbers)
+{
+	toc_entry_set_numbers(toc->entries + index, numbers);
+}
+
+size_t table_of_contents_insert_header(TableOfContents *toc,
+									   ASTNode *header,
+									   const uint32_t *numbers,
+									   uint32_t length)
+{
+	table_of_contents_reserve(toc);
+	
+	uint32_t p = (uint32_t)table_of_contents_count_through(toc, header->range.location);
+	
+	memmove(toc->entries + p + 1, toc->entries + p, (toc->len - p) * sizeof(TOCEntry));
+	++toc->len;
+	
+	// Every link to an entry at or after p moves along with it.
+	for (size_t i = 0; i < toc->len; ++i) {
+		TOCEntry *entry = toc->entries + i;
+		
+		if (entry->parent != TOC_NONE && entry->parent >= p)
+			++entry->parent;
+		if (entry->first_child != TOC_NONE && entry->first_child >= p)
+			++entry->first_child;
+		if (entry->next_sibling != TOC_NONE && entry->next_sibling >= p)
+			++entry->next_sibling;
+	}
+	
+	TOCEntry *entry = toc->entries + p;
+	entry->node = header;
+	entry->range = header->range;
+	toc_entry_set_numbers(entry, numbers);
+	
+	// Sections never reach past an act, so only the entries from the act before the new header up to the act after it need linking again.
+	uint32_t start = p;
+	while (start && header_rank(toc->entries[start - 1].node) != HEADER_ACT)
+		--start;
+	
+	if (start)
+		--start;
+	
+	uint32_t end = p + 1;
+	while (end < toc->len && header_rank(toc->entries[end].node) != HEADER_ACT)
+		++end;
+	
+	toc->open_len = 0;
+	toc->last_child[0] = TOC_NONE;
+	
+	for (uint32_t i = start; i < end; ++i)
+		table_of_contents_link(toc, i);
+	
+	// The last top-level section of the range still leads on to the act after it.
+	uint32_t last = toc->open[0];
+	
+	table_of_contents_finalize(toc, end < toc->len ? toc->entries[end].range.location : length);
+	
+	if (end < toc->len)
+		toc->entries[last].next_sibling = end;
+	
+	return p;
+}
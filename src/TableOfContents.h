@@ -0,0 +1,83 @@
+
+#ifndef TableOfContents_h
+#define TableOfContents_h
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "nodes.h"
+
+#define TOC_NONE UINT32_MAX
+
+/** One header in the outline. `range` is the header line itself, and `body`
+ * runs from the end of the header to the next header of the same or higher
+ * rank, or to the end of the document. `numbers` holds the header's resolved
+ * act, scene, page and frame numbers, indexed by `HeaderType`, and `number`
+ * is the one at its own level (0 for forced headers). Entries refer to each
+ * other by index.
+ */
+typedef struct
+{
+	ASTNode *node;
+	SRange range;
+	SRange body;
+	uint32_t numbers[HEADER_FORCED];
+	uint32_t number;
+	uint32_t depth;
+	uint32_t parent;
+	uint32_t first_child;
+	uint32_t next_sibling;
+} TOCEntry;
+
+/** A nested outline of a document's headers (Act > Scene > Page > Frame),
+ * kept in document order. Forced headers sit at the same level as acts.
+ */
+typedef struct TableOfContents TableOfContents;
+
+TableOfContents *table_of_contents_new(void);
+
+void table_of_contents_free(TableOfContents *toc);
+
+/** Appends `header` with its resolved `numbers` to the outline. Headers must
+ * be added in document order, and the range of the latest header's body stays
+ * open until the next header or `table_of_contents_finalize`.
+ */
+void table_of_contents_add_header(TableOfContents *toc,
+								  ASTNode *header,
+								  const uint32_t *numbers);
+
+/** Closes the body ranges of every open section at `length`. */
+void table_of_contents_finalize(TableOfContents *toc,
+								uint32_t length);
+
+size_t table_of_contents_count(TableOfContents *toc);
+
+TOCEntry *table_of_contents_get_entries(TableOfContents *toc);
+
+/** Returns the innermost section containing `offset`, or NULL if `offset`
+ * precedes the first header. Runs in O(log n).
+ */
+TOCEntry *table_of_contents_entry_at_offset(TableOfContents *toc,
+											uint32_t offset);
+
+/** Returns the entry of `header`, or NULL if it isn't in the outline. Runs in
+ * O(log n).
+ */
+TOCEntry *table_of_contents_entry_for_header(TableOfContents *toc,
+											 ASTNode *header);
+
+/** Replaces the numbers of the entry at `index`. */
+void table_of_contents_set_numbers(TableOfContents *toc,
+								   size_t index,
+								   const uint32_t *numbers);
+
+/** Inserts `header` into a finalized outline of a document `length` bytes
+ * long and returns its index. Only the sections of the acts around `header`
+ * are linked again, though every later entry moves up by one.
+ */
+size_t table_of_contents_insert_header(TableOfContents *toc,
+									   ASTNode *header,
+									   const uint32_t *numbers,
+									   uint32_t length);
+
+#endif /* TableOfContents_h */
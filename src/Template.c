@@ -0,0 +1,758 @@
+
+#include "Template.h"
+
+#include <string.h>
+
+#include "mem.h"
+#include "Escape.h"
+#include "Format.h"
+#include "Renderer.h"
+
+#define TEMPLATE_MAGIC 0x54455543 // "CUET"
+#define TEMPLATE_VERSION 1
+
+// The serialized header: magic, version, node type count, escape mode, skip mask, code bytes, string bytes.
+#define HEADER_WORDS 7
+
+// Offset 0 holds an OP_END, so it doubles as "no program".
+#define NO_PROGRAM 0
+
+typedef enum
+{
+	OP_END,
+	
+	// Followed by the offset and length of a run of `strings`, 4 bytes each.
+	OP_LITERAL,
+	
+	OP_TEXT,
+	OP_RAW,
+	OP_LOCATION,
+	OP_LENGTH,
+	
+	// The numbers of the node's header, in `HeaderType` order.
+	OP_ACT,
+	OP_SCENE,
+	OP_PAGE,
+	OP_FRAME,
+	OP_NUMBER,
+	OP_LEVEL,
+	
+	OP_KEYWORD,
+	OP_ID,
+	OP_TITLE,
+	OP_NAME,
+	
+	OP_COUNT
+} TemplateOp;
+
+typedef enum
+{
+	ESCAPE_HTML,
+	ESCAPE_LATEX,
+	ESCAPE_JSON,
+	ESCAPE_NONE,
+	
+	ESCAPE_COUNT
+} EscapeMode;
+
+struct CueTemplate
+{
+	uint32_t enter[S_NODE_TYPE_COUNT];
+	uint32_t exit[S_NODE_TYPE_COUNT];
+	uint32_t skip_mask;
+	uint32_t escape;
+	
+	uint8_t *code;
+	size_t code_len;
+	size_t code_cap;
+	
+	char *strings;
+	size_t strings_len;
+	size_t strings_cap;
+};
+
+static const char *type_names[S_NODE_TYPE_COUNT] = {
+	"document",
+	"header",
+	"description",
+	"simultaneous_cues",
+	"facsimile",
+	"thematic_break",
+	"end",
+	"cue",
+	"lyric_direction",
+	"plain_direction",
+	"line",
+	"stream",
+	"keyword",
+	"identifier",
+	"title",
+	"name",
+	"url",
+	"literal",
+	"emphasis",
+	"strong",
+	"reference",
+	"parenthetical",
+	"comment"
+};
+
+static const char *escape_names[ESCAPE_COUNT] = { "html", "latex", "json", "none" };
+
+// Placeholders with an op of their own. `newline` and `tab` become part of the literal around them.
+static const struct
+{
+	const char *name;
+	uint8_t op;
+} placeholders[] = {
+	{ "text", OP_TEXT },
+	{ "raw", OP_RAW },
+	{ "location", OP_LOCATION },
+	{ "length", OP_LENGTH },
+	{ "act", OP_ACT },
+	{ "scene", OP_SCENE },
+	{ "page", OP_PAGE },
+	{ "frame", OP_FRAME },
+	{ "number", OP_NUMBER },
+	{ "level", OP_LEVEL },
+	{ "keyword", OP_KEYWORD },
+	{ "id", OP_ID },
+	{ "title", OP_TITLE },
+	{ "name", OP_NAME }
+};
+
+static const char *const latex_escapes[256] = {
+	['\\'] = "\\textbackslash{}",
+	['{'] = "\\{",
+	['}'] = "\\}",
+	['$'] = "\\$",
+	['&'] = "\\&",
+	['#'] = "\\#",
+	['%'] = "\\%",
+	['_'] = "\\_",
+	['~'] = "\\textasciitilde{}",
+	['^'] = "\\textasciicircum{}"
+};
+
+static inline void put_u32(uint8_t *p,
+						   uint32_t v)
+{
+	p[0] = (uint8_t)v;
+	p[1] = (uint8_t)(v >> 8);
+	p[2] = (uint8_t)(v >> 16);
+	p[3] = (uint8_t)(v >> 24);
+}
+
+static inline uint32_t get_u32(const uint8_t *p)
+{
+	return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static CueTemplate *cue_template_new(void)
+{
+	CueTemplate *template = c_calloc(1, sizeof(CueTemplate));
+	
+	template->code_cap = 256;
+	template->code = c_malloc(template->code_cap);
+	template->code[template->code_len++] = OP_END;
+	
+	template->strings_cap = 256;
+	template->strings = c_malloc(template->strings_cap);
+	
+	return template;
+}
+
+void cue_template_free(CueTemplate *template)
+{
+	free(template->code);
+	free(template->strings);
+	
+	free(template);
+}
+
+static void emit(CueTemplate *template,
+				 const uint8_t *bytes,
+				 size_t length)
+{
+	if (template->code_len + length > template->code_cap) {
+		while (template->code_len + length > template->code_cap)
+			template->code_cap *= 2;
+		template->code = c_realloc(template->code, template->code_cap);
+	}
+	
+	memcpy(template->code + template->code_len, bytes, length);
+	template->code_len += length;
+}
+
+static void emit_op(CueTemplate *template,
+					uint8_t op)
+{
+	emit(template, &op, 1);
+}
+
+static void append_string(CueTemplate *template,
+						  const char *bytes,
+						  size_t length)
+{
+	if (template->strings_len + length > template->strings_cap) {
+		while (template->strings_len + length > template->strings_cap)
+			template->strings_cap *= 2;
+		template->strings = c_realloc(template->strings, template->strings_cap);
+	}
+	
+	memcpy(template->strings + template->strings_len, bytes, length);
+	template->strings_len += length;
+}
+
+// Emits the literal that began at `start` in `strings`, if it isn't empty.
+static void emit_literal(CueTemplate *template,
+						 size_t start)
+{
+	if (template->strings_len == start)
+		return;
+	
+	uint8_t op[9] = { OP_LITERAL };
+	put_u32(op + 1, (uint32_t)start);
+	put_u32(op + 5, (uint32_t)(template->strings_len - start));
+	emit(template, op, sizeof(op));
+}
+
+static int is_name_char(char c)
+{
+	return (c >= 'a' && c <= 'z') || c == '_';
+}
+
+static int match_name(const char *s,
+					  size_t length,
+					  const char *name)
+{
+	return strlen(name) == length && memcmp(s, name, length) == 0;
+}
+
+static int find_type(const char *s,
+					 size_t length)
+{
+	for (int t = 0; t < S_NODE_TYPE_COUNT; ++t) {
+		if (match_name(s, length, type_names[t]))
+			return t;
+	}
+	
+	return -1;
+}
+
+// Compiles the template in [s, end) into a program and returns its offset, NO_PROGRAM if it writes nothing, or -1 on an error at `*error`.
+static int64_t compile_program(CueTemplate *template,
+							   const char *s,
+							   const char *end,
+							   const char **error)
+{
+	size_t program = template->code_len;
+	size_t literal = template->strings_len;
+	
+	while (s < end) {
+		if (s + 1 < end && s[0] == '{' && s[1] == '{') {
+			const char *name = s + 2;
+			const char *p = name;
+			while (p < end && is_name_char(*p))
+				++p;
+			
+			if (p > name && p + 1 < end && p[0] == '}' && p[1] == '}') {
+				size_t length = p - name;
+				
+				if (match_name(name, length, "newline")) {
+					append_string(template, "\n", 1);
+				} else if (match_name(name, length, "tab")) {
+					append_string(template, "\t", 1);
+				} else {
+					size_t n = sizeof(placeholders) / sizeof(*placeholders);
+					size_t i = 0;
+					while (i < n && !match_name(name, length, placeholders[i].name))
+						++i;
+					
+					if (i == n) {
+						*error = s;
+						return -1;
+					}
+					
+					emit_literal(template, literal);
+					emit_op(template, placeholders[i].op);
+					literal = template->strings_len;
+				}
+				
+				s = p + 2;
+				continue;
+			}
+		}
+		
+		// Anything else, including a brace that doesn't start a placeholder, is written as it is.
+		append_string(template, s, 1);
+		++s;
+	}
+	
+	emit_literal(template, literal);
+	
+	if (template->code_len == program)
+		return NO_PROGRAM;
+	
+	emit_op(template, OP_END);
+	
+	return program;
+}
+
+// Compiles one line, without its line break. Returns 0 and sets `*error` on failure.
+static int compile_line(CueTemplate *template,
+						const char *s,
+						const char *end,
+						const char **error)
+{
+	while (s < end && (*s == ' ' || *s == '\t'))
+		++s;
+	
+	if (s == end || *s == '#')
+		return 1;
+	
+	const char *word = s;
+	while (s < end && is_name_char(*s))
+		++s;
+	
+	size_t word_len = s - word;
+	
+	if (s < end && *s == ' ') {
+		const char *arg = s + 1;
+		const char *arg_end = end;
+		while (arg_end > arg && (arg_end[-1] == ' ' || arg_end[-1] == '\t'))
+			--arg_end;
+		
+		if (match_name(word, word_len, "escape")) {
+			for (uint32_t m = 0; m < ESCAPE_COUNT; ++m) {
+				if (match_name(arg, arg_end - arg, escape_names[m])) {
+					template->escape = m;
+					return 1;
+				}
+			}
+			
+			*error = arg;
+			return 0;
+		}
+		
+		if (match_name(word, word_len, "skip")) {
+			int type = find_type(arg, arg_end - arg);
+			if (type < 0) {
+				*error = arg;
+				return 0;
+			}
+			
+			template->skip_mask |= S_NODE_MASK(type);
+			return 1;
+		}
+	}
+	
+	int type = find_type(word, word_len);
+	if (type < 0 || s == end || *s != '.') {
+		*error = word;
+		return 0;
+	}
+	
+	const char *event = ++s;
+	while (s < end && is_name_char(*s))
+		++s;
+	
+	uint32_t *programs;
+	if (match_name(event, s - event, "enter")) {
+		programs = template->enter;
+	} else if (match_name(event, s - event, "exit")) {
+		programs = template->exit;
+	} else {
+		*error = event;
+		return 0;
+	}
+	
+	while (s < end && (*s == ' ' || *s == '\t'))
+		++s;
+	
+	if (s == end || *s != '=') {
+		*error = s;
+		return 0;
+	}
+	
+	// One space after the `=` is part of the syntax, and anything after that is part of the template.
+	++s;
+	if (s < end && *s == ' ')
+		++s;
+	
+	int64_t program = compile_program(template, s, end, error);
+	if (program < 0)
+		return 0;
+	
+	// A later line for the same event replaces an earlier one.
+	programs[type] = (uint32_t)program;
+	
+	return 1;
+}
+
+CueTemplate *cue_template_compile(const char *source,
+								  size_t length,
+								  size_t *error_offset)
+{
+	CueTemplate *template = cue_template_new();
+	const char *end = source + length;
+	const char *line = source;
+	
+	while (line < end) {
+		const char *line_end = memchr(line, '\n', end - line);
+		if (!line_end)
+			line_end = end;
+		
+		const char *content_end = line_end;
+		if (content_end > line && content_end[-1] == '\r')
+			--content_end;
+		
+		const char *error = NULL;
+		
+		if (!compile_line(template, line, content_end, &error)) {
+			if (error_offset)
+				*error_offset = error - source;
+			
+			cue_template_free(template);
+			return NULL;
+		}
+		
+		line = line_end + 1;
+	}
+	
+	return template;
+}
+
+static void put_latex_escaped(MarkupContext *ctx,
+							  const char *text,
+							  size_t length)
+{
+	size_t start = 0;
+	
+	for (size_t i = 0; i < length; ++i) {
+		const char *escape = latex_escapes[(unsigned char)text[i]];
+		if (!escape)
+			continue;
+		
+		markup_context_put(ctx, text + start, i - start);
+		markup_context_put(ctx, escape, strlen(escape));
+		start = i + 1;
+	}
+	
+	markup_context_put(ctx, text + start, length - start);
+}
+
+static void put_json_escaped(MarkupContext *ctx,
+							 const char *text,
+							 size_t length)
+{
+	size_t start = 0;
+	
+	while (start < length) {
+		size_t i = start + escape_find_json(text + start, length - start);
+		markup_context_put(ctx, text + start, i - start);
+		
+		if (i == length)
+			break;
+		
+		uint32_t sequence_length;
+		const char *sequence = escape_json_sequence((unsigned char)text[i], &sequence_length);
+		markup_context_put(ctx, sequence, sequence_length);
+		
+		start = i + 1;
+	}
+}
+
+static void put_text(const CueTemplate *template,
+					 MarkupContext *ctx,
+					 ASTNode *node,
+					 const char *source)
+{
+	if (!node)
+		return;
+	
+	const char *text = source + node->range.location;
+	size_t length = node->range.length;
+	
+	// The end's range runs on through its line break.
+	if (node->type == S_NODE_END) {
+		while (length && (text[length - 1] == '\n' || text[length - 1] == '\r' || text[length - 1] == ' ' || text[length - 1] == '\t'))
+			--length;
+	}
+	
+	switch (template->escape) {
+		case ESCAPE_HTML:
+			markup_context_put_escaped(ctx, text, length);
+			break;
+		case ESCAPE_LATEX:
+			put_latex_escaped(ctx, text, length);
+			break;
+		case ESCAPE_JSON:
+			put_json_escaped(ctx, text, length);
+			break;
+		default:
+			markup_context_put(ctx, text, length);
+			break;
+	}
+}
+
+static void put_uint(MarkupContext *ctx,
+					 uint32_t value)
+{
+	char buffer[FORMAT_UINT32_MAX];
+	
+	markup_context_put(ctx, buffer, format_uint32(buffer, value) - buffer);
+}
+
+// Returns `node` or its nearest ancestor of `type`, or NULL.
+static ASTNode *find_enclosing(ASTNode *node,
+							   ASTNodeType type)
+{
+	while (node && node->type != type)
+		node = node->parent;
+	
+	return node;
+}
+
+// Returns the outline entry of the header `node` is in, or NULL.
+static TOCEntry *find_enclosing_entry(TableOfContents *toc,
+									  ASTNode *node)
+{
+	ASTNode *header = find_enclosing(node, S_NODE_HEADER);
+	
+	return (header && toc) ? table_of_contents_entry_for_header(toc, header) : NULL;
+}
+
+static void run_program(const CueTemplate *template,
+						uint32_t pc,
+						ASTNode *node,
+						const char *source,
+						TableOfContents *toc,
+						MarkupContext *ctx)
+{
+	const uint8_t *code = template->code;
+	ASTNode *header;
+	ASTNode *cue;
+	TOCEntry *entry;
+	
+	for (;;) {
+		uint8_t op = code[pc++];
+		
+		switch (op) {
+			case OP_END:
+				return;
+			case OP_LITERAL:
+				markup_context_put(ctx, template->strings + get_u32(code + pc), get_u32(code + pc + 4));
+				pc += 8;
+				break;
+			case OP_TEXT:
+				put_text(template, ctx, node, source);
+				break;
+			case OP_RAW:
+				markup_context_put(ctx, source + node->range.location, node->range.length);
+				break;
+			case OP_LOCATION:
+				put_uint(ctx, node->range.location);
+				break;
+			case OP_LENGTH:
+				put_uint(ctx, node->range.length);
+				break;
+			case OP_ACT:
+			case OP_SCENE:
+			case OP_PAGE:
+			case OP_FRAME:
+				if ((entry = find_enclosing_entry(toc, node)))
+					put_uint(ctx, entry->numbers[op - OP_ACT]);
+				break;
+			case OP_NUMBER:
+				if ((entry = find_enclosing_entry(toc, node)) && entry->node->as.header.type < HEADER_FORCED)
+					put_uint(ctx, entry->number);
+				break;
+			case OP_LEVEL:
+				if ((header = find_enclosing(node, S_NODE_HEADER)))
+					put_uint(ctx, header->as.header.type == HEADER_FORCED ? 1 : header->as.header.type + 1);
+				break;
+			case OP_KEYWORD:
+				if ((header = find_enclosing(node, S_NODE_HEADER)))
+					put_text(template, ctx, header->as.header.keyword, source);
+				break;
+			case OP_ID:
+				if ((header = find_enclosing(node, S_NODE_HEADER)))
+					put_text(template, ctx, header->as.header.id, source);
+				break;
+			case OP_TITLE:
+				if ((header = find_enclosing(node, S_NODE_HEADER)))
+					put_text(template, ctx, header->as.header.title, source);
+				break;
+			case OP_NAME:
+				if ((cue = find_enclosing(node, S_NODE_CUE)))
+					put_text(template, ctx, cue->as.cue.name, source);
+				break;
+		}
+	}
+}
+
+typedef struct
+{
+	const CueTemplate *template;
+	TableOfContents *toc;
+	MarkupContext *ctx;
+} TemplateRun;
+
+static inline int template_enter(ASTNode *node,
+								 const char *source,
+								 void *info)
+{
+	TemplateRun *run = info;
+	const CueTemplate *template = run->template;
+	
+	if (template->enter[node->type] != NO_PROGRAM)
+		run_program(template, template->enter[node->type], node, source, run->toc, run->ctx);
+	
+	return (template->skip_mask & S_NODE_MASK(node->type)) != 0;
+}
+
+static inline void template_exit(ASTNode *node,
+								 const char *source,
+								 void *info)
+{
+	TemplateRun *run = info;
+	
+	if (run->template->exit[node->type] != NO_PROGRAM)
+		run_program(run->template, run->template->exit[node->type], node, source, run->toc, run->ctx);
+}
+
+void cue_template_render(const CueTemplate *template,
+						 ASTNode *root,
+						 const char *source,
+						 TableOfContents *toc,
+						 MarkupContext *ctx)
+{
+	TemplateRun run = { template, toc, ctx };
+	
+	RENDERER_WALK(root, source, &run, template_enter, template_exit);
+}
+
+size_t cue_template_serialized_size(const CueTemplate *template)
+{
+	return (HEADER_WORDS + 2 * S_NODE_TYPE_COUNT) * 4 + template->code_len + template->strings_len;
+}
+
+void cue_template_serialize(const CueTemplate *template,
+							void *buffer)
+{
+	uint8_t *p = buffer;
+	
+	put_u32(p, TEMPLATE_MAGIC);
+	put_u32(p + 4, TEMPLATE_VERSION);
+	put_u32(p + 8, S_NODE_TYPE_COUNT);
+	put_u32(p + 12, template->escape);
+	put_u32(p + 16, template->skip_mask);
+	put_u32(p + 20, (uint32_t)template->code_len);
+	put_u32(p + 24, (uint32_t)template->strings_len);
+	p += HEADER_WORDS * 4;
+	
+	for (int t = 0; t < S_NODE_TYPE_COUNT; ++t) {
+		put_u32(p, template->enter[t]);
+		put_u32(p + 4, template->exit[t]);
+		p += 8;
+	}
+	
+	memcpy(p, template->code, template->code_len);
+	p += template->code_len;
+	
+	memcpy(p, template->strings, template->strings_len);
+}
+
+int cue_template_is_serialized(const void *data,
+							   size_t size)
+{
+	return size >= 4 && get_u32(data) == TEMPLATE_MAGIC;
+}
+
+// Checks that every instruction is whole and every literal lies inside `strings`, marking where instructions start in `starts`.
+static int validate_code(const CueTemplate *template,
+						 uint8_t *starts)
+{
+	const uint8_t *code = template->code;
+	size_t pc = 0;
+	
+	while (pc < template->code_len) {
+		starts[pc] = 1;
+		uint8_t op = code[pc++];
+		
+		if (op >= OP_COUNT)
+			return 0;
+		
+		if (op == OP_LITERAL) {
+			if (pc + 8 > template->code_len)
+				return 0;
+			
+			if ((uint64_t)get_u32(code + pc) + get_u32(code + pc + 4) > template->strings_len)
+				return 0;
+			
+			pc += 8;
+		}
+	}
+	
+	// Every program runs until an OP_END, so the last one has to end with one.
+	return starts[template->code_len - 1] && code[template->code_len - 1] == OP_END;
+}
+
+CueTemplate *cue_template_deserialize(const void *data,
+									  size_t size)
+{
+	const uint8_t *p = data;
+	size_t tables = 2 * S_NODE_TYPE_COUNT * 4;
+	
+	if (size < HEADER_WORDS * 4 + tables || get_u32(p) != TEMPLATE_MAGIC || get_u32(p + 4) != TEMPLATE_VERSION || get_u32(p + 8) != S_NODE_TYPE_COUNT)
+		return NULL;
+	
+	uint32_t escape = get_u32(p + 12);
+	uint32_t skip_mask = get_u32(p + 16);
+	size_t code_len = get_u32(p + 20);
+	size_t strings_len = get_u32(p + 24);
+	
+	if (escape >= ESCAPE_COUNT || !code_len || HEADER_WORDS * 4 + tables + code_len + strings_len != size)
+		return NULL;
+	
+	CueTemplate *template = c_calloc(1, sizeof(CueTemplate));
+	template->escape = escape;
+	template->skip_mask = skip_mask;
+	
+	template->code_len = template->code_cap = code_len;
+	template->code = c_malloc(code_len);
+	template->strings_len = template->strings_cap = strings_len;
+	template->strings = c_malloc(strings_len + 1);
+	
+	p += HEADER_WORDS * 4;
+	
+	for (int t = 0; t < S_NODE_TYPE_COUNT; ++t) {
+		template->enter[t] = get_u32(p);
+		template->exit[t] = get_u32(p + 4);
+		p += 8;
+	}
+	
+	memcpy(template->code, p, code_len);
+	p += code_len;
+	
+	memcpy(template->strings, p, strings_len);
+	
+	// Programs have to start on an instruction, or they could read a literal's operands as ops.
+	uint8_t *starts = c_calloc(code_len, 1);
+	int valid = validate_code(template, starts) && template->code[NO_PROGRAM] == OP_END;
+	
+	for (int t = 0; t < S_NODE_TYPE_COUNT && valid; ++t) {
+		valid = template->enter[t] < code_len && starts[template->enter[t]] &&
+				template->exit[t] < code_len && starts[template->exit[t]];
+	}
+	
+	free(starts);
+	
+	if (!valid) {
+		cue_template_free(template);
+		return NULL;
+	}
+	
+	return template;
+}
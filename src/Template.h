@@ -0,0 +1,81 @@
+
+#ifndef Template_h
+#define Template_h
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "nodes.h"
+#include "MarkupContext.h"
+#include "TableOfContents.h"
+
+/** A renderer compiled from a template, so that a new output format needs
+ * no C. A template maps node types to the text written on entering and
+ * exiting them, one line each:
+ *
+ *     # LaTeX
+ *     escape latex
+ *     header.enter = \section*{{{keyword}} {{number}}}{{newline}}
+ *     literal.enter = {{text}}
+ *     emphasis.enter = \emph{
+ *     emphasis.exit = }
+ *     skip comment
+ *
+ * Node types are named as in queries. `{{text}}` is a node's source, escaped
+ * as `escape html|latex|json|none` says (HTML by default), and `{{raw}}` is
+ * the same unescaped. `{{location}}` and `{{length}}` give its range.
+ * `{{act}}`, `{{scene}}`, `{{page}}`, `{{frame}}`, `{{number}}` (the header's
+ * own number) and `{{level}}` (1 for acts and forced headers, up to 4 for
+ * frames) come from the header a node is in, and `{{name}}` is the character
+ * of the cue a node is in. `{{keyword}}`, `{{id}}` and `{{title}}` are the
+ * parts of a header.
+ * `{{newline}}` and `{{tab}}` stand for those characters. Braces that don't
+ * make a placeholder are written as they are. `skip TYPE` leaves out the
+ * children of nodes of that type, and types without a template write
+ * nothing but still have their children rendered.
+ *
+ * Compiling turns each template into bytecode for a small interpreter. A
+ * compiled template can be serialized and loaded again without compiling.
+ */
+typedef struct CueTemplate CueTemplate;
+
+/** Compiles `source`. Returns NULL on a syntax error and, if `error_offset`
+ * isn't NULL, stores the offset into `source` where compilation failed.
+ */
+CueTemplate *cue_template_compile(const char *source,
+								  size_t length,
+								  size_t *error_offset);
+
+void cue_template_free(CueTemplate *template);
+
+/** Renders `root` and its descendants into `ctx` with `template`. Header
+ * numbers come from `toc`, and are left out if it's NULL.
+ */
+void cue_template_render(const CueTemplate *template,
+						 ASTNode *root,
+						 const char *source,
+						 TableOfContents *toc,
+						 MarkupContext *ctx);
+
+/** Returns the number of bytes `cue_template_serialize` writes. */
+size_t cue_template_serialized_size(const CueTemplate *template);
+
+/** Writes `template` to `buffer`, which must hold
+ * `cue_template_serialized_size(template)` bytes.
+ */
+void cue_template_serialize(const CueTemplate *template,
+							void *buffer);
+
+/** Returns 1 if `data` starts like a serialized template rather than a
+ * template's source.
+ */
+int cue_template_is_serialized(const void *data,
+							   size_t size);
+
+/** Reads a template written by `cue_template_serialize`. Returns NULL if
+ * `data` is malformed or was written by an incompatible version.
+ */
+CueTemplate *cue_template_deserialize(const void *data,
+									  size_t size);
+
+#endif /* Template_h */
@@ -0,0 +1,802 @@
+
+#include "TextIndex.h"
+
+#include <string.h>
+
+#include "mem.h"
+#include "Hash.h"
+#include "Visitor.h"
+
+#define TEXT_INDEX_MAGIC 0x58455543 // "CUEX"
+#define TEXT_INDEX_VERSION 2
+
+// The serialized header: magic, version, source length, source hash (two words), term count, name bytes, postings bytes.
+#define HEADER_WORDS 8
+#define TERM_WORDS 5
+
+// Digits of the radix sort that orders prefix matches.
+#define RADIX_BITS 11
+#define RADIX_MASK ((1 << RADIX_BITS) - 1)
+
+typedef struct
+{
+	uint32_t name;
+	uint32_t length;
+	uint32_t postings;
+	uint32_t size;
+	uint32_t count;
+} Term;
+
+struct TextIndex
+{
+	// Sorted by name, so that prefixes cover a contiguous run.
+	Term *terms;
+	size_t term_count;
+	
+	char *names;
+	size_t names_len;
+	
+	uint8_t *postings;
+	size_t postings_len;
+	
+	uint32_t source_length;
+	uint64_t source_hash;
+};
+
+static inline int is_token_byte(unsigned char c)
+{
+	return (c >= '0' && c <= '9') || ((c | 0x20) >= 'a' && (c | 0x20) <= 'z') || c >= 0x80;
+}
+
+static inline char fold(char c)
+{
+	return (c >= 'A' && c <= 'Z') ? c + ('a' - 'A') : c;
+}
+
+// Finds the next token at or after `*loc` and before `end`. Apostrophes only count between token bytes, so quotes never become part of a word.
+static int next_token(const char *s,
+					  uint32_t *loc,
+					  uint32_t end,
+					  SRange *token)
+{
+	uint32_t i = *loc;
+	
+	while (i < end && !is_token_byte(s[i]))
+		++i;
+	
+	if (i >= end)
+		return 0;
+	
+	uint32_t start = i;
+	while (i < end && (is_token_byte(s[i]) || (s[i] == '\'' && i + 1 < end && is_token_byte(s[i+1]))))
+		++i;
+	
+	token->location = start;
+	token->length = i - start;
+	*loc = i;
+	
+	return 1;
+}
+
+static inline uint8_t *put_varint(uint8_t *p,
+								  uint64_t value)
+{
+	while (value >= 0x80) {
+		*p++ = (uint8_t)(value | 0x80);
+		value >>= 7;
+	}
+	
+	*p++ = (uint8_t)value;
+	
+	return p;
+}
+
+static inline const uint8_t *get_varint(const uint8_t *p,
+										const uint8_t *end,
+										uint64_t *value)
+{
+	if (p < end && !(*p & 0x80)) {
+		*value = *p;
+		return p + 1;
+	}
+	
+	uint64_t v = 0;
+	int shift = 0;
+	
+	while (p < end && shift < 64) {
+		uint8_t b = *p++;
+		v |= (uint64_t)(b & 0x7F) << shift;
+		
+		if (!(b & 0x80)) {
+			*value = v;
+			return p;
+		}
+		
+		shift += 7;
+	}
+	
+	return NULL;
+}
+
+typedef struct
+{
+	uint32_t term;
+	uint32_t position;
+	uint32_t offset;
+	uint32_t tag;
+} Occurrence;
+
+typedef struct
+{
+	const char *source;
+	
+	Term *terms;
+	size_t term_count;
+	size_t term_cap;
+	
+	// Terms by name.
+	HashTable slots;
+	
+	char *names;
+	size_t names_len;
+	size_t names_cap;
+	
+	Occurrence *occurrences;
+	size_t len;
+	size_t cap;
+	
+	TextTag tag;
+	int comment_depth;
+	uint32_t position;
+} TextIndexBuilder;
+
+typedef struct
+{
+	TextIndexBuilder *builder;
+	const char *name;
+	uint32_t length;
+} TermName;
+
+static int term_name_equals(const void *context,
+							uint32_t id)
+{
+	const TermName *key = context;
+	TextIndexBuilder *b = key->builder;
+	Term *term = b->terms + id;
+	
+	return term->length == key->length && memcmp(b->names + term->name, key->name, key->length) == 0;
+}
+
+// Returns the id of the term for `token`, folding its case into the name buffer.
+static uint32_t builder_intern(TextIndexBuilder *b,
+							   SRange token)
+{
+	if (b->names_len + token.length > b->names_cap) {
+		b->names_cap = (b->names_cap + token.length) * 2;
+		b->names = c_realloc(b->names, b->names_cap);
+	}
+	
+	char *name = b->names + b->names_len;
+	uint32_t hash = FNV_OFFSET_BASIS;
+	
+	for (uint32_t i = 0; i < token.length; ++i) {
+		name[i] = fold(b->source[token.location + i]);
+		hash = (hash ^ (unsigned char)name[i]) * FNV_PRIME;
+	}
+	
+	TermName key = { b, name, token.length };
+	HashSlot *slot = hash_table_find(&b->slots, hash, term_name_equals, &key);
+	if (slot->entry)
+		return slot->entry - 1;
+	
+	if (b->term_count >= b->term_cap) {
+		b->term_cap = b->term_cap ? b->term_cap * 2 : 256;
+		b->terms = c_realloc(b->terms, b->term_cap * sizeof(Term));
+	}
+	
+	uint32_t id = (uint32_t)b->term_count++;
+	
+	memset(b->terms + id, 0, sizeof(Term));
+	b->terms[id].name = (uint32_t)b->names_len;
+	b->terms[id].length = token.length;
+	b->names_len += token.length;
+	
+	hash_table_insert(&b->slots, slot, hash, id);
+	
+	return id;
+}
+
+static void builder_add_literal(TextIndexBuilder *b,
+								ASTNode *literal)
+{
+	uint32_t loc = literal->range.location;
+	uint32_t end = s_range_max(literal->range);
+	SRange token;
+	
+	while (next_token(b->source, &loc, end, &token)) {
+		uint32_t term = builder_intern(b, token);
+		
+		if (b->len >= b->cap) {
+			b->cap = b->cap ? b->cap * 2 : 1024;
+			b->occurrences = c_realloc(b->occurrences, b->cap * sizeof(Occurrence));
+		}
+		
+		Occurrence *occ = b->occurrences + b->len++;
+		occ->term = term;
+		occ->position = b->position++;
+		occ->offset = token.location;
+		occ->tag = b->tag;
+		
+		++b->terms[term].count;
+	}
+}
+
+static void text_index_visit(ASTNode *node,
+							 WalkerEvent event,
+							 void *data)
+{
+	TextIndexBuilder *b = data;
+	
+	if (node->type == S_NODE_COMMENT) {
+		b->comment_depth += (event == EVENT_ENTER) ? 1 : -1;
+		return;
+	}
+	
+	if (event != EVENT_ENTER)
+		return;
+	
+	switch (node->type) {
+		case S_NODE_LITERAL:
+			if (!b->comment_depth)
+				builder_add_literal(b, node);
+			return;
+		case S_NODE_DESCRIPTION:
+			b->tag = TEXT_TAG_DESCRIPTION;
+			break;
+		case S_NODE_CUE:
+			b->tag = TEXT_TAG_DIALOGUE;
+			break;
+		case S_NODE_LYRIC_DIRECTION:
+			b->tag = TEXT_TAG_LYRIC;
+			break;
+		case S_NODE_FACSIMILE:
+			b->tag = TEXT_TAG_FACSIMILE;
+			break;
+		case S_NODE_TITLE:
+			b->tag = TEXT_TAG_TITLE;
+			break;
+		default:
+			break;
+	}
+	
+	// Skip a position at the start of every block and line, so that no phrase spans two.
+	++b->position;
+}
+
+// A term's name and id, so that terms can be sorted by name without reaching back into the builder.
+typedef struct
+{
+	const char *name;
+	uint32_t length;
+	uint32_t id;
+} TermKey;
+
+static int compare_term_keys(const void *a,
+							 const void *b)
+{
+	const TermKey *x = a;
+	const TermKey *y = b;
+	
+	uint32_t n = x->length < y->length ? x->length : y->length;
+	int cmp = memcmp(x->name, y->name, n);
+	
+	return cmp ? cmp : (int)x->length - (int)y->length;
+}
+
+TextIndex *text_index_build(ASTNode *root,
+							const char *source,
+							size_t length)
+{
+	TextIndexBuilder b;
+	memset(&b, 0, sizeof(TextIndexBuilder));
+	
+	b.source = source;
+	hash_table_init(&b.slots, 1024);
+	
+	VisitorSet *set = visitor_set_new();
+	visitor_set_add(set, S_NODE_MASK(S_NODE_LITERAL) | S_NODE_MASK(S_NODE_COMMENT) | S_NODE_MASK(S_NODE_DESCRIPTION) | S_NODE_MASK(S_NODE_CUE) | S_NODE_MASK(S_NODE_LYRIC_DIRECTION) | S_NODE_MASK(S_NODE_LINE) | S_NODE_MASK(S_NODE_FACSIMILE) | S_NODE_MASK(S_NODE_TITLE), text_index_visit, &b);
+	visitor_set_walk(set, root);
+	visitor_set_free(set);
+	
+	TextIndex *index = c_calloc(1, sizeof(TextIndex));
+	index->source_length = (uint32_t)length;
+	index->source_hash = hash_bytes(source, length, length);
+	index->term_count = b.term_count;
+	
+	// Order the terms by name.
+	TermKey *keys = c_malloc((b.term_count + 1) * sizeof(TermKey));
+	for (size_t t = 0; t < b.term_count; ++t) {
+		keys[t].name = b.names + b.terms[t].name;
+		keys[t].length = b.terms[t].length;
+		keys[t].id = (uint32_t)t;
+	}
+	
+	qsort(keys, b.term_count, sizeof(TermKey), compare_term_keys);
+	
+	uint32_t *order = c_malloc((b.term_count + 1) * sizeof(uint32_t));
+	for (size_t r = 0; r < b.term_count; ++r)
+		order[r] = keys[r].id;
+	
+	free(keys);
+	
+	uint32_t *rank = c_malloc((b.term_count + 1) * sizeof(uint32_t));
+	for (size_t r = 0; r < b.term_count; ++r)
+		rank[order[r]] = (uint32_t)r;
+	
+	// Counting sort the occurrences by term, keeping document order within each term.
+	size_t *starts = c_calloc(b.term_count + 1, sizeof(size_t));
+	for (size_t r = 0; r < b.term_count; ++r)
+		starts[r + 1] = starts[r] + b.terms[order[r]].count;
+	
+	Occurrence *sorted = c_malloc((b.len + 1) * sizeof(Occurrence));
+	for (size_t i = 0; i < b.len; ++i)
+		sorted[starts[rank[b.occurrences[i].term]]++] = b.occurrences[i];
+	
+	// Each occurrence is at most two 10-byte varints.
+	index->terms = c_malloc((b.term_count + 1) * sizeof(Term));
+	index->names = c_malloc(b.names_len + 1);
+	index->postings = c_malloc(b.len * 20 + 1);
+	
+	uint8_t *p = index->postings;
+	size_t i = 0;
+	
+	for (size_t r = 0; r < b.term_count; ++r) {
+		Term *src = b.terms + order[r];
+		Term *term = index->terms + r;
+		
+		term->name = (uint32_t)index->names_len;
+		term->length = src->length;
+		term->postings = (uint32_t)(p - index->postings);
+		term->count = src->count;
+		
+		memcpy(index->names + index->names_len, b.names + src->name, src->length);
+		index->names_len += src->length;
+		
+		uint32_t position = 0;
+		uint32_t offset = 0;
+		
+		for (uint32_t k = 0; k < src->count; ++k, ++i) {
+			Occurrence *occ = sorted + i;
+			
+			p = put_varint(p, ((uint64_t)(occ->position - position) << 3) | occ->tag);
+			p = put_varint(p, occ->offset - offset);
+			
+			position = occ->position;
+			offset = occ->offset;
+		}
+		
+		term->size = (uint32_t)(p - index->postings) - term->postings;
+	}
+	
+	index->postings_len = p - index->postings;
+	index->postings = c_realloc(index->postings, index->postings_len + 1);
+	
+	free(sorted);
+	free(starts);
+	free(rank);
+	free(order);
+	free(b.occurrences);
+	free(b.names);
+	hash_table_free(&b.slots);
+	free(b.terms);
+	
+	return index;
+}
+
+void text_index_free(TextIndex *index)
+{
+	free(index->terms);
+	free(index->names);
+	free(index->postings);
+	
+	free(index);
+}
+
+size_t text_index_term_count(TextIndex *index)
+{
+	return index->term_count;
+}
+
+typedef struct
+{
+	uint32_t position;
+	uint32_t offset;
+	uint32_t length;
+	uint32_t tag;
+} Hit;
+
+// Compares a term's name, cut to `length` bytes if `prefix`, with `name`.
+static int compare_term(TextIndex *index,
+						Term *term,
+						const char *name,
+						uint32_t length,
+						int prefix)
+{
+	uint32_t n = term->length < length ? term->length : length;
+	int cmp = memcmp(index->names + term->name, name, n);
+	
+	if (cmp || (prefix && term->length >= length))
+		return cmp;
+	
+	return (int)term->length - (int)length;
+}
+
+// Returns the first term that compares at or above `name` (or above it, if not `inclusive`).
+static size_t lower_bound(TextIndex *index,
+						  const char *name,
+						  uint32_t length,
+						  int prefix,
+						  int inclusive)
+{
+	size_t lo = 0;
+	size_t hi = index->term_count;
+	
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+		int cmp = compare_term(index, index->terms + mid, name, length, prefix);
+		
+		if (cmp < 0 || (!inclusive && cmp == 0))
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	
+	return lo;
+}
+
+// Appends the occurrences of `term` to `hits`.
+static Hit *decode_term(TextIndex *index,
+						Term *term,
+						Hit *hits)
+{
+	const uint8_t *p = index->postings + term->postings;
+	const uint8_t *end = p + term->size;
+	
+	uint32_t position = 0;
+	uint32_t offset = 0;
+	
+	for (uint32_t k = 0; k < term->count; ++k) {
+		uint64_t head = 0;
+		uint64_t delta = 0;
+		
+		p = get_varint(p, end, &head);
+		if (p)
+			p = get_varint(p, end, &delta);
+		if (!p)
+			break;
+		
+		position += (uint32_t)(head >> 3);
+		offset += (uint32_t)delta;
+		
+		hits->position = position;
+		hits->offset = offset;
+		hits->length = term->length;
+		hits->tag = (uint32_t)(head & 7);
+		++hits;
+	}
+	
+	return hits;
+}
+
+// Sorts hits by position, 11 bits at a time from the least significant. Positions are unique, so this is as stable as it needs to be.
+static void sort_hits(Hit *hits,
+					  size_t count)
+{
+	if (count < 2)
+		return;
+	
+	uint32_t max = 0;
+	for (size_t i = 0; i < count; ++i)
+		max |= hits[i].position;
+	
+	Hit *buffer = c_malloc(count * sizeof(Hit));
+	Hit *from = hits;
+	Hit *to = buffer;
+	
+	for (int shift = 0; shift < 32 && (max >> shift); shift += RADIX_BITS) {
+		size_t offsets[1 << RADIX_BITS] = { 0 };
+		
+		for (size_t i = 0; i < count; ++i)
+			++offsets[(from[i].position >> shift) & RADIX_MASK];
+		
+		size_t total = 0;
+		for (int d = 0; d < (1 << RADIX_BITS); ++d) {
+			size_t n = offsets[d];
+			offsets[d] = total;
+			total += n;
+		}
+		
+		for (size_t i = 0; i < count; ++i)
+			to[offsets[(from[i].position >> shift) & RADIX_MASK]++] = from[i];
+		
+		Hit *swap = from;
+		from = to;
+		to = swap;
+	}
+	
+	if (from != hits)
+		memcpy(hits, from, count * sizeof(Hit));
+	
+	free(buffer);
+}
+
+// Drops the hits in [hits, end) whose position isn't set in `positions`, a bitmap of `limit` bits.
+static Hit *filter_hits(Hit *hits,
+						Hit *end,
+						const uint64_t *positions,
+						uint32_t limit)
+{
+	Hit *kept = hits;
+	
+	for (Hit *hit = hits; hit < end; ++hit) {
+		if (hit->position < limit && (positions[hit->position >> 6] >> (hit->position & 63) & 1))
+			*kept++ = *hit;
+	}
+	
+	return kept;
+}
+
+// Decodes every occurrence of the terms in [first, last) into one list in position order. Returns NULL if there are none. If `heads` is given, only hits `gap` positions after one of them are kept, which saves sorting every occurrence of a short prefix.
+static Hit *decode_terms(TextIndex *index,
+						 size_t first,
+						 size_t last,
+						 const Hit *heads,
+						 size_t head_count,
+						 uint32_t gap,
+						 size_t *count)
+{
+	uint64_t *positions = NULL;
+	uint32_t limit = 0;
+	
+	if (heads && head_count) {
+		limit = heads[head_count - 1].position + gap + 1;
+		positions = c_calloc((limit + 63) / 64, sizeof(uint64_t));
+		
+		for (size_t i = 0; i < head_count; ++i) {
+			uint32_t position = heads[i].position + gap;
+			positions[position >> 6] |= (uint64_t)1 << (position & 63);
+		}
+	}
+	
+	size_t total = 0;
+	for (size_t t = first; t < last; ++t)
+		total += index->terms[t].count;
+	
+	*count = 0;
+	if (!total)
+		return NULL;
+	
+	Hit *hits = c_malloc(total * sizeof(Hit));
+	Hit *end = hits;
+	
+	for (size_t t = first; t < last; ++t) {
+		Hit *start = end;
+		end = decode_term(index, index->terms + t, end);
+		
+		if (heads)
+			end = filter_hits(start, end, positions, limit);
+	}
+	
+	free(positions);
+	
+	*count = end - hits;
+	
+	if (last - first > 1)
+		sort_hits(hits, *count);
+	
+	return hits;
+}
+
+size_t text_index_search(TextIndex *index,
+						 const char *query,
+						 size_t length,
+						 uint32_t tag_mask,
+						 TextMatch *out,
+						 size_t cap)
+{
+	SRange words[TEXT_INDEX_MAX_QUERY_WORDS];
+	size_t word_count = 0;
+	
+	uint32_t loc = 0;
+	SRange token;
+	while (word_count < TEXT_INDEX_MAX_QUERY_WORDS && next_token(query, &loc, (uint32_t)length, &token))
+		words[word_count++] = token;
+	
+	// Matching only the first words of a longer phrase would report matches that weren't asked for.
+	if (!word_count || next_token(query, &loc, (uint32_t)length, &token))
+		return 0;
+	
+	// Cutting a word short could make it match a different term.
+	for (size_t w = 0; w < word_count; ++w) {
+		if (words[w].length > TEXT_INDEX_MAX_QUERY_WORD_LENGTH)
+			return 0;
+	}
+	
+	int prefix = s_range_max(words[word_count - 1]) < length && query[s_range_max(words[word_count - 1])] == '*';
+	
+	// Decode each word's occurrences. Only the last word can be a prefix.
+	Hit *lists[TEXT_INDEX_MAX_QUERY_WORDS];
+	size_t counts[TEXT_INDEX_MAX_QUERY_WORDS];
+	size_t matches = 0;
+	size_t w = 0;
+	
+	for (; w < word_count; ++w) {
+		char name[TEXT_INDEX_MAX_QUERY_WORD_LENGTH];
+		uint32_t n = words[w].length;
+		for (uint32_t i = 0; i < n; ++i)
+			name[i] = fold(query[words[w].location + i]);
+		
+		int is_prefix = prefix && w + 1 == word_count;
+		size_t first = lower_bound(index, name, n, is_prefix, 1);
+		size_t last = is_prefix ? lower_bound(index, name, n, 1, 0) : first + (first < index->term_count && compare_term(index, index->terms + first, name, n, 0) == 0);
+		
+		if (is_prefix && w)
+			lists[w] = decode_terms(index, first, last, lists[0], counts[0], (uint32_t)w, counts + w);
+		else
+			lists[w] = decode_terms(index, first, last, NULL, 0, 0, counts + w);
+		
+		if (!lists[w])
+			goto done;
+	}
+	
+	// Join on positions: the i-th word of a phrase sits i positions after the first.
+	size_t cursors[TEXT_INDEX_MAX_QUERY_WORDS] = { 0 };
+	
+	for (size_t k = 0; k < counts[0]; ++k) {
+		Hit *head = lists[0] + k;
+		if (!(tag_mask & TEXT_TAG_MASK(head->tag)))
+			continue;
+		
+		Hit *tail = head;
+		size_t i = 1;
+		
+		for (; i < word_count; ++i) {
+			while (cursors[i] < counts[i] && lists[i][cursors[i]].position < head->position + i)
+				++cursors[i];
+			
+			if (cursors[i] >= counts[i] || lists[i][cursors[i]].position != head->position + i)
+				break;
+			
+			tail = lists[i] + cursors[i];
+		}
+		
+		if (i < word_count)
+			continue;
+		
+		if (matches < cap) {
+			TextMatch *match = out + matches;
+			match->range.location = head->offset;
+			match->range.length = tail->offset + tail->length - head->offset;
+			match->position = head->position;
+			match->tag = (TextTag)head->tag;
+		}
+		
+		++matches;
+	}
+
+done:
+	for (size_t i = 0; i < w && i < word_count; ++i)
+		free(lists[i]);
+	
+	return matches;
+}
+
+static inline void put_u32(uint8_t *p,
+						   uint32_t v)
+{
+	p[0] = (uint8_t)v;
+	p[1] = (uint8_t)(v >> 8);
+	p[2] = (uint8_t)(v >> 16);
+	p[3] = (uint8_t)(v >> 24);
+}
+
+static inline uint32_t get_u32(const uint8_t *p)
+{
+	return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+size_t text_index_serialized_size(TextIndex *index)
+{
+	return (HEADER_WORDS + index->term_count * TERM_WORDS) * 4 + index->names_len + index->postings_len;
+}
+
+void text_index_serialize(TextIndex *index,
+						  void *buffer)
+{
+	uint8_t *p = buffer;
+	
+	put_u32(p, TEXT_INDEX_MAGIC);
+	put_u32(p + 4, TEXT_INDEX_VERSION);
+	put_u32(p + 8, index->source_length);
+	put_u32(p + 12, (uint32_t)index->source_hash);
+	put_u32(p + 16, (uint32_t)(index->source_hash >> 32));
+	put_u32(p + 20, (uint32_t)index->term_count);
+	put_u32(p + 24, (uint32_t)index->names_len);
+	put_u32(p + 28, (uint32_t)index->postings_len);
+	p += HEADER_WORDS * 4;
+	
+	for (size_t t = 0; t < index->term_count; ++t) {
+		Term *term = index->terms + t;
+		
+		put_u32(p, term->name);
+		put_u32(p + 4, term->length);
+		put_u32(p + 8, term->postings);
+		put_u32(p + 12, term->size);
+		put_u32(p + 16, term->count);
+		p += TERM_WORDS * 4;
+	}
+	
+	memcpy(p, index->names, index->names_len);
+	p += index->names_len;
+	
+	memcpy(p, index->postings, index->postings_len);
+}
+
+TextIndex *text_index_deserialize(const void *data,
+								  size_t size,
+								  const char *source,
+								  size_t length)
+{
+	const uint8_t *p = data;
+	
+	if (size < HEADER_WORDS * 4 || get_u32(p) != TEXT_INDEX_MAGIC || get_u32(p + 4) != TEXT_INDEX_VERSION)
+		return NULL;
+	
+	uint64_t source_hash = get_u32(p + 12) | ((uint64_t)get_u32(p + 16) << 32);
+	if (get_u32(p + 8) != length || source_hash != hash_bytes(source, length, length))
+		return NULL;
+	
+	size_t term_count = get_u32(p + 20);
+	size_t names_len = get_u32(p + 24);
+	size_t postings_len = get_u32(p + 28);
+	
+	if (term_count > size / (TERM_WORDS * 4) || (HEADER_WORDS + term_count * TERM_WORDS) * 4 + names_len + postings_len != size)
+		return NULL;
+	
+	TextIndex *index = c_calloc(1, sizeof(TextIndex));
+	index->source_length = (uint32_t)length;
+	index->source_hash = source_hash;
+	index->term_count = term_count;
+	index->names_len = names_len;
+	index->postings_len = postings_len;
+	
+	index->terms = c_malloc((term_count + 1) * sizeof(Term));
+	index->names = c_malloc(names_len + 1);
+	index->postings = c_malloc(postings_len + 1);
+	
+	p += HEADER_WORDS * 4;
+	
+	for (size_t t = 0; t < term_count; ++t) {
+		Term *term = index->terms + t;
+		
+		term->name = get_u32(p);
+		term->length = get_u32(p + 4);
+		term->postings = get_u32(p + 8);
+		term->size = get_u32(p + 12);
+		term->count = get_u32(p + 16);
+		p += TERM_WORDS * 4;
+		
+		// Every range has to stay inside its buffer, and every occurrence takes at least two bytes.
+		if ((uint64_t)term->name + term->length > names_len || (uint64_t)term->postings + term->size > postings_len || (uint64_t)term->count * 2 > term->size) {
+			text_index_free(index);
+			return NULL;
+		}
+	}
+	
+	memcpy(index->names, p, names_len);
+	p += names_len;
+	
+	memcpy(index->postings, p, postings_len);
+	
+	return index;
+}
@@ -0,0 +1,91 @@
+
+#ifndef TextIndex_h
+#define TextIndex_h
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "nodes.h"
+
+/** The kind of block a word was found in. */
+typedef enum
+{
+	TEXT_TAG_DESCRIPTION,
+	TEXT_TAG_DIALOGUE,
+	TEXT_TAG_LYRIC,
+	TEXT_TAG_FACSIMILE,
+	TEXT_TAG_TITLE
+} TextTag;
+
+#define TEXT_TAG_COUNT (TEXT_TAG_TITLE + 1)
+
+/* Tags can be combined into a bit mask to restrict a search. */
+#define TEXT_TAG_MASK(tag) ((uint32_t)1 << (tag))
+#define TEXT_TAG_MASK_ALL (TEXT_TAG_MASK(TEXT_TAG_COUNT) - 1)
+
+/* The most words a search phrase can have, and the most bytes in each. */
+#define TEXT_INDEX_MAX_QUERY_WORDS 16
+#define TEXT_INDEX_MAX_QUERY_WORD_LENGTH 256
+
+/** One hit of a search. `range` runs from the start of the first word of the
+ * phrase to the end of the last, and `position` counts words from the start
+ * of the document.
+ */
+typedef struct
+{
+	SRange range;
+	uint32_t position;
+	TextTag tag;
+} TextMatch;
+
+/** An inverted index of the words of a document. Words are runs of ASCII
+ * letters and digits, bytes above 0x7F, and apostrophes between them, with
+ * ASCII letters lower-cased. Only literal text is indexed, so comments,
+ * names and header keywords are left out. Each term keeps the position,
+ * offset and tag of every occurrence, delta- and varint-encoded.
+ */
+typedef struct TextIndex TextIndex;
+
+/** Indexes the text below `root`, which was parsed from `source`. */
+TextIndex *text_index_build(ASTNode *root,
+							const char *source,
+							size_t length);
+
+void text_index_free(TextIndex *index);
+
+/** The number of distinct terms. */
+size_t text_index_term_count(TextIndex *index);
+
+/** Searches for `query` in blocks whose tag is in `tag_mask`. A query of
+ * several words matches them as a phrase within one block, and a `*` right
+ * after the last word matches any term it is a prefix of. Stores up to `cap`
+ * matches in `out` in document order and returns how many there are in
+ * total. A query of more than `TEXT_INDEX_MAX_QUERY_WORDS` words, or with
+ * a word longer than `TEXT_INDEX_MAX_QUERY_WORD_LENGTH` bytes, matches
+ * nothing.
+ */
+size_t text_index_search(TextIndex *index,
+						 const char *query,
+						 size_t length,
+						 uint32_t tag_mask,
+						 TextMatch *out,
+						 size_t cap);
+
+/** Returns the number of bytes `text_index_serialize` writes. */
+size_t text_index_serialized_size(TextIndex *index);
+
+/** Writes `index` to `buffer`, which must hold
+ * `text_index_serialized_size(index)` bytes.
+ */
+void text_index_serialize(TextIndex *index,
+						  void *buffer);
+
+/** Reads an index written by `text_index_serialize`. Returns NULL if `data`
+ * is malformed or was built from a source other than `source`.
+ */
+TextIndex *text_index_deserialize(const void *data,
+								  size_t size,
+								  const char *source,
+								  size_t length);
+
+#endif /* TextIndex_h */
@@ -0,0 +1,276 @@
+
+#include "UTF8.h"
+
+#include <stdint.h>
+#include <string.h>
+
+#include "SWAR.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// The lookup-table validator needs SSSE3's byte shuffle. It is compiled for SSSE3 on its own and only used when the CPU supports it.
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define UTF8_HAVE_SSSE3 1
+#include <tmmintrin.h>
+#endif
+
+/* Every byte that starts a character adds one UTF-16 unit, and the lead byte of a 4-byte sequence (0xF0 and up) adds a second for the surrogate pair. Continuation bytes (0b10xxxxxx) add nothing. */
+static inline size_t utf16_units_for_byte(unsigned char c)
+{
+	if ((c & 0xC0) == 0x80)
+		return 0;
+	
+	return (c >= 0xF0) ? 2 : 1;
+}
+
+size_t utf8_count_utf16_units(const char *s,
+							  size_t len)
+{
+	size_t units = 0;
+	size_t i = 0;
+
+#if defined(__SSE2__)
+	// As signed bytes, continuation bytes are the ones below -64. 4-byte lead bytes are the ones left unchanged by an unsigned max with 0xF0.
+	const __m128i continuation_bound = _mm_set1_epi8(-64);
+	const __m128i four_byte_bound = _mm_set1_epi8((char)0xF0);
+	
+	for (; i + 16 <= len; i += 16) {
+		__m128i v = _mm_loadu_si128((const __m128i *)(s + i));
+		
+		int continuations = _mm_movemask_epi8(_mm_cmplt_epi8(v, continuation_bound));
+		int four_byte_leads = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_max_epu8(v, four_byte_bound), v));
+		
+		units += 16 - popcount32(continuations) + popcount32(four_byte_leads);
+	}
+#endif
+	
+	for (; i + 8 <= len; i += 8) {
+		uint64_t w;
+		memcpy(&w, s + i, 8);
+		
+		// Bit 7 of each byte ends up set for 0b10xxxxxx and for 0b1111xxxx respectively.
+		uint64_t continuations = w & ~(w << 1) & HIGHS;
+		uint64_t four_byte_leads = w & (w << 1) & (w << 2) & (w << 3) & HIGHS;
+		
+		units += 8 - popcount64(continuations) + popcount64(four_byte_leads);
+	}
+	
+	for (; i < len; ++i)
+		units += utf16_units_for_byte((unsigned char)s[i]);
+	
+	return units;
+}
+
+static size_t utf8_validate_scalar(const unsigned char *s,
+								   size_t len)
+{
+	size_t i = 0;
+	
+	while (i < len) {
+		// Skip ASCII a word at a time.
+		if (i + 8 <= len) {
+			uint64_t w;
+			memcpy(&w, s + i, 8);
+			
+			if (!(w & HIGHS)) {
+				i += 8;
+				continue;
+			}
+		}
+		
+		unsigned char c = s[i];
+		if (c < 0x80) {
+			++i;
+			continue;
+		}
+		
+		// Number of continuation bytes, and the allowed range of the first one.
+		size_t n;
+		unsigned char lo = 0x80;
+		unsigned char hi = 0xBF;
+		
+		if (c >= 0xC2 && c <= 0xDF) {
+			n = 1;
+		} else if (c == 0xE0) {
+			n = 2;
+			lo = 0xA0;
+		} else if (c == 0xED) {
+			n = 2;
+			hi = 0x9F;
+		} else if (c >= 0xE1 && c <= 0xEF) {
+			n = 2;
+		} else if (c == 0xF0) {
+			n = 3;
+			lo = 0x90;
+		} else if (c >= 0xF1 && c <= 0xF3) {
+			n = 3;
+		} else if (c == 0xF4) {
+			n = 3;
+			hi = 0x8F;
+		} else {
+			return i;
+		}
+		
+		if (len - i <= n)
+			return i;
+		
+		if (s[i+1] < lo || s[i+1] > hi)
+			return i;
+		
+		for (size_t k = 2; k <= n; ++k) {
+			if ((s[i+k] & 0xC0) != 0x80)
+				return i;
+		}
+		
+		i += n + 1;
+	}
+	
+	return len;
+}
+
+#if defined(UTF8_HAVE_SSSE3)
+
+/* Keiser and Lemire's lookup-table validator, "Validating UTF-8 In Less Than One Instruction Per Byte". Each byte is classified by the high nibble of the byte before it, the low nibble of the byte before it, and its own high nibble. Any error class that all three lookups agree on is an error, and a final check makes sure third and fourth bytes of longer sequences are continuations. */
+#define TOO_SHORT (1 << 0)
+#define TOO_LONG (1 << 1)
+#define OVERLONG_3 (1 << 2)
+#define TOO_LARGE (1 << 3)
+#define SURROGATE (1 << 4)
+#define OVERLONG_2 (1 << 5)
+#define TOO_LARGE_1000 (1 << 6)
+#define OVERLONG_4 (1 << 6)
+#define TWO_CONTS (1 << 7)
+#define CARRY (TOO_SHORT | TOO_LONG | TWO_CONTS)
+
+__attribute__((target("ssse3")))
+static inline __m128i utf8_block_errors(__m128i input,
+										__m128i prev_input)
+{
+	const __m128i byte_1_high_table = _mm_setr_epi8(
+		TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG,
+		TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG,
+		TWO_CONTS, TWO_CONTS, TWO_CONTS, TWO_CONTS,
+		TOO_SHORT | OVERLONG_2,
+		TOO_SHORT,
+		TOO_SHORT | OVERLONG_3 | SURROGATE,
+		TOO_SHORT | TOO_LARGE | TOO_LARGE_1000 | OVERLONG_4);
+	
+	const __m128i byte_1_low_table = _mm_setr_epi8(
+		CARRY | OVERLONG_3 | OVERLONG_2 | OVERLONG_4,
+		CARRY | OVERLONG_2,
+		CARRY,
+		CARRY,
+		CARRY | TOO_LARGE,
+		CARRY | TOO_LARGE | TOO_LARGE_1000,
+		CARRY | TOO_LARGE | TOO_LARGE_1000,
+		CARRY | TOO_LARGE | TOO_LARGE_1000,
+		CARRY | TOO_LARGE | TOO_LARGE_1000,
+		CARRY | TOO_LARGE | TOO_LARGE_1000,
+		CARRY | TOO_LARGE | TOO_LARGE_1000,
+		CARRY | TOO_LARGE | TOO_LARGE_1000,
+		CARRY | TOO_LARGE | TOO_LARGE_1000,
+		CARRY | TOO_LARGE | TOO_LARGE_1000 | SURROGATE,
+		CARRY | TOO_LARGE | TOO_LARGE_1000,
+		CARRY | TOO_LARGE | TOO_LARGE_1000);
+	
+	const __m128i byte_2_high_table = _mm_setr_epi8(
+		TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT,
+		TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT,
+		TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE_1000 | OVERLONG_4,
+		TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE,
+		TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE | TOO_LARGE,
+		TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE | TOO_LARGE,
+		TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT);
+	
+	const __m128i nibble = _mm_set1_epi8(0x0F);
+	
+	__m128i prev1 = _mm_alignr_epi8(input, prev_input, 15);
+	__m128i prev2 = _mm_alignr_epi8(input, prev_input, 14);
+	__m128i prev3 = _mm_alignr_epi8(input, prev_input, 13);
+	
+	__m128i byte_1_high = _mm_shuffle_epi8(byte_1_high_table, _mm_and_si128(_mm_srli_epi16(prev1, 4), nibble));
+	__m128i byte_1_low = _mm_shuffle_epi8(byte_1_low_table, _mm_and_si128(prev1, nibble));
+	__m128i byte_2_high = _mm_shuffle_epi8(byte_2_high_table, _mm_and_si128(_mm_srli_epi16(input, 4), nibble));
+	
+	__m128i special_cases = _mm_and_si128(_mm_and_si128(byte_1_high, byte_1_low), byte_2_high);
+	
+	// Bytes two or three places after a 3- or 4-byte lead must be continuations.
+	__m128i is_third_byte = _mm_subs_epu8(prev2, _mm_set1_epi8((char)(0xE0 - 0x80)));
+	__m128i is_fourth_byte = _mm_subs_epu8(prev3, _mm_set1_epi8((char)(0xF0 - 0x80)));
+	__m128i must_be_continuation = _mm_and_si128(_mm_or_si128(is_third_byte, is_fourth_byte), _mm_set1_epi8((char)0x80));
+	
+	return _mm_xor_si128(must_be_continuation, special_cases);
+}
+
+// Flags a block whose last bytes begin a sequence that needs more bytes than remain.
+__attribute__((target("ssse3")))
+static inline __m128i utf8_block_incomplete(__m128i input)
+{
+	const __m128i max_complete = _mm_setr_epi8(
+		(char)0xFF, (char)0xFF, (char)0xFF, (char)0xFF,
+		(char)0xFF, (char)0xFF, (char)0xFF, (char)0xFF,
+		(char)0xFF, (char)0xFF, (char)0xFF, (char)0xFF,
+		(char)0xFF, (char)(0xF0 - 1), (char)(0xE0 - 1), (char)(0xC0 - 1));
+	
+	return _mm_subs_epu8(input, max_complete);
+}
+
+__attribute__((target("ssse3")))
+static int utf8_is_valid_ssse3(const char *s,
+							   size_t len)
+{
+	__m128i error = _mm_setzero_si128();
+	__m128i prev_input = _mm_setzero_si128();
+	__m128i prev_incomplete = _mm_setzero_si128();
+	
+	size_t i = 0;
+	for (;;) {
+		__m128i input;
+		
+		if (i + 16 <= len) {
+			input = _mm_loadu_si128((const __m128i *)(s + i));
+		} else if (i < len) {
+			// Pad the tail with ASCII zeros, so a sequence cut off by the end shows up as incomplete.
+			char tail[16] = { 0 };
+			memcpy(tail, s + i, len - i);
+			input = _mm_loadu_si128((const __m128i *)tail);
+		} else {
+			break;
+		}
+		
+		if (_mm_movemask_epi8(input) == 0) {
+			error = _mm_or_si128(error, prev_incomplete);
+			prev_incomplete = _mm_setzero_si128();
+		} else {
+			error = _mm_or_si128(error, utf8_block_errors(input, prev_input));
+			prev_incomplete = utf8_block_incomplete(input);
+		}
+		
+		prev_input = input;
+		i += 16;
+	}
+	
+	error = _mm_or_si128(error, prev_incomplete);
+	
+	return _mm_movemask_epi8(_mm_cmpeq_epi8(error, _mm_setzero_si128())) == 0xFFFF;
+}
+
+#endif
+
+size_t utf8_validate(const char *s,
+					 size_t len)
+{
+#if defined(UTF8_HAVE_SSSE3)
+	static int have_ssse3 = -1;
+	if (have_ssse3 < 0)
+		have_ssse3 = __builtin_cpu_supports("ssse3");
+	
+	// The vector validator only says whether there is an error. Only then do we pay for the scalar pass that finds where.
+	if (have_ssse3 && utf8_is_valid_ssse3(s, len))
+		return len;
+#endif
+	
+	return utf8_validate_scalar((const unsigned char *)s, len);
+}
@@ -0,0 +1,22 @@
+
+#ifndef UTF8_h
+#define UTF8_h
+
+#include <stddef.h>
+
+/** Returns the number of UTF-16 code units needed to encode the UTF-8 string
+ * `s` of `len` bytes. Counting starts and stops at byte boundaries, so a
+ * character cut off at either end is counted if its first byte is in range.
+ */
+size_t utf8_count_utf16_units(const char *s,
+							  size_t len);
+
+/** Checks that `s` holds `len` bytes of well-formed UTF-8, rejecting overlong
+ * encodings, surrogates, code points above U+10FFFF, and sequences cut off by
+ * the end of `s`. Returns `len` if `s` is valid, otherwise the offset of the
+ * first byte of the first invalid sequence.
+ */
+size_t utf8_validate(const char *s,
+					 size_t len);
+
+#endif /* UTF8_h */
@@ -0,0 +1,139 @@
+
+#include "Visitor.h"
+
+#include "mem.h"
+
+typedef struct
+{
+	uint32_t mask;
+	VisitorCallback callback;
+	void *data;
+} Visitor;
+
+struct VisitorSet
+{
+	Visitor *visitors;
+	size_t len;
+	size_t cap;
+	
+	// Visitor indices grouped by node type, so that dispatching an event only touches interested visitors.
+	size_t *dispatch;
+	size_t first[S_NODE_TYPE_COUNT + 1];
+	int descend[S_NODE_TYPE_COUNT];
+	uint32_t mask;
+	int dirty;
+};
+
+VisitorSet *visitor_set_new()
+{
+	VisitorSet *set = c_calloc(1, sizeof(VisitorSet));
+	
+	size_t cap = 4;
+	
+	set->visitors = c_malloc(cap * sizeof(Visitor));
+	set->cap = cap;
+	
+	return set;
+}
+
+void visitor_set_free(VisitorSet *set)
+{
+	free(set->visitors);
+	free(set->dispatch);
+	
+	free(set);
+}
+
+void visitor_set_add(VisitorSet *set,
+					 uint32_t mask,
+					 VisitorCallback callback,
+					 void *data)
+{
+	if (set->len >= set->cap) {
+		set->cap *= 2;
+		set->visitors = c_realloc(set->visitors, set->cap * sizeof(Visitor));
+	}
+	
+	Visitor v = { mask & S_NODE_MASK_ALL, callback, data };
+	set->visitors[set->len++] = v;
+	
+	set->mask |= v.mask;
+	set->dirty = 1;
+}
+
+static void visitor_set_build_dispatch(VisitorSet *set)
+{
+	size_t total = 0;
+	for (size_t t = 0; t < S_NODE_TYPE_COUNT; ++t) {
+		set->first[t] = total;
+		for (size_t i = 0; i < set->len; ++i) {
+			if (set->visitors[i].mask & S_NODE_MASK(t))
+				++total;
+		}
+	}
+	set->first[S_NODE_TYPE_COUNT] = total;
+	
+	set->dispatch = c_realloc(set->dispatch, (total + 1) * sizeof(size_t));
+	
+	size_t j = 0;
+	for (size_t t = 0; t < S_NODE_TYPE_COUNT; ++t) {
+		for (size_t i = 0; i < set->len; ++i) {
+			if (set->visitors[i].mask & S_NODE_MASK(t))
+				set->dispatch[j++] = i;
+		}
+	}
+	
+	for (size_t t = 0; t < S_NODE_TYPE_COUNT; ++t)
+		set->descend[t] = (ast_node_type_descendant_mask(t) & set->mask) != 0;
+	
+	set->dirty = 0;
+}
+
+static inline void visitor_set_dispatch(VisitorSet *set,
+										ASTNode *node,
+										WalkerEvent event)
+{
+	if (!(set->mask & S_NODE_MASK(node->type)))
+		return;
+	
+	size_t end = set->first[node->type + 1];
+	for (size_t i = set->first[node->type]; i < end; ++i) {
+		Visitor *v = set->visitors + set->dispatch[i];
+		v->callback(node, event, v->data);
+	}
+}
+
+// Walks the tree in the same order as `Walker`, but keeps its state on the stack and follows parent links back up, so a walk allocates nothing.
+void visitor_set_walk(VisitorSet *set,
+					  ASTNode *root)
+{
+	if (set->dirty)
+		visitor_set_build_dispatch(set);
+	
+	if (!set->mask)
+		return;
+	
+	ASTNode *node = root;
+	visitor_set_dispatch(set, node, EVENT_ENTER);
+	
+	for (;;) {
+		if (node->first_child && set->descend[node->type]) {
+			node = node->first_child;
+			visitor_set_dispatch(set, node, EVENT_ENTER);
+			continue;
+		}
+		
+		visitor_set_dispatch(set, node, EVENT_EXIT);
+		
+		while (node != root && !node->next) {
+			node = node->parent;
+			visitor_set_dispatch(set, node, EVENT_EXIT);
+		}
+		
+		if (node == root)
+			break;
+		
+		node = node->next;
+		visitor_set_dispatch(set, node, EVENT_ENTER);
+	}
+}
@@ -0,0 +1,33 @@
+
+#ifndef Visitor_h
+#define Visitor_h
+
+#include <stdint.h>
+
+#include "nodes.h"
+#include "Walker.h"
+
+typedef void (*VisitorCallback)(ASTNode *node,
+								WalkerEvent event,
+								void *data);
+
+/** A VisitorSet fans a single depth-first walk out to any number of visitors.
+ * Each visitor registers a mask of the node types it's interested in (see
+ * `S_NODE_MASK`) and only receives ENTER/EXIT events for those types.
+ * Subtrees that can't contain any registered type are skipped entirely.
+ */
+typedef struct VisitorSet VisitorSet;
+
+VisitorSet *visitor_set_new(void);
+
+void visitor_set_free(VisitorSet *set);
+
+void visitor_set_add(VisitorSet *set,
+					 uint32_t mask,
+					 VisitorCallback callback,
+					 void *data);
+
+void visitor_set_walk(VisitorSet *set,
+					  ASTNode *root);
+
+#endif /* Visitor_h */
@@ -0,0 +1,95 @@
+
+#include "WordCounter.h"
+
+#include <string.h>
+
+#include "SWAR.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+static inline int is_word_space(char c)
+{
+	return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+// Sets bit 7 of each whitespace byte of `w`.
+static inline uint64_t space_bytes(uint64_t w)
+{
+	return zero_bytes(w ^ (ONES * ' ')) | zero_bytes(w ^ (ONES * '\t')) | zero_bytes(w ^ (ONES * '\n')) | zero_bytes(w ^ (ONES * '\r'));
+}
+
+/* A word starts at every byte that isn't whitespace but follows a byte that is. Both vector paths build a whitespace mask, shift it by one byte with the last byte of the previous block carried in, and count the bits where the two disagree in that direction. */
+uint32_t word_counter_count(const char *s,
+							size_t len,
+							int *after_space)
+{
+	uint32_t words = 0;
+	unsigned carry = *after_space ? 1 : 0;
+	size_t i = 0;
+
+#if defined(__SSE2__)
+	const __m128i space = _mm_set1_epi8(' ');
+	const __m128i tab = _mm_set1_epi8('\t');
+	const __m128i lf = _mm_set1_epi8('\n');
+	const __m128i cr = _mm_set1_epi8('\r');
+	
+	for (; i + 16 <= len; i += 16) {
+		__m128i v = _mm_loadu_si128((const __m128i *)(s + i));
+		
+		__m128i spaces = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, space), _mm_cmpeq_epi8(v, tab)),
+									  _mm_or_si128(_mm_cmpeq_epi8(v, lf), _mm_cmpeq_epi8(v, cr)));
+		
+		unsigned mask = (unsigned)_mm_movemask_epi8(spaces);
+		unsigned starts = ~mask & ((mask << 1) | carry) & 0xFFFF;
+		
+		words += popcount32(starts);
+		carry = mask >> 15;
+	}
+#endif
+	
+	for (; i + 8 <= len; i += 8) {
+		uint64_t w;
+		memcpy(&w, s + i, 8);
+		
+		uint64_t spaces = space_bytes(w);
+		uint64_t starts = ~spaces & ((spaces << 8) | ((uint64_t)carry << 7)) & HIGHS;
+		
+		words += popcount64(starts);
+		carry = (unsigned)(spaces >> 63);
+	}
+	
+	for (; i < len; ++i) {
+		unsigned next = is_word_space(s[i]);
+		words += carry & !next;
+		carry = next;
+	}
+	
+	*after_space = (int)carry;
+	
+	return words;
+}
+
+uint32_t word_counter_count_stream(ASTNode *stream,
+								   const char *source,
+								   uint32_t skip_mask)
+{
+	uint32_t words = 0;
+	int after_space = 1;
+	uint32_t i = stream->range.location;
+	
+	for (ASTNode *child = stream->first_child; child; child = child->next) {
+		if (!(skip_mask & S_NODE_MASK(child->type)))
+			continue;
+		
+		words += word_counter_count(source + i, child->range.location - i, &after_space);
+		
+		after_space = 1;
+		i = s_range_max(child->range);
+	}
+	
+	words += word_counter_count(source + i, s_range_max(stream->range) - i, &after_space);
+	
+	return words;
+}
@@ -0,0 +1,27 @@
+
+#ifndef WordCounter_h
+#define WordCounter_h
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "nodes.h"
+
+/** Counts the words that start in the `len` bytes at `s`, where a word is a
+ * run of anything but spaces, tabs and line breaks. `after_space` says
+ * whether the byte before `s` ended a word (pass 1 at the start of a text),
+ * and is updated so that counts can be chained across ranges.
+ */
+uint32_t word_counter_count(const char *s,
+							size_t len,
+							int *after_space);
+
+/** Counts the words in the inline stream `stream`, treating any direct child
+ * whose type is in `skip_mask` as whitespace. Markup stays part of the word
+ * it touches, so `**never**` is one word.
+ */
+uint32_t word_counter_count_stream(ASTNode *stream,
+								   const char *source,
+								   uint32_t skip_mask);
+
+#endif /* WordCounter_h */
@@ -2,16 +2,34 @@
 #include "cue.h"
 
 #include <stdio.h>
+#include <string.h>
 
 #include "mem.h"
 #include "Scanner.h"
 #include "inlines.h"
 #include "parser.h"
+#include "LineTable.h"
+#include "OffsetMap.h"
+#include "UTF8.h"
 
 struct CueDocument {
     const char *source;
     size_t length;
     ASTNode *root;
+    NodeIndex *node_index;
+    TableOfContents *toc;
+    CharacterIndex *characters;
+    ReferenceTable *references;
+    TextIndex *text_index;
+    LineTable *line_table;
+    OffsetMap *offset_map;
+    
+    // The children of root, in order.
+    ASTNode **blocks;
+    size_t block_count;
+    
+    // A hash of each block, computed by the first diff.
+    uint64_t *block_hashes;
 };
 
 CueDocument *cue_document_new(const char *source,
@@ -23,6 +41,16 @@ CueDocument *cue_document_new(const char *source,
     doc->source = source;
     doc->length = length;
     doc->root = root;
+    doc->node_index = NULL;
+    doc->toc = NULL;
+    doc->characters = NULL;
+    doc->references = NULL;
+    doc->text_index = NULL;
+    doc->line_table = NULL;
+    doc->offset_map = NULL;
+    doc->blocks = NULL;
+    doc->block_count = 0;
+    doc->block_hashes = NULL;
     
     return doc;
 }
@@ -31,6 +59,30 @@ void cue_document_free(CueDocument *doc)
 {
     //ast_node_free(doc->root);
     
+    if (doc->node_index)
+        node_index_free(doc->node_index);
+    
+    if (doc->toc)
+        table_of_contents_free(doc->toc);
+    
+    if (doc->characters)
+        character_index_free(doc->characters);
+    
+    if (doc->references)
+        reference_table_free(doc->references);
+    
+    if (doc->text_index)
+        text_index_free(doc->text_index);
+    
+    if (doc->line_table)
+        line_table_free(doc->line_table);
+    
+    if (doc->offset_map)
+        offset_map_free(doc->offset_map);
+    
+    free(doc->blocks);
+    free(doc->block_hashes);
+    
     free(doc);
 }
 
@@ -39,9 +91,319 @@ ASTNode *cue_document_get_root(CueDocument *doc)
     return doc->root;
 }
 
+const char *cue_document_get_source(CueDocument *doc)
+{
+    return doc->source;
+}
+
+size_t cue_document_get_length(CueDocument *doc)
+{
+    return doc->length;
+}
+
+TableOfContents *cue_document_get_table_of_contents(CueDocument *doc)
+{
+    return doc->toc;
+}
+
+CharacterIndex *cue_document_get_character_index(CueDocument *doc)
+{
+    return doc->characters;
+}
+
+static void cue_document_diff_input(CueDocument *doc,
+                                    DiffInput *input)
+{
+    if (!doc->block_hashes) {
+        doc->block_hashes = c_malloc((doc->block_count + 1) * sizeof(uint64_t));
+        diff_hash_blocks(doc->blocks, doc->block_count, doc->source, doc->block_hashes);
+    }
+    
+    input->blocks = doc->blocks;
+    input->hashes = doc->block_hashes;
+    input->count = doc->block_count;
+    input->source = doc->source;
+    input->length = (uint32_t)doc->length;
+}
+
+BlockDiff *cue_document_diff(CueDocument *old_doc,
+                             CueDocument *new_doc)
+{
+    DiffInput old_input;
+    DiffInput new_input;
+    
+    cue_document_diff_input(old_doc, &old_input);
+    cue_document_diff_input(new_doc, &new_input);
+    
+    return block_diff_compute(&old_input, &new_input);
+}
+
+ReferenceTable *cue_document_get_reference_table(CueDocument *doc)
+{
+    return doc->references;
+}
+
+TextIndex *cue_document_get_text_index(CueDocument *doc)
+{
+    return doc->text_index;
+}
+
+int cue_document_load_text_index(CueDocument *doc,
+                                 const void *data,
+                                 size_t size)
+{
+    TextIndex *index = text_index_deserialize(data, size, doc->source, doc->length);
+    if (!index)
+        return 0;
+    
+    if (doc->text_index)
+        text_index_free(doc->text_index);
+    
+    doc->text_index = index;
+    
+    return 1;
+}
+
+StatsTable *cue_document_compute_stats(CueDocument *doc,
+                                       int nthreads)
+{
+    return stats_table_compute(doc->blocks, doc->block_count, doc->source, (uint32_t)doc->length, nthreads);
+}
+
+void cue_document_render_html(CueDocument *doc,
+                              MarkupContext *ctx,
+                              int nthreads)
+{
+    render_html_parallel(ctx, doc->blocks, doc->block_count, doc->source, nthreads);
+}
+
+void cue_document_render_range(CueDocument *doc,
+                               SRange range,
+                               const RendererCallbacks *callbacks,
+                               void *info)
+{
+    render_range_with_callbacks(callbacks, doc->blocks, doc->block_count, range, doc->source, info);
+}
+
+size_t cue_document_highlight_spans(CueDocument *doc,
+                                    SRange visible,
+                                    CueSpan *out,
+                                    size_t cap)
+{
+    return highlight_spans(doc->blocks, doc->block_count, visible, doc->source, out, cap);
+}
+
+ASTNode **cue_document_get_blocks(CueDocument *doc,
+                                  size_t *count)
+{
+    *count = doc->block_count;
+    
+    return doc->blocks;
+}
+
+static int s_range_contains(SRange range,
+                            uint32_t offset)
+{
+    return range.location <= offset && offset < s_range_max(range);
+}
+
+ASTNode *cue_document_node_at_offset(CueDocument *doc,
+                                     uint32_t offset)
+{
+    // Find the last block that starts at or before offset.
+    size_t lo = 0;
+    size_t hi = doc->block_count;
+    
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        
+        if (doc->blocks[mid]->range.location <= offset)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    
+    if (!lo || !s_range_contains(doc->blocks[lo - 1]->range, offset))
+        return doc->root;
+    
+    // Children are ordered and disjoint, so at most one of them contains offset at each level.
+    ASTNode *node = doc->blocks[lo - 1];
+    ASTNode *child = node->first_child;
+    
+    while (child) {
+        if (s_range_contains(child->range, offset)) {
+            node = child;
+            child = node->first_child;
+        } else if (child->range.location > offset) {
+            break;
+        } else {
+            child = child->next;
+        }
+    }
+    
+    return node;
+}
+
+int cue_document_offset_to_line_col(CueDocument *doc,
+                                    uint32_t offset,
+                                    uint32_t *line,
+                                    uint32_t *column)
+{
+    return line_table_offset_to_line_col(doc->line_table, offset, line, column);
+}
+
+int cue_document_line_col_to_offset(CueDocument *doc,
+                                    uint32_t line,
+                                    uint32_t column,
+                                    uint32_t *offset)
+{
+    return line_table_line_col_to_offset(doc->line_table, doc->source, line, column, offset);
+}
+
+size_t cue_document_get_line_count(CueDocument *doc)
+{
+    return line_table_count(doc->line_table);
+}
+
+int cue_document_utf8_to_utf16_offset(CueDocument *doc,
+                                      uint32_t offset,
+                                      uint32_t *utf16_offset)
+{
+    if (!doc->offset_map)
+        return 0;
+    
+    return offset_map_utf8_to_utf16(doc->offset_map, doc->source, offset, utf16_offset);
+}
+
+int cue_document_utf16_to_utf8_offset(CueDocument *doc,
+                                      uint32_t utf16_offset,
+                                      uint32_t *offset)
+{
+    if (!doc->offset_map)
+        return 0;
+    
+    return offset_map_utf16_to_utf8(doc->offset_map, doc->source, utf16_offset, offset);
+}
+
+// Returns the scene header that `offset` falls under in the outline `context`, or NULL. An act ends its last scene, but forced, page and frame headers don't.
+static ASTNode *cue_document_scene_at(void *context,
+                                      uint32_t offset)
+{
+    TableOfContents *toc = context;
+    TOCEntry *entries = table_of_contents_get_entries(toc);
+    TOCEntry *entry = table_of_contents_entry_at_offset(toc, offset);
+    
+    for (; entry; entry = (entry > entries) ? entry - 1 : NULL) {
+        HeaderType type = entry->node->as.header.type;
+        
+        if (type <= HEADER_SCENE)
+            return (type == HEADER_SCENE) ? entry->node : NULL;
+    }
+    
+    return NULL;
+}
+
+void cue_document_update_header_numbers(CueDocument *doc,
+                                        ASTNode *header)
+{
+    // Insert the header into the list of blocks, and into the block hashes if a diff has made them.
+    size_t lo = 0;
+    size_t hi = doc->block_count;
+    
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        
+        if (doc->blocks[mid]->range.location < header->range.location)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    
+    doc->blocks = c_realloc(doc->blocks, (doc->block_count + 2) * sizeof(ASTNode*));
+    memmove(doc->blocks + lo + 1, doc->blocks + lo, (doc->block_count - lo) * sizeof(ASTNode*));
+    doc->blocks[lo] = header;
+    
+    if (doc->block_hashes) {
+        doc->block_hashes = c_realloc(doc->block_hashes, (doc->block_count + 2) * sizeof(uint64_t));
+        memmove(doc->block_hashes + lo + 1, doc->block_hashes + lo, (doc->block_count - lo) * sizeof(uint64_t));
+        diff_hash_blocks(&header, 1, doc->source, doc->block_hashes + lo);
+    }
+    
+    ++doc->block_count;
+    
+    if (doc->node_index)
+        node_index_insert_subtree(doc->node_index, header);
+    
+    // Resume counting from the closest header before this one.
+    HeaderCounter counter = { 0, 0, 0, 0 };
+    uint32_t numbers[HEADER_FORCED];
+    
+    TOCEntry *prev = table_of_contents_entry_at_offset(doc->toc, header->range.location);
+    if (prev)
+        header_counter_restore(&counter, prev->numbers);
+    
+    header_counter_number_header(&counter, header, doc->source, numbers);
+    
+    size_t p = table_of_contents_insert_header(doc->toc, header, numbers, (uint32_t)doc->length);
+    size_t count = table_of_contents_count(doc->toc);
+    TOCEntry *entries = table_of_contents_get_entries(doc->toc);
+    
+    // Each header's numbers only depend on the numbers before it, so once a header comes out unchanged so will every header after it.
+    for (size_t i = p + 1; i < count; ++i) {
+        header_counter_number_header(&counter, entries[i].node, doc->source, numbers);
+        
+        if (memcmp(numbers, entries[i].numbers, sizeof(numbers)) == 0)
+            break;
+        
+        table_of_contents_set_numbers(doc->toc, i, numbers);
+    }
+    
+    // The references between the new header and the next act or scene now fall under a different scene, or none.
+    if (doc->references && header->as.header.type <= HEADER_SCENE) {
+        size_t next = p + 1;
+        while (next < count && entries[next].node->as.header.type > HEADER_SCENE)
+            ++next;
+        
+        uint32_t end = (next < count) ? entries[next].range.location : (uint32_t)doc->length;
+        reference_table_update_scenes(doc->references, header->range.location, end, cue_document_scene_at, doc->toc);
+    }
+}
+
+size_t cue_document_count_nodes_of_type(CueDocument *doc,
+                                        ASTNodeType type)
+{
+    if (!doc->node_index)
+        return 0;
+    
+    return node_index_count(doc->node_index, type);
+}
+
+ASTNode *cue_document_get_node_of_type(CueDocument *doc,
+                                       ASTNodeType type,
+                                       size_t k)
+{
+    if (k >= cue_document_count_nodes_of_type(doc, type))
+        return NULL;
+    
+    return node_index_get_nodes(doc->node_index, type)[k];
+}
+
+ASTNode **cue_document_get_nodes_of_type(CueDocument *doc,
+                                         ASTNodeType type,
+                                         size_t *count)
+{
+    *count = cue_document_count_nodes_of_type(doc, type);
+    
+    if (!doc->node_index)
+        return NULL;
+    
+    return node_index_get_nodes(doc->node_index, type);
+}
+
 CueParser *cue_parser_new(NodeAllocator *node_allocator,
                           const char *source,
-                          uint32_t length)
+                          uint32_t length,
+                          int options)
 {
     CueParser *p = c_malloc(sizeof(CueParser));
     
@@ -49,6 +411,12 @@ CueParser *cue_parser_new(NodeAllocator *node_allocator,
     p->root = ast_node_new(node_allocator, S_NODE_DOCUMENT, 0, length);
     p->scanner = scanner_new(source, length);
     p->delimiter_stack = delimiter_stack_new();
+    p->options = options;
+    p->node_index = (options & CUE_PARSE_NODE_INDEX) ? node_index_new() : NULL;
+    p->toc = table_of_contents_new();
+    p->characters = (options & CUE_PARSE_CHARACTER_INDEX) ? character_index_new() : NULL;
+    p->references = (options & CUE_PARSE_REFERENCE_TABLE) ? reference_table_new() : NULL;
+    memset(&p->header_counter, 0, sizeof(HeaderCounter));
     p->bol = 0;
     p->eol = 0;
     p->first_nonspace = 0;
@@ -100,8 +468,22 @@ ASTNode *block_for_line(CueParser *parser)
     return block;
 }
 
-ASTNode *appropriate_container_for_block(CueParser *parser, ASTNode *block)
+// Releases `node` and its descendants in the reverse of the order they were allocated, so that a stack allocator can reclaim them.
+static void release_subtree(ASTNode *node)
 {
+    ASTNode *child = node->last_child;
+    while (child) {
+        ASTNode *prev = child->prev;
+        release_subtree(child);
+        child = prev;
+    }
+    
+    ast_node_free(node);
+}
+
+ASTNode *appropriate_container_for_block(CueParser *parser, ASTNode **block_ptr)
+{
+    ASTNode *block = *block_ptr;
     ASTNode *root = parser->root;
     NodeAllocator *node_allocator = parser->node_allocator;
     
@@ -134,7 +516,11 @@ ASTNode *appropriate_container_for_block(CueParser *parser, ASTNode *block)
                 ASTNode *line = block->first_child;
                 ASTNode *stream = line->first_child;
                 
+                // The facsimile still runs to the end of the raw line, but the line itself starts after its '>', like the first one.
+                ast_node_extend_length_to_include_child(last, block);
+                
                 block->type = S_NODE_LINE;
+                block->range = line->range;
                 
                 line->type = S_NODE_STREAM;
                 line->range = stream->range;
@@ -143,7 +529,6 @@ ASTNode *appropriate_container_for_block(CueParser *parser, ASTNode *block)
                 
                 ast_node_free(stream);
                 
-                ast_node_extend_length_to_include_child(last, block);
                 return last;
             }
             
@@ -176,11 +561,11 @@ ASTNode *appropriate_container_for_block(CueParser *parser, ASTNode *block)
     // invalid syntax, fail gracefully
     
     ast_node_unlink(block);
-    ast_node_free(block);
+    release_subtree(block);
     
     Scanner *s = parser->scanner;
     
-    block = ast_node_description_init(node_allocator, s->bol, s->wc, s->ewc - s->wc, s->eol - s->bol);
+    *block_ptr = ast_node_description_init(node_allocator, s->bol, s->wc, s->ewc - s->wc, s->eol - s->bol);
     
     return root;
 }
@@ -208,13 +593,10 @@ void finalize_line(CueParser *parser, ASTNode *block)
         case S_NODE_CUE: {
             ASTNode *dir = block->as.cue.direction;
             
-            ASTNode *newdir;
+            ASTNode *line;
             s->loc = dir->range.location;
-            if ((newdir = scan_for_lyric_line(s, node_allocator))) {
-                dir = newdir;
+            if ((line = scan_for_lyric_line(s, node_allocator))) {
                 dir->type = S_NODE_LYRIC_DIRECTION;
-                
-                ASTNode *line = ast_node_new(node_allocator, S_NODE_LINE, dir->range.location, dir->range.length);
                 ast_node_add_child(dir, line);
                 
                 parse_inlines_for_node(parser, line->first_child, 1);
@@ -233,13 +615,31 @@ void finalize_line(CueParser *parser, ASTNode *block)
 
 void process_line(CueParser *parser)
 {
+    ASTNode *root = parser->root;
+    ASTNode *last = root->last_child;
+    
     ASTNode *block = block_for_line(parser);
     
-    ASTNode *container = appropriate_container_for_block(parser, block);
+    ASTNode *container = appropriate_container_for_block(parser, &block);
     ast_node_add_child(container, block);
     
     finalize_line(parser, block);
     
+    if (block->type == S_NODE_HEADER) {
+        uint32_t numbers[HEADER_FORCED];
+        header_counter_number_header(&parser->header_counter, block, parser->scanner->source, numbers);
+        table_of_contents_add_header(parser->toc, block, numbers);
+    }
+    
+    if (parser->characters && block->type == S_NODE_CUE)
+        character_index_add_cue(parser->characters, block, parser->scanner->source);
+    
+    // Index only once the line is final, so nodes released or retyped while merging never reach the index. Everything new is either a new child of root or `block` itself, and either way it follows all indexed nodes in document order.
+    if (parser->node_index) {
+        ASTNode *added = (root->last_child != last) ? root->last_child : block;
+        node_index_add_subtree(parser->node_index, added);
+    }
+    
     return;
 }
 
@@ -247,18 +647,122 @@ CueDocument *cue_document_from_utf8(NodeAllocator *node_allocator,
                                     const char *source,
                                     size_t length)
 {
-    CueParser *parser = cue_parser_new(node_allocator, source, (uint32_t)length);
+    return cue_document_from_utf8_with_options(node_allocator, source, length, CUE_PARSE_DEFAULT);
+}
+
+CueDocument *cue_document_from_utf8_with_options(NodeAllocator *node_allocator,
+                                                 const char *source,
+                                                 size_t length,
+                                                 int options)
+{
+    return cue_document_from_utf8_checked(node_allocator, source, length, options, NULL);
+}
+
+// Lines are validated in batches of at least this many bytes, while they're still in cache.
+#define VALIDATE_BATCH_SIZE 4096
+
+CueDocument *cue_document_from_utf8_checked(NodeAllocator *node_allocator,
+                                            const char *source,
+                                            size_t length,
+                                            int options,
+                                            size_t *error_offset)
+{
+    CueParser *parser = cue_parser_new(node_allocator, source, (uint32_t)length, options);
+    
+    if (parser->node_index)
+        node_index_add_subtree(parser->node_index, parser->root);
     
     Scanner *scanner = parser->scanner;
     
+    LineTable *line_table = line_table_new();
+    OffsetMap *offset_map = (options & CUE_PARSE_UTF16_OFFSETS) ? offset_map_new() : NULL;
+    
+    int validate = options & CUE_PARSE_VALIDATE_UTF8;
+    size_t validated = 0;
+    size_t invalid = length;
+    
     // Enumerate lines
     while (scanner_advance_to_next_line(scanner) < length) {
+        line_table_add_line(line_table, source, scanner->bol);
+        
+        if (offset_map)
+            offset_map_extend(offset_map, source, scanner->eol);
+        
+        // A batch always ends after a line break, so no sequence is split between batches.
+        if (validate && scanner->eol - validated >= VALIDATE_BATCH_SIZE) {
+            size_t batch = scanner->eol - validated;
+            size_t valid = utf8_validate(source + validated, batch);
+            
+            if (valid < batch) {
+                invalid = validated + valid;
+                break;
+            }
+            
+            validated = scanner->eol;
+        }
+        
         if (!scanner_is_at_eol(scanner)) {
             process_line(parser);
         }
     }
     
+    if (validate && invalid == length)
+        invalid = validated + utf8_validate(source + validated, length - validated);
+    
+    if (invalid < length) {
+        if (error_offset)
+            *error_offset = invalid;
+        
+        line_table_free(line_table);
+        if (offset_map)
+            offset_map_free(offset_map);
+        if (parser->node_index)
+            node_index_free(parser->node_index);
+        table_of_contents_free(parser->toc);
+        if (parser->characters)
+            character_index_free(parser->characters);
+        if (parser->references)
+            reference_table_free(parser->references);
+        cue_parser_free(parser);
+        
+        return NULL;
+    }
+    
+    line_table_finalize(line_table, source, (uint32_t)length);
+    
+    if (offset_map)
+        offset_map_finalize(offset_map, source, (uint32_t)length);
+    
+    table_of_contents_finalize(parser->toc, (uint32_t)length);
+    
+    // Lyric lines keep joining their cue until the next block, so counts wait until everything is parsed.
+    if (parser->characters)
+        character_index_finalize(parser->characters, source);
+    
+    if (parser->references)
+        reference_table_finalize(parser->references, parser->root);
+    
     CueDocument *doc = cue_document_new(source, length, parser->root);
+    doc->node_index = parser->node_index;
+    doc->toc = parser->toc;
+    doc->characters = parser->characters;
+    doc->references = parser->references;
+    doc->line_table = line_table;
+    doc->offset_map = offset_map;
+    
+    size_t block_count = 0;
+    for (ASTNode *block = doc->root->first_child; block; block = block->next)
+        ++block_count;
+    
+    doc->blocks = c_malloc((block_count + 1) * sizeof(ASTNode*));
+    doc->block_count = block_count;
+    
+    size_t i = 0;
+    for (ASTNode *block = doc->root->first_child; block; block = block->next)
+        doc->blocks[i++] = block;
+    
+    if (options & CUE_PARSE_TEXT_INDEX)
+        doc->text_index = text_index_build(doc->root, source, length);
     
     cue_parser_free(parser);
     
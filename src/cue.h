@@ -7,9 +7,52 @@
 
 #include "nodes.h"
 #include "Walker.h"
+#include "Visitor.h"
+#include "Query.h"
+#include "TableOfContents.h"
+#include "CharacterIndex.h"
+#include "Stats.h"
+#include "TextIndex.h"
+#include "ReferenceTable.h"
+#include "Diff.h"
+#include "Escape.h"
+#include "Renderer.h"
+#include "HTML.h"
+#include "JSON.h"
+#include "Template.h"
+#include "RenderCache.h"
+#include "Outline.h"
+#include "Pagination.h"
+#include "Highlight.h"
 
 typedef struct CueDocument CueDocument;
 
+/** Options for `cue_document_from_utf8_with_options`, combined with `|`. */
+#define CUE_PARSE_DEFAULT 0
+
+/** Keep an index of every node by type, in document order. */
+#define CUE_PARSE_NODE_INDEX (1 << 0)
+
+/** Keep a map between UTF-8 byte offsets and UTF-16 code unit offsets. */
+#define CUE_PARSE_UTF16_OFFSETS (1 << 1)
+
+/** Reject sources that aren't valid UTF-8. Once at least 4 KB of lines
+ * have been split and parsed, their bytes are validated in one batch while
+ * they're still in cache, so the check costs a few percent of parse time.
+ * Lines are parsed before they're validated, but nothing is returned if any
+ * batch fails.
+ */
+#define CUE_PARSE_VALIDATE_UTF8 (1 << 2)
+
+/** Group cues by character name as they're parsed. */
+#define CUE_PARSE_CHARACTER_INDEX (1 << 3)
+
+/** Build a full-text index of the document's words once it's parsed. */
+#define CUE_PARSE_TEXT_INDEX (1 << 4)
+
+/** Group references by target as they're parsed. */
+#define CUE_PARSE_REFERENCE_TABLE (1 << 5)
+
 NodeAllocator *stack_allocator_new(void);
 
 void stack_allocator_free(NodeAllocator *node_allocator);
@@ -23,10 +66,177 @@ CueDocument *cue_document_from_utf8(NodeAllocator *node_allocator,
 									const char *source,
 									size_t length);
 
+/** Creates a CueDocument using the `CUE_PARSE_*` flags in `options`. Returns
+ * NULL if `CUE_PARSE_VALIDATE_UTF8` is set and `source` isn't valid UTF-8.
+ */
+CueDocument *cue_document_from_utf8_with_options(NodeAllocator *node_allocator,
+												 const char *source,
+												 size_t length,
+												 int options);
+
+/** Like `cue_document_from_utf8_with_options`, but when validation fails the
+ * byte offset of the first invalid sequence is stored in `error_offset`.
+ * Nodes created before the error are left in `node_allocator`.
+ */
+CueDocument *cue_document_from_utf8_checked(NodeAllocator *node_allocator,
+											const char *source,
+											size_t length,
+											int options,
+											size_t *error_offset);
+
 void cue_document_free(CueDocument *doc);
 
 ASTNode *cue_document_get_root(CueDocument *doc);
 
-void *cue_document_get_table_of_contents(CueDocument *doc);
+const char *cue_document_get_source(CueDocument *doc);
+
+size_t cue_document_get_length(CueDocument *doc);
+
+/** Returns the children of `doc`'s root in order and stores their number in
+ * `count`.
+ */
+ASTNode **cue_document_get_blocks(CueDocument *doc,
+								  size_t *count);
+
+/** Returns the deepest node whose range contains `offset`, or the root if no
+ * block does. Runs in O(log n) in the number of blocks.
+ */
+ASTNode *cue_document_node_at_offset(CueDocument *doc,
+									 uint32_t offset);
+
+/** Converts a byte offset into a 0-based line and byte column. Returns 0 if
+ * `offset` is past the end of the document.
+ */
+int cue_document_offset_to_line_col(CueDocument *doc,
+									uint32_t offset,
+									uint32_t *line,
+									uint32_t *column);
+
+/** Converts a 0-based line and byte column into a byte offset, clamping the
+ * column to the end of the line. Returns 0 if there is no such line.
+ */
+int cue_document_line_col_to_offset(CueDocument *doc,
+									uint32_t line,
+									uint32_t column,
+									uint32_t *offset);
+
+size_t cue_document_get_line_count(CueDocument *doc);
+
+/** Converts a byte offset into a UTF-16 code unit offset. Requires
+ * `CUE_PARSE_UTF16_OFFSETS`. Returns 0 if the map wasn't built or `offset` is
+ * past the end of the document.
+ */
+int cue_document_utf8_to_utf16_offset(CueDocument *doc,
+									  uint32_t offset,
+									  uint32_t *utf16_offset);
+
+/** Converts a UTF-16 code unit offset into the byte offset of the character
+ * that contains it. Requires `CUE_PARSE_UTF16_OFFSETS`. Returns 0 if the map
+ * wasn't built or `utf16_offset` is past the end of the document.
+ */
+int cue_document_utf16_to_utf8_offset(CueDocument *doc,
+									  uint32_t utf16_offset,
+									  uint32_t *offset);
+
+/** Numbers `header`, a header that has just been inserted among the root's
+ * children, and renumbers any later headers whose numbers it changes.
+ * Numbers are otherwise resolved while parsing and kept in the table of
+ * contents. The header is added in place to the table of contents, the list
+ * of blocks used for rendering and diffing, and the node index, and the
+ * references it moves into another scene are updated. The character index
+ * is unaffected, but neither the reference table nor the text index learns
+ * about the words and references in the header's own title.
+ */
+void cue_document_update_header_numbers(CueDocument *doc,
+										ASTNode *header);
+
+/** Returns the number of nodes of `type` in `doc`. Requires
+ * `CUE_PARSE_NODE_INDEX`, otherwise returns 0.
+ */
+size_t cue_document_count_nodes_of_type(CueDocument *doc,
+										ASTNodeType type);
+
+/** Returns the `k`th node of `type` in document order, or NULL if there is
+ * no such node. Requires `CUE_PARSE_NODE_INDEX`.
+ */
+ASTNode *cue_document_get_node_of_type(CueDocument *doc,
+									   ASTNodeType type,
+									   size_t k);
+
+/** Returns every node of `type` in document order and stores their number in
+ * `count`. Requires `CUE_PARSE_NODE_INDEX`, otherwise returns NULL.
+ */
+ASTNode **cue_document_get_nodes_of_type(CueDocument *doc,
+										 ASTNodeType type,
+										 size_t *count);
+
+/** Returns the outline of `doc`'s headers. The outline is built while parsing,
+ * so this costs nothing.
+ */
+TableOfContents *cue_document_get_table_of_contents(CueDocument *doc);
+
+/** Returns `doc`'s cues grouped by character. Requires
+ * `CUE_PARSE_CHARACTER_INDEX`, otherwise returns NULL.
+ */
+CharacterIndex *cue_document_get_character_index(CueDocument *doc);
+
+/** Finds the blocks that were inserted, deleted or modified between
+ * `old_doc` and `new_doc`, along with the words that changed inside each
+ * modified block. Block hashes are computed on first use and kept with each
+ * document, so diffing against the same draft again only costs as much as
+ * the changes. Free the result with `block_diff_free`.
+ */
+BlockDiff *cue_document_diff(CueDocument *old_doc,
+							 CueDocument *new_doc);
+
+/** Returns `doc`'s references grouped by target. Requires
+ * `CUE_PARSE_REFERENCE_TABLE`, otherwise returns NULL.
+ */
+ReferenceTable *cue_document_get_reference_table(CueDocument *doc);
+
+/** Returns the full-text index of `doc`. Requires `CUE_PARSE_TEXT_INDEX` or a
+ * successful `cue_document_load_text_index`, otherwise returns NULL.
+ */
+TextIndex *cue_document_get_text_index(CueDocument *doc);
+
+/** Replaces `doc`'s full-text index with one read from `data`, which was
+ * written by `text_index_serialize` for the same source. Returns 0 and keeps
+ * the current index if `data` doesn't match.
+ */
+int cue_document_load_text_index(CueDocument *doc,
+								 const void *data,
+								 size_t size);
+
+/** Computes word, cue and length statistics for every section of `doc`, on
+ * up to `nthreads` threads. Free the result with `stats_table_free`.
+ */
+StatsTable *cue_document_compute_stats(CueDocument *doc,
+									   int nthreads);
+
+/** Renders `doc` as HTML into `ctx`, sharing its blocks out between up to
+ * `nthreads` threads. The output is the same whatever the thread count.
+ */
+void cue_document_render_html(CueDocument *doc,
+							  MarkupContext *ctx,
+							  int nthreads);
+
+/** Renders the nodes of `doc` that intersect `range` with `callbacks`,
+ * opening and closing the containers around them, so that redrawing a
+ * viewport costs in proportion to the text it shows. See
+ * `render_range_with_callbacks`.
+ */
+void cue_document_render_range(CueDocument *doc,
+							   SRange range,
+							   const RendererCallbacks *callbacks,
+							   void *info);
+
+/** Fills `out` with up to `cap` syntax-highlighting spans for the source in
+ * `visible` and returns how many there are, without allocating. See
+ * `highlight_spans`.
+ */
+size_t cue_document_highlight_spans(CueDocument *doc,
+									SRange visible,
+									CueSpan *out,
+									size_t cap);
 
 #endif /* cue_h */
@@ -159,6 +159,10 @@ void construct_ast(CueParser *parser, ASTNode *node, uint32_t ewc)
 			last_idx = s_range_max(tok->range);
 		} else if (tok->event == EVENT_EXIT) {
             active_parent->range.length = s_range_max(tok->range) - active_parent->range.location;
+			
+			if (parser->references && active_parent->type == S_NODE_REFERENCE)
+				reference_table_add(parser->references, active_parent, parser->scanner->source);
+			
 			active_parent = active_parent->parent;
 			last_idx = s_range_max(tok->range);
 		}
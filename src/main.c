@@ -5,9 +5,25 @@
 #include <stdio.h>
 #include <errno.h>
 #include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
 
 #define CUE_OPTION_BENCH 1 << 0
 #define CUE_OPTION_AST 1 << 1
+#define CUE_OPTION_QUERY 1 << 2
+#define CUE_OPTION_TOC 1 << 3
+#define CUE_OPTION_OUTLINE 1 << 4
+#define CUE_OPTION_CHARACTERS 1 << 5
+#define CUE_OPTION_STATS 1 << 6
+#define CUE_OPTION_SEARCH 1 << 7
+#define CUE_OPTION_REFERENCES 1 << 8
+#define CUE_OPTION_PREVIEW 1 << 9
+#define CUE_OPTION_HTML 1 << 10
+#define CUE_OPTION_ESCAPE 1 << 11
+#define CUE_OPTION_RANGE 1 << 12
+#define CUE_OPTION_JSON 1 << 13
+#define CUE_OPTION_PAGES 1 << 14
+#define CUE_OPTION_HIGHLIGHT 1 << 15
 
 typedef struct {
 	uint32_t type;
@@ -18,6 +34,19 @@ typedef struct {
 	size_t num_file_paths;
 	int bench_iterations;
 	int options;
+	const char *query;
+	const char *character;
+	const char *reference;
+	const char *diff;
+	int parse_options;
+	int threads;
+	const char *search;
+	uint32_t search_tags;
+	const char *read_index;
+	const char *write_index;
+	SRange range;
+	const char *template;
+	const char *write_template;
 } CLIRequest;
 
 CLIRequest *cli_request_new(const char *file_paths[],
@@ -31,6 +60,19 @@ CLIRequest *cli_request_new(const char *file_paths[],
 	req->num_file_paths = num_file_paths;
 	req->bench_iterations = bench_iterations;
 	req->options = options;
+	req->query = NULL;
+	req->character = NULL;
+	req->reference = NULL;
+	req->diff = NULL;
+	req->parse_options = CUE_PARSE_DEFAULT;
+	req->threads = 1;
+	req->search = NULL;
+	req->search_tags = TEXT_TAG_MASK_ALL;
+	req->read_index = NULL;
+	req->write_index = NULL;
+	req->range = (SRange){ 0, 0 };
+	req->template = NULL;
+	req->write_template = NULL;
 	
 	return req;
 }
@@ -68,7 +110,8 @@ void string_free(String *str)
 
 void benchmark_parsing_string(String *str,
 							  const char *file_name,
-							  int iterations)
+							  int iterations,
+							  int parse_options)
 {
 	clock_t clocks = 0;
 	
@@ -78,8 +121,9 @@ void benchmark_parsing_string(String *str,
 		clock_t t1 = clock();
 		
 		stack_allocator_reset(alloc);
-		CueDocument *doc = cue_document_from_utf8(alloc, str->buff, str->len);
-		cue_document_free(doc);
+		CueDocument *doc = cue_document_from_utf8_with_options(alloc, str->buff, str->len, parse_options);
+		if (doc)
+			cue_document_free(doc);
 		
 		clock_t t2 = clock();
 		
@@ -95,8 +139,285 @@ void benchmark_parsing_string(String *str,
 	double ticks = ((double)clocks / (double)iterations);
 	double time = ticks / (double)CLOCKS_PER_SEC;
 	
-	printf("Averaged %f seconds parsing %s over %i iterations.\n", time,
+	printf("Averaged %f seconds (%.3f GB/s) parsing %s over %i iterations.\n", time,
+		   str->len / time / 1e9, file_name, iterations);
+}
+
+void count_outline_item(const OutlineItem *item,
+						void *data)
+{
+	++*(size_t *)data;
+}
+
+void benchmark_outline_string(String *str,
+							  const char *file_name,
+							  int iterations)
+{
+	clock_t clocks = 0;
+	size_t headers = 0;
+	
+	for (int i = 0; i < iterations; ++i) {
+		clock_t t1 = clock();
+		
+		headers = 0;
+		cue_scan_outline(str->buff, str->len, count_outline_item, &headers);
+		
+		clock_t t2 = clock();
+		
+		clocks += t2 - t1;
+	}
+	
+	double ticks = ((double)clocks / (double)iterations);
+	double time = ticks / (double)CLOCKS_PER_SEC;
+	
+	printf("Averaged %f seconds (%.3f GB/s) scanning %zu headers in %s over %i iterations.\n", time,
+		   str->len / time / 1e9, headers, file_name, iterations);
+}
+
+// Statistics run on several threads, so their benchmark measures wall time rather than CPU time.
+static double wall_time(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+void benchmark_stats_string(String *str,
+							const char *file_name,
+							int iterations,
+							int max_threads)
+{
+	NodeAllocator *alloc = stack_allocator_new();
+	CueDocument *doc = cue_document_from_utf8(alloc, str->buff, str->len);
+	
+	for (int threads = 1; threads <= max_threads; threads = (threads * 2 > max_threads && threads < max_threads) ? max_threads : threads * 2) {
+		double t1 = wall_time();
+		
+		for (int i = 0; i < iterations; ++i)
+			stats_table_free(cue_document_compute_stats(doc, threads));
+		
+		double time = (wall_time() - t1) / iterations;
+		
+		printf("Averaged %f seconds (%.3f GB/s) computing stats for %s on %i threads over %i iterations.\n", time,
+			   str->len / time / 1e9, file_name, threads, iterations);
+	}
+	
+	cue_document_free(doc);
+	stack_allocator_free(alloc);
+}
+
+void benchmark_search_string(String *str,
+							 const char *file_name,
+							 int iterations,
+							 const char *search,
+							 uint32_t tags)
+{
+	NodeAllocator *alloc = stack_allocator_new();
+	CueDocument *doc = cue_document_from_utf8(alloc, str->buff, str->len);
+	
+	double t1 = wall_time();
+	TextIndex *index = text_index_build(cue_document_get_root(doc), str->buff, str->len);
+	double build_time = wall_time() - t1;
+	
+	printf("Built an index of %zu terms (%zu bytes) for %s in %f seconds.\n", text_index_term_count(index),
+		   text_index_serialized_size(index), file_name, build_time);
+	
+	size_t cap = 64;
+	TextMatch *matches = malloc(sizeof(TextMatch) * cap);
+	size_t count = 0;
+	
+	t1 = wall_time();
+	
+	for (int i = 0; i < iterations; ++i)
+		count = text_index_search(index, search, strlen(search), tags, matches, cap);
+	
+	double time = (wall_time() - t1) / iterations;
+	
+	printf("Averaged %f ms finding %zu matches of \"%s\" in %s over %i iterations.\n", time * 1e3, count, search,
 		   file_name, iterations);
+	
+	free(matches);
+	text_index_free(index);
+	cue_document_free(doc);
+	stack_allocator_free(alloc);
+}
+
+void print_query_matches(const char *selector,
+						 ASTNode *root,
+						 String *str)
+{
+	size_t error_offset;
+	CueQuery *query = cue_query_compile(selector, strlen(selector), &error_offset);
+	
+	if (!query) {
+		printf("Error compiling query at offset %zu.\n", error_offset);
+		return;
+	}
+	
+	size_t cap = 64;
+	ASTNode **matches = malloc(sizeof(ASTNode*) * cap);
+	
+	size_t count = cue_query_run(query, root, str->buff, matches, cap);
+	if (count > cap) {
+		cap = count;
+		matches = realloc(matches, sizeof(ASTNode*) * cap);
+		cue_query_run(query, root, str->buff, matches, cap);
+	}
+	
+	for (size_t i = 0; i < count; ++i) {
+		ASTNode *match = matches[i];
+		
+		ast_node_print_description(match, 0);
+		printf(" %.*s\n", (int)match->range.length, str->buff + match->range.location);
+	}
+	
+	free(matches);
+	cue_query_free(query);
+}
+
+void print_table_of_contents(TableOfContents *toc,
+							 String *str)
+{
+	TOCEntry *entries = table_of_contents_get_entries(toc);
+	size_t count = table_of_contents_count(toc);
+	
+	for (size_t i = 0; i < count; ++i) {
+		TOCEntry *entry = entries + i;
+		ASTNode *keyword = entry->node->as.header.keyword;
+		ASTNode *title = entry->node->as.header.title;
+		
+		for (uint32_t d = 0; d < entry->depth; ++d)
+			printf("| ");
+		
+		printf("%.*s %u", (int)keyword->range.length, str->buff + keyword->range.location, entry->number);
+		
+		if (title)
+			printf(" - %.*s", (int)title->range.length, str->buff + title->range.location);
+		
+		printf(" {%u, %u}\n", entry->body.location, entry->body.length);
+	}
+}
+
+void print_characters(CharacterIndex *characters)
+{
+	CharacterEntry *entries = character_index_get_entries(characters);
+	size_t count = character_index_count(characters);
+	
+	for (size_t i = 0; i < count; ++i) {
+		CharacterEntry *entry = entries + i;
+		
+		printf("%s: %u cues, %u lines, %u words\n", entry->name, entry->cue_count, entry->line_count, entry->word_count);
+	}
+}
+
+void print_dialogue(CharacterIndex *characters,
+					const char *name,
+					String *str)
+{
+	CharacterEntry *entry = character_index_lookup(characters, name, strlen(name));
+	
+	if (!entry) {
+		printf("No cues for %s.\n", name);
+		return;
+	}
+	
+	for (uint32_t i = 0; i < entry->cue_count; ++i) {
+		ASTNode *dir = entry->cues[i]->as.cue.direction;
+		
+		if (dir->type == S_NODE_LYRIC_DIRECTION) {
+			for (ASTNode *line = dir->first_child; line; line = line->next)
+				printf("%s: ~%.*s\n", entry->name, (int)line->first_child->range.length, str->buff + line->first_child->range.location);
+		} else {
+			printf("%s: %.*s\n", entry->name, (int)dir->range.length, str->buff + dir->range.location);
+		}
+	}
+}
+
+void print_references(ReferenceTable *references,
+					  TableOfContents *toc)
+{
+	ReferenceEntry *entries = reference_table_get_entries(references);
+	size_t count = reference_table_count(references);
+	
+	for (size_t i = 0; i < count; ++i) {
+		ReferenceEntry *entry = entries + i;
+		
+		printf("%.*s: %u uses", (int)entry->target_length, entry->target, entry->occurrence_count);
+		
+		for (uint32_t s = 0; s < entry->scene_count; ++s)
+			printf("%s%u", s ? ", " : " in scenes ", table_of_contents_entry_for_header(toc, entry->scenes[s])->number);
+		
+		printf("\n");
+	}
+}
+
+void print_reference_scenes(ReferenceTable *references,
+							const char *target,
+							String *str)
+{
+	ReferenceEntry *entry = reference_table_lookup(references, target, strlen(target));
+	
+	if (!entry) {
+		printf("No references to %s.\n", target);
+		return;
+	}
+	
+	for (uint32_t s = 0; s < entry->scene_count; ++s) {
+		ASTNode *scene = entry->scenes[s];
+		uint32_t length = scene->range.length;
+		
+		while (length && (str->buff[scene->range.location + length - 1] == '\n' || str->buff[scene->range.location + length - 1] == '\r'))
+			--length;
+		
+		printf("%.*s\n", (int)length, str->buff + scene->range.location);
+	}
+}
+
+void print_stats(StatsTable *table,
+				 String *str)
+{
+	SectionStats *sections = stats_table_get_sections(table);
+	size_t count = stats_table_count(table);
+	
+	printf("%-32s %8s %8s %6s %6s %6s %7s\n", "Section", "Desc", "Dialog", "Cues", "Chars", "Lyrics", "Pages");
+	
+	for (size_t i = 0; i <= count; ++i) {
+		SectionStats *stats = (i < count) ? sections + i : stats_table_get_totals(table);
+		
+		const char *name = "(untitled)";
+		int name_length = 10;
+		
+		if (i == count) {
+			name = "Total";
+			name_length = 5;
+		} else if (stats->header) {
+			name = str->buff + stats->header->range.location;
+			name_length = stats->header->range.length < 32 ? (int)stats->header->range.length : 32;
+			
+			while (name_length && (name[name_length - 1] == '\n' || name[name_length - 1] == '\r'))
+				--name_length;
+		}
+		
+		printf("%-32.*s %8u %8u %6u %6u %6u %3u %u/8\n", name_length, name, stats->description_words, stats->dialogue_words,
+			   stats->cue_count, stats->speaking_characters, stats->lyric_lines, stats->page_eighths / 8, stats->page_eighths % 8);
+	}
+}
+
+void print_outline_item(const OutlineItem *item,
+						void *data)
+{
+	String *str = data;
+	
+	printf("%.*s", (int)item->keyword.length, str->buff + item->keyword.location);
+	
+	if (item->identifier.length)
+		printf(" %.*s", (int)item->identifier.length, str->buff + item->identifier.location);
+	
+	if (item->title.length)
+		printf(" - %.*s", (int)item->title.length, str->buff + item->title.location);
+	
+	printf(" {%u, %u}\n", item->range.location, item->range.length);
 }
 
 String *string_from_file_path(const char *file_path)
@@ -122,6 +443,937 @@ String *string_from_file_path(const char *file_path)
 	return str;
 }
 
+static const char *text_tag_names[TEXT_TAG_COUNT] = { "description", "dialogue", "lyric", "facsimile", "title" };
+
+// Reads a comma separated list of tag names into a mask.
+uint32_t parse_text_tags(const char *list)
+{
+	uint32_t mask = 0;
+	
+	while (*list) {
+		size_t len = strcspn(list, ",");
+		
+		for (int tag = 0; tag < TEXT_TAG_COUNT; ++tag) {
+			if (strlen(text_tag_names[tag]) == len && strncmp(list, text_tag_names[tag], len) == 0)
+				mask |= TEXT_TAG_MASK(tag);
+		}
+		
+		list += len;
+		if (*list)
+			++list;
+	}
+	
+	return mask;
+}
+
+void print_search_matches(CueDocument *doc,
+						  const char *search,
+						  uint32_t tags,
+						  String *str)
+{
+	TextIndex *index = cue_document_get_text_index(doc);
+	
+	size_t cap = 64;
+	TextMatch *matches = malloc(sizeof(TextMatch) * cap);
+	
+	size_t count = text_index_search(index, search, strlen(search), tags, matches, cap);
+	if (count > cap) {
+		cap = count;
+		matches = realloc(matches, sizeof(TextMatch) * cap);
+		text_index_search(index, search, strlen(search), tags, matches, cap);
+	}
+	
+	for (size_t i = 0; i < count; ++i) {
+		TextMatch *match = matches + i;
+		uint32_t line = 0;
+		uint32_t column = 0;
+		
+		cue_document_offset_to_line_col(doc, match->range.location, &line, &column);
+		
+		printf("%u:%u %s: %.*s\n", line + 1, column + 1, text_tag_names[match->tag], (int)match->range.length,
+			   str->buff + match->range.location);
+	}
+	
+	free(matches);
+}
+
+// Loads the text index from `path`. Returns 0 if it can't be read or was built from another source.
+int load_text_index(CueDocument *doc,
+					const char *path)
+{
+	String *data = string_from_file_path(path);
+	if (!data)
+		return 0;
+	
+	int loaded = cue_document_load_text_index(doc, data->buff, data->len);
+	
+	string_free(data);
+	
+	return loaded;
+}
+
+void write_text_index(TextIndex *index,
+					  const char *path)
+{
+	FILE *file = fopen(path, "wb");
+	
+	if (!file) {
+		perror("Error");
+		return;
+	}
+	
+	size_t size = text_index_serialized_size(index);
+	char *buffer = malloc(size);
+	
+	text_index_serialize(index, buffer);
+	fwrite(buffer, 1, size, file);
+	
+	free(buffer);
+	fclose(file);
+}
+
+// Loads a template from `path`, compiling it unless it was saved compiled.
+CueTemplate *load_template(const char *path)
+{
+	String *data = string_from_file_path(path);
+	if (!data)
+		return NULL;
+	
+	CueTemplate *template;
+	
+	if (cue_template_is_serialized(data->buff, data->len)) {
+		template = cue_template_deserialize(data->buff, data->len);
+		if (!template)
+			printf("%s isn't a compiled template this version can read.\n", path);
+	} else {
+		size_t error_offset = 0;
+		template = cue_template_compile(data->buff, data->len, &error_offset);
+		if (!template)
+			printf("Error in template %s at byte %zu.\n", path, error_offset);
+	}
+	
+	string_free(data);
+	
+	return template;
+}
+
+void write_template(CueTemplate *template,
+					const char *path)
+{
+	FILE *file = fopen(path, "wb");
+	
+	if (!file) {
+		perror("Error");
+		return;
+	}
+	
+	size_t size = cue_template_serialized_size(template);
+	char *buffer = malloc(size);
+	
+	cue_template_serialize(template, buffer);
+	fwrite(buffer, 1, size, file);
+	
+	free(buffer);
+	fclose(file);
+}
+
+void print_template(CueDocument *doc,
+					CueTemplate *template)
+{
+	fflush(stdout);
+	
+	MarkupContext *ctx = markup_context_new_with_fd(STDOUT_FILENO, 64 << 10);
+	cue_template_render(template, cue_document_get_root(doc), cue_document_get_source(doc), cue_document_get_table_of_contents(doc), ctx);
+	markup_context_flush(ctx);
+	
+	markup_context_free(ctx);
+}
+
+// Times compiling and loading a compiled copy of the template, then rendering with it against the hand-written HTML renderer.
+void benchmark_template_string(String *str,
+							   const char *file_name,
+							   int iterations,
+							   const char *template_path)
+{
+	String *source = string_from_file_path(template_path);
+	if (!source)
+		return;
+	
+	double t1 = wall_time();
+	
+	for (int i = 0; i < iterations; ++i) {
+		CueTemplate *template = cue_template_compile(source->buff, source->len, NULL);
+		if (!template) {
+			printf("Error in template %s.\n", template_path);
+			string_free(source);
+			return;
+		}
+		
+		cue_template_free(template);
+	}
+	
+	double compile_time = (wall_time() - t1) / iterations;
+	
+	CueTemplate *template = cue_template_compile(source->buff, source->len, NULL);
+	size_t size = cue_template_serialized_size(template);
+	char *compiled = malloc(size);
+	cue_template_serialize(template, compiled);
+	cue_template_free(template);
+	
+	t1 = wall_time();
+	
+	for (int i = 0; i < iterations; ++i)
+		cue_template_free(cue_template_deserialize(compiled, size));
+	
+	double load_time = (wall_time() - t1) / iterations;
+	
+	template = cue_template_deserialize(compiled, size);
+	
+	NodeAllocator *alloc = stack_allocator_new();
+	CueDocument *doc = cue_document_from_utf8(alloc, str->buff, str->len);
+	ASTNode *root = cue_document_get_root(doc);
+	TableOfContents *toc = cue_document_get_table_of_contents(doc);
+	MarkupContext *ctx = markup_context_new();
+	
+	t1 = wall_time();
+	
+	for (int i = 0; i < iterations; ++i) {
+		markup_context_clear(ctx);
+		cue_template_render(template, root, str->buff, toc, ctx);
+	}
+	
+	double template_time = (wall_time() - t1) / iterations;
+	size_t template_length = markup_context_get_length(ctx);
+	
+	t1 = wall_time();
+	
+	for (int i = 0; i < iterations; ++i) {
+		markup_context_clear(ctx);
+		render_html_to_markup_context(ctx, root, str->buff);
+	}
+	
+	double html_time = (wall_time() - t1) / iterations;
+	
+	printf("Averaged %f ms compiling %s and %f ms loading it compiled (%zu bytes) over %i iterations.\n",
+		   compile_time * 1e3, template_path, load_time * 1e3, size, iterations);
+	printf("Averaged %f seconds (%.1f MB/s) rendering %s to %zu bytes with the template, against %f seconds (%.1f MB/s) to %zu bytes of HTML, over %i iterations.\n",
+		   template_time, str->len / template_time / 1e6, file_name, template_length,
+		   html_time, str->len / html_time / 1e6, markup_context_get_length(ctx), iterations);
+	
+	markup_context_free(ctx);
+	cue_document_free(doc);
+	stack_allocator_free(alloc);
+	cue_template_free(template);
+	free(compiled);
+	string_free(source);
+}
+
+static const char diff_op_symbols[] = { '+', '-', '~' };
+
+// Prints up to 60 bytes of `range` on one line.
+static void print_diff_range(const char *source,
+							 SRange range)
+{
+	int length = range.length < 60 ? (int)range.length : 60;
+	
+	putchar('"');
+	for (int i = 0; i < length; ++i) {
+		char c = source[range.location + i];
+		putchar(c == '\n' || c == '\r' || c == '\t' ? ' ' : c);
+	}
+	printf("%s\"", length < (int)range.length ? "..." : "");
+}
+
+void print_diff(BlockDiff *diff,
+				const char *old_source,
+				const char *new_source)
+{
+	DiffOp *ops = block_diff_get_ops(diff);
+	size_t count = block_diff_count(diff);
+	
+	for (size_t i = 0; i < count; ++i) {
+		DiffOp *op = ops + i;
+		
+		printf("%c old %u+%u {%u, %u} new %u+%u {%u, %u}\n", diff_op_symbols[op->type], op->old_block, op->old_count,
+			   op->old_range.location, op->old_range.length, op->new_block, op->new_count, op->new_range.location, op->new_range.length);
+		
+		for (uint32_t c = 0; c < op->change_count; ++c) {
+			DiffOp *change = op->changes + c;
+			
+			printf("    %c ", diff_op_symbols[change->type]);
+			
+			if (change->type != DIFF_INSERT)
+				print_diff_range(old_source, change->old_range);
+			
+			if (change->type == DIFF_MODIFY)
+				printf(" -> ");
+			
+			if (change->type != DIFF_DELETE)
+				print_diff_range(new_source, change->new_range);
+			
+			printf("\n");
+		}
+	}
+}
+
+// The first diff hashes every block, and later ones reuse the hashes.
+void benchmark_diff(CueDocument *old_doc,
+					CueDocument *new_doc,
+					const char *file_name,
+					int iterations)
+{
+	double t1 = wall_time();
+	BlockDiff *diff = cue_document_diff(old_doc, new_doc);
+	double first = wall_time() - t1;
+	
+	size_t count = block_diff_count(diff);
+	block_diff_free(diff);
+	
+	t1 = wall_time();
+	
+	for (int i = 0; i < iterations; ++i)
+		block_diff_free(cue_document_diff(old_doc, new_doc));
+	
+	double time = (wall_time() - t1) / iterations;
+	
+	printf("Diffed %s in %f seconds with hashing, then averaged %f ms finding %zu changes over %i iterations.\n", file_name,
+		   first, time * 1e3, count, iterations);
+}
+
+typedef enum {
+	HTML_SINK_BUFFER,
+	HTML_SINK_REUSED_BUFFER,
+	HTML_SINK_RESERVED,
+	HTML_SINK_FD,
+	HTML_SINK_CHUNKS,
+	HTML_SINK_COUNT
+} HTMLSink;
+
+static const char *html_sink_names[HTML_SINK_COUNT] = { "a new buffer", "a reused buffer", "a reserved buffer", "a 64 KB fd buffer", "64 KB chunks" };
+
+// Renders into each kind of sink, writing to /dev/null where there's something to write.
+void benchmark_html_string(String *str,
+						   const char *file_name,
+						   int iterations)
+{
+	NodeAllocator *alloc = stack_allocator_new();
+	CueDocument *doc = cue_document_from_utf8(alloc, str->buff, str->len);
+	ASTNode *root = cue_document_get_root(doc);
+	
+	int null_fd = open("/dev/null", O_WRONLY);
+	MarkupContext *reused = markup_context_new();
+	
+	for (int sink = 0; sink < HTML_SINK_COUNT; ++sink) {
+		MarkupContextStats stats = { 0 };
+		
+		double t1 = wall_time();
+		
+		for (int i = 0; i < iterations; ++i) {
+			MarkupContext *ctx;
+			
+			switch (sink) {
+				case HTML_SINK_REUSED_BUFFER:
+					ctx = reused;
+					markup_context_clear(ctx);
+					break;
+				case HTML_SINK_RESERVED: {
+					MarkupContext *counter = markup_context_new_counting();
+					render_html_to_markup_context(counter, root, str->buff);
+					
+					ctx = markup_context_new();
+					markup_context_reserve(ctx, markup_context_get_length(counter));
+					markup_context_free(counter);
+					break;
+				}
+				case HTML_SINK_FD:
+					ctx = markup_context_new_with_fd(null_fd, 64 << 10);
+					break;
+				case HTML_SINK_CHUNKS:
+					ctx = markup_context_new_chunked(64 << 10);
+					break;
+				default:
+					ctx = markup_context_new();
+					break;
+			}
+			
+			render_html_to_markup_context(ctx, root, str->buff);
+			
+			if (sink == HTML_SINK_FD)
+				markup_context_flush(ctx);
+			else if (sink == HTML_SINK_CHUNKS)
+				markup_context_write_chunks(ctx, null_fd);
+			
+			stats = markup_context_get_stats(ctx);
+			
+			if (ctx != reused)
+				markup_context_free(ctx);
+		}
+		
+		double time = (wall_time() - t1) / iterations;
+		
+		printf("Averaged %f seconds (%.1f MB/s) rendering %s to %zu bytes of HTML in %s, copying %zu bytes in %zu growths with %zu flushes and %zu chunks, peaking at %zu bytes, over %i iterations.\n",
+			   time, str->len / time / 1e6, file_name, stats.bytes_written, html_sink_names[sink], stats.bytes_copied, stats.growths,
+			   stats.flushes, stats.chunks, stats.peak_memory, iterations);
+	}
+	
+	// The same renderer dispatched through its callback table rather than the generated switch.
+	double t1 = wall_time();
+	
+	for (int i = 0; i < iterations; ++i) {
+		markup_context_clear(reused);
+		render_with_callbacks(html_renderer_callbacks(), root, str->buff, reused);
+	}
+	
+	double time = (wall_time() - t1) / iterations;
+	
+	printf("Averaged %f seconds (%.1f MB/s) rendering %s through the callback table into a reused buffer over %i iterations.\n",
+		   time, str->len / time / 1e6, file_name, iterations);
+	
+	markup_context_free(reused);
+	close(null_fd);
+	cue_document_free(doc);
+	stack_allocator_free(alloc);
+}
+
+// Checks the output on every thread count against rendering on one thread.
+void benchmark_html_parallel(String *str,
+							 const char *file_name,
+							 int iterations,
+							 int max_threads)
+{
+	NodeAllocator *alloc = stack_allocator_new();
+	CueDocument *doc = cue_document_from_utf8(alloc, str->buff, str->len);
+	
+	MarkupContext *expected = markup_context_new();
+	render_html_to_markup_context(expected, cue_document_get_root(doc), str->buff);
+	StringBuffer *html = markup_context_get_string(expected);
+	
+	MarkupContext *ctx = markup_context_new();
+	
+	for (int threads = 1; threads <= max_threads; threads = (threads * 2 > max_threads && threads < max_threads) ? max_threads : threads * 2) {
+		double t1 = wall_time();
+		
+		for (int i = 0; i < iterations; ++i) {
+			markup_context_clear(ctx);
+			cue_document_render_html(doc, ctx, threads);
+		}
+		
+		double time = (wall_time() - t1) / iterations;
+		
+		StringBuffer *output = markup_context_get_string(ctx);
+		int same = output->length == html->length && memcmp(output->buffer, html->buffer, html->length) == 0;
+		
+		printf("Averaged %f seconds (%.1f MB/s) rendering %s on %i threads over %i iterations, %s.\n", time,
+			   str->len / time / 1e6, file_name, threads, iterations, same ? "matching one thread" : "DIFFERING from one thread");
+	}
+	
+	markup_context_free(ctx);
+	markup_context_free(expected);
+	cue_document_free(doc);
+	stack_allocator_free(alloc);
+}
+
+// Compares export with and without text against copying the same number of bytes, which is as fast as it could go.
+void benchmark_json_string(String *str,
+						   const char *file_name,
+						   int iterations)
+{
+	NodeAllocator *alloc = stack_allocator_new();
+	CueDocument *doc = cue_document_from_utf8(alloc, str->buff, str->len);
+	ASTNode *root = cue_document_get_root(doc);
+	TableOfContents *toc = cue_document_get_table_of_contents(doc);
+	
+	MarkupContext *ctx = markup_context_new();
+	
+	for (int options = JSON_DEFAULT; options <= JSON_INCLUDE_TEXT; ++options) {
+		double t1 = wall_time();
+		
+		for (int i = 0; i < iterations; ++i) {
+			markup_context_clear(ctx);
+			render_json_to_markup_context(ctx, root, str->buff, toc, options);
+		}
+		
+		double time = (wall_time() - t1) / iterations;
+		
+		StringBuffer *json = markup_context_get_string(ctx);
+		char *copy = malloc(json->length);
+		
+		t1 = wall_time();
+		
+		for (int i = 0; i < iterations; ++i) {
+			memcpy(copy, json->buffer, json->length);
+			
+			// Keeps the copies from being optimized away.
+			__asm__ volatile("" : : "r"(copy) : "memory");
+		}
+		
+		double copy_time = (wall_time() - t1) / iterations;
+		free(copy);
+		
+		printf("Averaged %f seconds (%.1f MB/s of JSON) exporting %s to %zu bytes of JSON %s, against %f seconds (%.1f MB/s) copying them, over %i iterations.\n",
+			   time, json->length / time / 1e6, file_name, json->length, options & JSON_INCLUDE_TEXT ? "with text" : "without text",
+			   copy_time, json->length / copy_time / 1e6, iterations);
+	}
+	
+	markup_context_free(ctx);
+	cue_document_free(doc);
+	stack_allocator_free(alloc);
+}
+
+void print_json(CueDocument *doc)
+{
+	fflush(stdout);
+	
+	MarkupContext *ctx = markup_context_new_with_fd(STDOUT_FILENO, 64 << 10);
+	render_json_to_markup_context(ctx, cue_document_get_root(doc), cue_document_get_source(doc), cue_document_get_table_of_contents(doc), JSON_INCLUDE_TEXT);
+	markup_context_put(ctx, "\n", 1);
+	markup_context_flush(ctx);
+	
+	markup_context_free(ctx);
+}
+
+static double benchmark_escaping(const char *text,
+								 size_t length,
+								 int iterations)
+{
+	MarkupContext *ctx = markup_context_new();
+	
+	double t1 = wall_time();
+	
+	for (int i = 0; i < iterations; ++i) {
+		markup_context_clear(ctx);
+		markup_context_put_escaped(ctx, text, (uint32_t)length);
+	}
+	
+	double time = (wall_time() - t1) / iterations;
+	
+	markup_context_free(ctx);
+	
+	return time;
+}
+
+// Escapes the source with every special character taken out, and again with one every 8 bytes.
+void benchmark_escape_string(String *str,
+							 const char *file_name,
+							 int iterations)
+{
+	static const char specials[] = "&<>\"'";
+	char *text = malloc(str->len + 1);
+	
+	for (size_t i = 0; i < str->len; ++i) {
+		uint32_t length;
+		text[i] = escape_entity((unsigned char)str->buff[i], &length) ? ' ' : str->buff[i];
+	}
+	
+	double plain_time = benchmark_escaping(text, str->len, iterations);
+	
+	for (size_t i = 7; i < str->len; i += 8)
+		text[i] = specials[(i / 8) % 5];
+	
+	double heavy_time = benchmark_escaping(text, str->len, iterations);
+	
+	printf("Averaged %f seconds (%.1f MB/s) escaping %s without special characters, and %f seconds (%.1f MB/s) with one every 8 bytes, over %i iterations.\n",
+		   plain_time, str->len / plain_time / 1e6, file_name, heavy_time, str->len / heavy_time / 1e6, iterations);
+	
+	free(text);
+}
+
+// Streams straight to stdout, so memory use doesn't grow with the document.
+void print_html(CueDocument *doc,
+				int threads)
+{
+	fflush(stdout);
+	
+	MarkupContext *ctx = markup_context_new_with_fd(STDOUT_FILENO, 64 << 10);
+	cue_document_render_html(doc, ctx, threads);
+	
+	// End with a new line, as long as there was anything to print.
+	markup_context_set_needs_new_line(ctx);
+	markup_context_put(ctx, "", 0);
+	markup_context_flush(ctx);
+	
+	markup_context_free(ctx);
+}
+
+void print_html_range(CueDocument *doc,
+					  SRange range)
+{
+	MarkupContext *ctx = markup_context_new();
+	cue_document_render_range(doc, range, html_renderer_callbacks(), ctx);
+	
+	StringBuffer *html = markup_context_get_string(ctx);
+	
+	if (html->length)
+		printf("%.*s\n", (int)html->length, html->buffer);
+	
+	markup_context_free(ctx);
+}
+
+// Renders a viewport of `window` bytes at `iterations` positions spread evenly through the document.
+void benchmark_html_range(String *str,
+						  const char *file_name,
+						  int iterations,
+						  uint32_t window)
+{
+	NodeAllocator *alloc = stack_allocator_new();
+	CueDocument *doc = cue_document_from_utf8(alloc, str->buff, str->len);
+	MarkupContext *ctx = markup_context_new();
+	
+	double t1 = wall_time();
+	render_html_to_markup_context(ctx, cue_document_get_root(doc), str->buff);
+	double full_time = wall_time() - t1;
+	
+	size_t bytes = 0;
+	
+	t1 = wall_time();
+	
+	for (int i = 0; i < iterations; ++i) {
+		uint32_t location = (uint32_t)(str->len * i / iterations);
+		
+		markup_context_clear(ctx);
+		cue_document_render_range(doc, (SRange){ location, window }, html_renderer_callbacks(), ctx);
+		bytes += markup_context_get_length(ctx);
+	}
+	
+	double time = (wall_time() - t1) / iterations;
+	
+	printf("Rendered %s in %f ms.\n", file_name, full_time * 1e3);
+	printf("Averaged %f ms (%.2f%% of the whole) rendering %zu bytes of HTML for a %u byte viewport at %i positions.\n",
+		   time * 1e3, 100.0 * time / full_time, bytes / iterations, window, iterations);
+	
+	markup_context_free(ctx);
+	cue_document_free(doc);
+	stack_allocator_free(alloc);
+}
+
+void print_highlight_spans(CueDocument *doc,
+						   SRange range)
+{
+	const char *source = cue_document_get_source(doc);
+	size_t count = cue_document_highlight_spans(doc, range, NULL, 0);
+	CueSpan *spans = malloc(count * sizeof(CueSpan));
+	cue_document_highlight_spans(doc, range, spans, count);
+	
+	for (size_t i = 0; i < count; ++i) {
+		SRange span = spans[i].range;
+		printf("%u %u %s%s \"%.*s\"\n", span.location, span.length, ast_node_type_description(spans[i].type),
+			   spans[i].flags & CUE_SPAN_DELIMITER ? " delimiter" : "", (int)span.length, source + span.location);
+	}
+	
+	free(spans);
+}
+
+// Highlights a viewport of `window` bytes at `iterations` positions spread evenly through the document, into a buffer of a screenful of spans.
+void benchmark_highlight_range(String *str,
+							   const char *file_name,
+							   int iterations,
+							   uint32_t window)
+{
+	NodeAllocator *alloc = stack_allocator_new();
+	CueDocument *doc = cue_document_from_utf8(alloc, str->buff, str->len);
+	
+	size_t whole = cue_document_highlight_spans(doc, (SRange){ 0, (uint32_t)str->len }, NULL, 0);
+	CueSpan *spans = malloc(whole * sizeof(CueSpan));
+	
+	double t1 = wall_time();
+	cue_document_highlight_spans(doc, (SRange){ 0, (uint32_t)str->len }, spans, whole);
+	double full_time = wall_time() - t1;
+	
+	CueSpan screen[1024];
+	size_t count = 0;
+	
+	t1 = wall_time();
+	
+	for (int i = 0; i < iterations; ++i) {
+		uint32_t location = (uint32_t)(str->len * i / iterations);
+		count += cue_document_highlight_spans(doc, (SRange){ location, window }, screen, 1024);
+	}
+	
+	double time = (wall_time() - t1) / iterations;
+	
+	// Every viewport's spans should be the whole document's spans that overlap it, including those cut by its edges.
+	CueSpan *part = malloc((whole + 1) * sizeof(CueSpan));
+	uint32_t seed = 12345;
+	int matches = 1;
+	
+	for (int i = 0; i < iterations && matches; ++i) {
+		seed = seed * 1103515245 + 12345;
+		uint32_t location = (uint32_t)((seed >> 8) % (str->len + 1));
+		seed = seed * 1103515245 + 12345;
+		uint32_t length = (seed >> 8) % (window + 1);
+		if (length > str->len - location)
+			length = (uint32_t)(str->len - location);
+		
+		uint32_t end = location + (length ? length : 1);
+		
+		size_t first = 0;
+		size_t hi = whole;
+		while (first < hi) {
+			size_t mid = first + (hi - first) / 2;
+			if (s_range_max(spans[mid].range) <= location)
+				first = mid + 1;
+			else
+				hi = mid;
+		}
+		
+		size_t last = first;
+		while (last < whole && spans[last].range.location < end)
+			++last;
+		
+		size_t n = cue_document_highlight_spans(doc, (SRange){ location, length }, part, whole);
+		matches = n == last - first && !memcmp(part, spans + first, n * sizeof(CueSpan));
+	}
+	
+	printf("Highlighted %s as %zu spans in %f ms.\n", file_name, whole, full_time * 1e3);
+	printf("Averaged %f us finding %zu spans for a %u byte viewport at %i positions; random viewports %s the whole document's spans.\n",
+		   time * 1e6, count / iterations, window, iterations,
+		   matches ? "match" : "DO NOT match");
+	
+	free(part);
+	free(spans);
+	cue_document_free(doc);
+	stack_allocator_free(alloc);
+}
+
+// Types a letter at a pseudo-random offset before each re-render, the way a live preview sees edits.
+void benchmark_preview_string(String *str,
+							  const char *file_name,
+							  int iterations)
+{
+	size_t length = str->len;
+	char *source = malloc(length + iterations);
+	memcpy(source, str->buff, length);
+	
+	NodeAllocator *alloc = stack_allocator_new();
+	MarkupContext *ctx = markup_context_new();
+	RenderCache *cache = render_cache_new(render_html_to_markup_context, 64 << 20);
+	
+	CueDocument *doc = cue_document_from_utf8(alloc, source, length);
+	
+	double t1 = wall_time();
+	render_html_to_markup_context(ctx, cue_document_get_root(doc), source);
+	double full_time = wall_time() - t1;
+	
+	size_t count;
+	ASTNode **blocks = cue_document_get_blocks(doc, &count);
+	
+	markup_context_clear(ctx);
+	t1 = wall_time();
+	render_cache_render(cache, blocks, count, source, ctx);
+	double cold_time = wall_time() - t1;
+	
+	cue_document_free(doc);
+	
+	RenderCacheStats cold = render_cache_get_stats(cache);
+	double parse_time = 0;
+	double render_time = 0;
+	uint32_t seed = 12345;
+	
+	for (int i = 0; i < iterations; ++i) {
+		seed = seed * 1103515245 + 12345;
+		size_t offset = (seed >> 8) % length;
+		
+		memmove(source + offset + 1, source + offset, length - offset);
+		source[offset] = 'e';
+		++length;
+		
+		t1 = wall_time();
+		stack_allocator_reset(alloc);
+		doc = cue_document_from_utf8(alloc, source, length);
+		double t2 = wall_time();
+		
+		blocks = cue_document_get_blocks(doc, &count);
+		markup_context_clear(ctx);
+		render_cache_render(cache, blocks, count, source, ctx);
+		double t3 = wall_time();
+		
+		cue_document_free(doc);
+		
+		parse_time += t2 - t1;
+		render_time += t3 - t2;
+	}
+	
+	RenderCacheStats stats = render_cache_get_stats(cache);
+	uint64_t hits = stats.hits - cold.hits;
+	uint64_t misses = stats.misses - cold.misses;
+	
+	printf("Rendered %s in %f ms, or %f ms filling an empty cache.\n", file_name, full_time * 1e3, cold_time * 1e3);
+	printf("Averaged %f ms parsing and %f ms rendering per keystroke with %.2f%% hits (%zu fragments, %zu bytes) over %i keystrokes.\n",
+		   parse_time / iterations * 1e3, render_time / iterations * 1e3, 100.0 * hits / (hits + misses),
+		   stats.count, stats.bytes, iterations);
+	
+	render_cache_free(cache);
+	markup_context_free(ctx);
+	stack_allocator_free(alloc);
+	free(source);
+}
+
+void print_pages(CueDocument *doc)
+{
+	PageLayout layout = page_layout_default();
+	Pagination *pagination = pagination_new(&layout);
+	
+	size_t count;
+	ASTNode **blocks = cue_document_get_blocks(doc, &count);
+	pagination_layout(pagination, blocks, count, cue_document_get_source(doc));
+	
+	size_t page_count;
+	const PageBreak *breaks = pagination_get_breaks(pagination, &page_count);
+	printf("%zu pages\n", page_count);
+	
+	for (size_t i = 0; i < page_count; ++i) {
+		uint32_t line = 0;
+		uint32_t column = 0;
+		
+		if (breaks[i].block < count)
+			cue_document_offset_to_line_col(doc, blocks[breaks[i].block]->range.location, &line, &column);
+		
+		printf("Page %zu: block %u, line %u", i + 1, breaks[i].block, line + 1);
+		if (breaks[i].line)
+			printf(", from its line %u%s", breaks[i].line + 1, breaks[i].continued ? " (CONT'D)" : "");
+		printf("\n");
+	}
+	
+	pagination_free(pagination);
+}
+
+// Returns 1 if `pagination` breaks `blocks` into the same pages as laying them out from scratch.
+static int pagination_matches_layout(Pagination *pagination,
+									 const PageLayout *layout,
+									 ASTNode **blocks,
+									 size_t count,
+									 const char *source)
+{
+	Pagination *check = pagination_new(layout);
+	pagination_layout(check, blocks, count, source);
+	
+	size_t edited_count, check_count;
+	const PageBreak *edited = pagination_get_breaks(pagination, &edited_count);
+	const PageBreak *expected = pagination_get_breaks(check, &check_count);
+	int matches = edited_count == check_count && !memcmp(edited, expected, check_count * sizeof(PageBreak));
+	
+	pagination_free(check);
+	
+	return matches;
+}
+
+// Makes a pseudo-random edit before each update and checks the incremental result against a full layout. Most edits type a letter, and the rest type a new line, split a block, delete a few bytes, join two blocks or add a scene header. Pages of a few lines are checked as well, since they put a break next to almost every edit.
+void benchmark_pages_string(String *str,
+							const char *file_name,
+							int iterations)
+{
+	size_t length = str->len;
+	const char *header = "Scene 9\n\n";
+	char *source = malloc(length + strlen(header) * iterations);
+	memcpy(source, str->buff, length);
+	
+	NodeAllocator *alloc = stack_allocator_new();
+	PageLayout layout = page_layout_default();
+	Pagination *pagination = pagination_new(&layout);
+	
+	PageLayout short_layout = layout;
+	short_layout.lines_per_page = 7;
+	Pagination *short_pagination = pagination_new(&short_layout);
+	
+	CueDocument *doc = cue_document_from_utf8(alloc, source, length);
+	size_t count;
+	ASTNode **blocks = cue_document_get_blocks(doc, &count);
+	
+	double t1 = wall_time();
+	pagination_layout(pagination, blocks, count, source);
+	double full_time = wall_time() - t1;
+	size_t page_count = pagination_get_page_count(pagination);
+	
+	pagination_layout(short_pagination, blocks, count, source);
+	
+	cue_document_free(doc);
+	
+	double edit_time = 0;
+	size_t laid_out = 0;
+	int mismatches = 0;
+	uint32_t seed = 12345;
+	
+	for (int i = 0; i < iterations; ++i) {
+		seed = seed * 1103515245 + 12345;
+		size_t offset = (seed >> 8) % length;
+		uint32_t old_length = 0;
+		const char *typed = NULL;
+		
+		switch (seed >> 29) {
+			case 0:
+				typed = "\n";
+				break;
+			case 1:
+				typed = "\n\n";
+				break;
+			case 2:
+				old_length = length - offset < 4 ? (uint32_t)(length - offset) : 4;
+				break;
+			case 3: {
+				// Joins the block at offset to the next one by taking out a blank line.
+				size_t gap = offset;
+				while (gap + 1 < length && !(source[gap] == '\n' && source[gap + 1] == '\n'))
+					++gap;
+				
+				if (gap + 1 < length)
+					offset = gap;
+				
+				old_length = 1;
+				break;
+			}
+			case 4:
+				typed = header;
+				break;
+			default:
+				typed = "e";
+				break;
+		}
+		
+		uint32_t new_length = typed ? (uint32_t)strlen(typed) : 0;
+		
+		memmove(source + offset + new_length, source + offset + old_length, length - offset - old_length);
+		if (typed)
+			memcpy(source + offset, typed, new_length);
+		length = length - old_length + new_length;
+		
+		stack_allocator_reset(alloc);
+		doc = cue_document_from_utf8(alloc, source, length);
+		blocks = cue_document_get_blocks(doc, &count);
+		
+		t1 = wall_time();
+		pagination_edit(pagination, blocks, count, source, (uint32_t)offset, old_length, new_length);
+		edit_time += wall_time() - t1;
+		laid_out += pagination_get_blocks_laid_out(pagination);
+		
+		pagination_edit(short_pagination, blocks, count, source, (uint32_t)offset, old_length, new_length);
+		
+		if (!pagination_matches_layout(pagination, &layout, blocks, count, source) ||
+			!pagination_matches_layout(short_pagination, &short_layout, blocks, count, source)) {
+			++mismatches;
+			
+			// Start the next edit from the right pages.
+			pagination_layout(pagination, blocks, count, source);
+			pagination_layout(short_pagination, blocks, count, source);
+		}
+		
+		cue_document_free(doc);
+	}
+	
+	printf("Paginated %s into %zu pages in %f ms.\n", file_name, page_count, full_time * 1e3);
+	
+	if (mismatches)
+		printf("Averaged %f ms (%.1f blocks laid out) per edit over %i edits; the result DOES NOT match a full layout after %i of them.\n",
+			   edit_time / iterations * 1e3, (double)laid_out / iterations, iterations, mismatches);
+	else
+		printf("Averaged %f ms (%.1f blocks laid out) per edit over %i edits; the result matches a full layout after every one.\n",
+			   edit_time / iterations * 1e3, (double)laid_out / iterations, iterations);
+	
+	pagination_free(short_pagination);
+	pagination_free(pagination);
+	stack_allocator_free(alloc);
+	free(source);
+}
+
 CLIRequest *parse_cli_request(const char *args[],
 							  int num_args)
 {
@@ -129,6 +1381,19 @@ CLIRequest *parse_cli_request(const char *args[],
 	const char **file_paths = malloc(sizeof(char*) * num_args);
 	int num_file_paths = 0;
 	int bench_iterations = 0;
+	const char *query = NULL;
+	const char *character = NULL;
+	const char *reference = NULL;
+	const char *diff = NULL;
+	int threads = 1;
+	int parse_options = CUE_PARSE_DEFAULT;
+	const char *search = NULL;
+	uint32_t search_tags = TEXT_TAG_MASK_ALL;
+	const char *read_index = NULL;
+	const char *write_index = NULL;
+	SRange range = { 0, 0 };
+	const char *template = NULL;
+	const char *write_template = NULL;
 	
 	for (int i = 1; i < num_args; ++i) {
 		if (strcmp(args[i], "--bench") == 0) {
@@ -137,6 +1402,70 @@ CLIRequest *parse_cli_request(const char *args[],
 				bench_iterations = 20;
 		} else if (strcmp(args[i], "--ast") == 0) {
 			options |= CUE_OPTION_AST;
+		} else if (strcmp(args[i], "--query") == 0 && i + 1 < num_args) {
+			options |= CUE_OPTION_QUERY;
+			query = args[++i];
+		} else if (strcmp(args[i], "--outline") == 0) {
+			options |= CUE_OPTION_OUTLINE;
+		} else if (strcmp(args[i], "--toc") == 0) {
+			options |= CUE_OPTION_TOC;
+		} else if (strcmp(args[i], "--index") == 0) {
+			parse_options |= CUE_PARSE_NODE_INDEX;
+		} else if (strcmp(args[i], "--utf16") == 0) {
+			parse_options |= CUE_PARSE_UTF16_OFFSETS;
+		} else if (strcmp(args[i], "--characters") == 0) {
+			options |= CUE_OPTION_CHARACTERS;
+			parse_options |= CUE_PARSE_CHARACTER_INDEX;
+		} else if (strcmp(args[i], "--character") == 0 && i + 1 < num_args) {
+			character = args[++i];
+			parse_options |= CUE_PARSE_CHARACTER_INDEX;
+		} else if (strcmp(args[i], "--references") == 0) {
+			options |= CUE_OPTION_REFERENCES;
+			parse_options |= CUE_PARSE_REFERENCE_TABLE;
+		} else if (strcmp(args[i], "--reference") == 0 && i + 1 < num_args) {
+			reference = args[++i];
+			parse_options |= CUE_PARSE_REFERENCE_TABLE;
+		} else if (strcmp(args[i], "--diff") == 0 && i + 1 < num_args) {
+			diff = args[++i];
+		} else if (strcmp(args[i], "--html") == 0) {
+			options |= CUE_OPTION_HTML;
+		} else if (strcmp(args[i], "--range") == 0 && i + 1 < num_args) {
+			// LOCATION,LENGTH in bytes.
+			options |= CUE_OPTION_RANGE;
+			char *end;
+			range.location = (uint32_t)strtoul(args[++i], &end, 10);
+			range.length = *end == ',' ? (uint32_t)strtoul(end + 1, NULL, 10) : 0;
+		} else if (strcmp(args[i], "--template") == 0 && i + 1 < num_args) {
+			template = args[++i];
+		} else if (strcmp(args[i], "--write-template") == 0 && i + 1 < num_args) {
+			write_template = args[++i];
+		} else if (strcmp(args[i], "--json") == 0) {
+			options |= CUE_OPTION_JSON;
+		} else if (strcmp(args[i], "--pages") == 0) {
+			options |= CUE_OPTION_PAGES;
+		} else if (strcmp(args[i], "--highlight") == 0) {
+			options |= CUE_OPTION_HIGHLIGHT;
+		} else if (strcmp(args[i], "--escape") == 0) {
+			options |= CUE_OPTION_ESCAPE;
+		} else if (strcmp(args[i], "--preview") == 0) {
+			options |= CUE_OPTION_PREVIEW;
+		} else if (strcmp(args[i], "--stats") == 0) {
+			options |= CUE_OPTION_STATS;
+		} else if (strcmp(args[i], "--threads") == 0 && i + 1 < num_args) {
+			threads = atoi(args[++i]);
+			if (threads < 1)
+				threads = 1;
+		} else if (strcmp(args[i], "--validate") == 0) {
+			parse_options |= CUE_PARSE_VALIDATE_UTF8;
+		} else if (strcmp(args[i], "--search") == 0 && i + 1 < num_args) {
+			options |= CUE_OPTION_SEARCH;
+			search = args[++i];
+		} else if (strcmp(args[i], "--search-in") == 0 && i + 1 < num_args) {
+			search_tags = parse_text_tags(args[++i]);
+		} else if (strcmp(args[i], "--read-index") == 0 && i + 1 < num_args) {
+			read_index = args[++i];
+		} else if (strcmp(args[i], "--write-index") == 0 && i + 1 < num_args) {
+			write_index = args[++i];
 		} else {
 			file_paths[num_file_paths++] = args[i];
 		}
@@ -147,6 +1476,23 @@ CLIRequest *parse_cli_request(const char *args[],
 	
 	CLIRequest *req = cli_request_new(file_paths, num_file_paths,
 									  bench_iterations, options);
+	req->query = query;
+	req->character = character;
+	req->reference = reference;
+	req->diff = diff;
+	req->threads = threads;
+	req->parse_options = parse_options;
+	req->search = search;
+	req->search_tags = search_tags;
+	req->read_index = read_index;
+	req->write_index = write_index;
+	req->range = range;
+	req->template = template;
+	req->write_template = write_template;
+	
+	// A saved index saves building one.
+	if ((search || write_index) && !read_index)
+		req->parse_options |= CUE_PARSE_TEXT_INDEX;
 	
 	return req;
 }
@@ -161,17 +1507,161 @@ void handle_request(CLIRequest *req)
 			break;
 		
 		if (req->bench_iterations) {
-			benchmark_parsing_string(str, file_path, req->bench_iterations);
+			if (req->options & CUE_OPTION_OUTLINE)
+				benchmark_outline_string(str, file_path, req->bench_iterations);
+			
+			if (req->options & CUE_OPTION_STATS)
+				benchmark_stats_string(str, file_path, req->bench_iterations, req->threads);
+			
+			if (req->options & CUE_OPTION_SEARCH)
+				benchmark_search_string(str, file_path, req->bench_iterations, req->search, req->search_tags);
+			
+			if (req->options & CUE_OPTION_PREVIEW)
+				benchmark_preview_string(str, file_path, req->bench_iterations);
+			
+			if (req->options & CUE_OPTION_HIGHLIGHT)
+				benchmark_highlight_range(str, file_path, req->bench_iterations, req->range.length ? req->range.length : 4096);
+			
+			if ((req->options & CUE_OPTION_HTML) && (req->options & CUE_OPTION_RANGE))
+				benchmark_html_range(str, file_path, req->bench_iterations, req->range.length);
+			else if ((req->options & CUE_OPTION_HTML) && req->threads > 1)
+				benchmark_html_parallel(str, file_path, req->bench_iterations, req->threads);
+			else if (req->options & CUE_OPTION_HTML)
+				benchmark_html_string(str, file_path, req->bench_iterations);
+			
+			if (req->template)
+				benchmark_template_string(str, file_path, req->bench_iterations, req->template);
+			
+			if (req->options & CUE_OPTION_JSON)
+				benchmark_json_string(str, file_path, req->bench_iterations);
+			
+			if (req->options & CUE_OPTION_PAGES)
+				benchmark_pages_string(str, file_path, req->bench_iterations);
+			
+			if (req->options & CUE_OPTION_ESCAPE)
+				benchmark_escape_string(str, file_path, req->bench_iterations);
+			
+			benchmark_parsing_string(str, file_path, req->bench_iterations, req->parse_options);
+		}
+		
+		if ((req->options & CUE_OPTION_OUTLINE) && !req->bench_iterations) {
+			cue_scan_outline(str->buff, str->len, print_outline_item, str);
 		}
 		
 		NodeAllocator *alloc = stack_allocator_new();
-		CueDocument *doc = cue_document_from_utf8(alloc, str->buff, str->len);
+		
+		size_t error_offset = 0;
+		CueDocument *doc = cue_document_from_utf8_checked(alloc, str->buff, str->len, req->parse_options, &error_offset);
+		
+		if (!doc) {
+			printf("Invalid UTF-8 at byte %zu of %s.\n", error_offset, file_path);
+			stack_allocator_free(alloc);
+			string_free(str);
+			continue;
+		}
 		
 		if (req->options & CUE_OPTION_AST) {
 			ASTNode *root = cue_document_get_root(doc);
 			ast_node_print_description(root, 1);
 		}
 		
+		if ((req->options & CUE_OPTION_HTML) && !req->bench_iterations) {
+			if (req->options & CUE_OPTION_RANGE)
+				print_html_range(doc, req->range);
+			else
+				print_html(doc, req->threads);
+		}
+		
+		if ((req->options & CUE_OPTION_JSON) && !req->bench_iterations) {
+			print_json(doc);
+		}
+		
+		if ((req->options & CUE_OPTION_PAGES) && !req->bench_iterations) {
+			print_pages(doc);
+		}
+		
+		if ((req->options & CUE_OPTION_HIGHLIGHT) && !req->bench_iterations) {
+			SRange range = { 0, (uint32_t)cue_document_get_length(doc) };
+			print_highlight_spans(doc, (req->options & CUE_OPTION_RANGE) ? req->range : range);
+		}
+		
+		if ((req->template || req->write_template) && !req->bench_iterations) {
+			CueTemplate *template = req->template ? load_template(req->template) : NULL;
+			
+			if (template && req->write_template)
+				write_template(template, req->write_template);
+			else if (template)
+				print_template(doc, template);
+			
+			if (template)
+				cue_template_free(template);
+		}
+		
+		if (req->options & CUE_OPTION_TOC) {
+			TableOfContents *toc = cue_document_get_table_of_contents(doc);
+			print_table_of_contents(toc, str);
+		}
+		
+		if (req->options & CUE_OPTION_QUERY) {
+			ASTNode *root = cue_document_get_root(doc);
+			print_query_matches(req->query, root, str);
+		}
+		
+		if (req->options & CUE_OPTION_CHARACTERS) {
+			print_characters(cue_document_get_character_index(doc));
+		}
+		
+		if ((req->options & CUE_OPTION_STATS) && !req->bench_iterations) {
+			StatsTable *table = cue_document_compute_stats(doc, req->threads);
+			print_stats(table, str);
+			stats_table_free(table);
+		}
+		
+		if (req->character) {
+			print_dialogue(cue_document_get_character_index(doc), req->character, str);
+		}
+		
+		if (req->diff) {
+			String *old_str = string_from_file_path(req->diff);
+			
+			if (old_str) {
+				NodeAllocator *old_alloc = stack_allocator_new();
+				CueDocument *old_doc = cue_document_from_utf8(old_alloc, old_str->buff, old_str->len);
+				
+				if (req->bench_iterations) {
+					benchmark_diff(old_doc, doc, file_path, req->bench_iterations);
+				} else {
+					BlockDiff *diff = cue_document_diff(old_doc, doc);
+					print_diff(diff, old_str->buff, str->buff);
+					block_diff_free(diff);
+				}
+				
+				cue_document_free(old_doc);
+				stack_allocator_free(old_alloc);
+				string_free(old_str);
+			}
+		}
+		
+		if (req->options & CUE_OPTION_REFERENCES) {
+			print_references(cue_document_get_reference_table(doc), cue_document_get_table_of_contents(doc));
+		}
+		
+		if (req->reference) {
+			print_reference_scenes(cue_document_get_reference_table(doc), req->reference, str);
+		}
+		
+		if (req->read_index && !load_text_index(doc, req->read_index)) {
+			printf("%s isn't an index of %s.\n", req->read_index, file_path);
+		}
+		
+		if ((req->options & CUE_OPTION_SEARCH) && !req->bench_iterations && cue_document_get_text_index(doc)) {
+			print_search_matches(doc, req->search, req->search_tags, str);
+		}
+		
+		if (req->write_index && cue_document_get_text_index(doc)) {
+			write_text_index(cue_document_get_text_index(doc), req->write_index);
+		}
+		
 		cue_document_free(doc);
 		stack_allocator_free(alloc);
 		
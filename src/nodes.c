@@ -110,6 +110,41 @@ int ast_node_is_direction(ASTNode * node)
 	return node->type == S_NODE_PLAIN_DIRECTION || node->type == S_NODE_LYRIC_DIRECTION;
 }
 
+uint32_t ast_node_type_descendant_mask(ASTNodeType type)
+{
+	const uint32_t streams = S_NODE_MASK(S_NODE_STREAM) | S_NODE_MASK_INLINES;
+	const uint32_t lines = S_NODE_MASK(S_NODE_LINE) | streams;
+	const uint32_t cues = S_NODE_MASK(S_NODE_NAME) | S_NODE_MASK(S_NODE_PLAIN_DIRECTION) | S_NODE_MASK(S_NODE_LYRIC_DIRECTION) | lines;
+	
+	switch (type) {
+		case S_NODE_DOCUMENT:
+			return S_NODE_MASK_ALL & ~S_NODE_MASK(S_NODE_DOCUMENT);
+		case S_NODE_HEADER:
+			return S_NODE_MASK(S_NODE_KEYWORD) | S_NODE_MASK(S_NODE_IDENTIFIER) | S_NODE_MASK(S_NODE_TITLE) | streams;
+		case S_NODE_SIMULTANEOUS_CUES:
+			return S_NODE_MASK(S_NODE_CUE) | cues;
+		case S_NODE_CUE:
+			return cues;
+		case S_NODE_FACSIMILE:
+		case S_NODE_LYRIC_DIRECTION:
+			return lines;
+		case S_NODE_DESCRIPTION:
+		case S_NODE_PLAIN_DIRECTION:
+		case S_NODE_LINE:
+		case S_NODE_TITLE:
+			return streams;
+		case S_NODE_STREAM:
+		case S_NODE_EMPHASIS:
+		case S_NODE_STRONG:
+		case S_NODE_REFERENCE:
+		case S_NODE_PARENTHETICAL:
+		case S_NODE_COMMENT:
+			return S_NODE_MASK_INLINES;
+		default:
+			return 0;
+	}
+}
+
 int ast_node_is_stream_container(ASTNode *node)
 {
 	return node->type == S_NODE_TITLE || node->type == S_NODE_LINE || node->type == S_NODE_DESCRIPTION;
@@ -37,6 +37,13 @@ typedef enum
 	S_NODE_COMMENT,
 } ASTNodeType;
 
+#define S_NODE_TYPE_COUNT (S_NODE_COMMENT + 1)
+
+/* Node types can be combined into a bit mask for filtering. */
+#define S_NODE_MASK(type) ((uint32_t)1 << (type))
+#define S_NODE_MASK_ALL (S_NODE_MASK(S_NODE_TYPE_COUNT) - 1)
+#define S_NODE_MASK_INLINES (S_NODE_MASK(S_NODE_LITERAL) | S_NODE_MASK(S_NODE_EMPHASIS) | S_NODE_MASK(S_NODE_STRONG) | S_NODE_MASK(S_NODE_REFERENCE) | S_NODE_MASK(S_NODE_PARENTHETICAL) | S_NODE_MASK(S_NODE_COMMENT))
+
 typedef struct
 {
 	uint32_t location, length;
@@ -107,8 +114,16 @@ int ast_node_is_type(ASTNode *node,
 
 int ast_node_is_direction(ASTNode * node);
 
+/** Returns a mask of every node type that can appear below a node of type
+ * `type`. Walks can use this to skip subtrees that can't hold what they want.
+ */
+uint32_t ast_node_type_descendant_mask(ASTNodeType type);
+
 void ast_node_unlink(ASTNode *node);
 
+/** Returns a readable name for `type`, like "simultaneous cues". */
+const char *ast_node_type_description(ASTNodeType type);
+
 void ast_node_print_description(ASTNode *node,
 								int recurse);
 
@@ -7,12 +7,31 @@
 #include "nodes.h"
 #include "Scanner.h"
 #include "inlines.h"
+#include "NodeIndex.h"
+#include "TableOfContents.h"
+#include "CharacterIndex.h"
+#include "ReferenceTable.h"
+#include "HeaderCounter.h"
 
 typedef struct {
 	NodeAllocator *node_allocator;
 	ASTNode *root;
 	Scanner *scanner;
 	DelimiterStack *delimiter_stack;
+	int options;
+	
+	// Only present when parsing with CUE_PARSE_NODE_INDEX.
+	NodeIndex *node_index;
+	
+	TableOfContents *toc;
+	
+	// Only present when parsing with CUE_PARSE_CHARACTER_INDEX.
+	CharacterIndex *characters;
+	
+	// Only present when parsing with CUE_PARSE_REFERENCE_TABLE.
+	ReferenceTable *references;
+	
+	HeaderCounter header_counter;
 	
 	/** This data is currently being stored in `scanner` and should probably
 	 * be used from here instead.